@@ -4,8 +4,61 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
+#if XMEM_FREE_INDEX_ENABLE
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
+
+#if XMEM_POOL_FILE_ENABLE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#if XMEM_POOL_SHARED_ENABLE
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if XMEM_EPOCH_ENABLE
+#include <sched.h>
+#endif
+
+#if XMEM_MAINT_ENABLE
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#ifndef xMemPageRelease
+#define xMemPageRelease(addr,size)  madvise(addr,size,MADV_DONTNEED)
+#endif
+#endif
+
+#if XMEM_TUNE_ENABLE
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if XMEM_PROFILE_ENABLE
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <execinfo.h>
+#ifndef xMemBacktrace
+#define xMemBacktrace   backtrace
+#endif
+#endif
+
 
 #if XMEM_DEBUG
 
@@ -17,10 +70,36 @@
 
 #endif
 
+#ifndef xMemAssert
 #define xMemAssert   assert
+#endif
+#if XMEM_SHIM_ENABLE
+//stdio might call malloc, the shim prints to stderr without it
+int xMemShimPrintf(const char *fmt, ...);
+#define xMemPrintf  xMemShimPrintf
+#endif
+
+#ifndef xMemPrintf
 #define xMemPrintf  printf
+#endif
 
+#if XMEM_POOL_SHARED_ENABLE
+//every process of the shared pool locks the mutex in the region
+void xMemSharedLock(void);
+void xMemSharedUnlock(void);
+#ifndef SYS_ENTER_CRITICAL_SECTION
+#define SYS_ENTER_CRITICAL_SECTION  xMemSharedLock()
+#endif
+#ifndef SYS_EXIT_CRITICAL_SECTION
+#define SYS_EXIT_CRITICAL_SECTION   xMemSharedUnlock()
+#endif
+#endif
+
+#ifndef SYS_ENTER_CRITICAL_SECTION
 #define SYS_ENTER_CRITICAL_SECTION
+#endif
+#ifndef SYS_EXIT_CRITICAL_SECTION
 #define SYS_EXIT_CRITICAL_SECTION
+#endif
 
 #endif // __PLATFORM_H__
@@ -1,18 +1,85 @@
 #ifndef __XCONFIG_H__
 #define __XCONFIG_H__
 
+#ifndef XMEM_POOL_OPPOSITE
 #define XMEM_POOL_OPPOSITE   0
+#endif
 
+#ifndef XMEM_DEBUG
 #define XMEM_DEBUG    0
+#endif
 
+#ifndef CPU_64_BIT
 #define CPU_64_BIT    0
+#endif
 
+#ifndef XMEM_POOL_SIZE
 #define XMEM_POOL_SIZE    (1024*10)
+#endif
 
+#ifndef XMEM_SUPERBLOCK_ENABLE
 #define XMEM_SUPERBLOCK_ENABLE    1
+#endif
 
 #define XMEM_SUPERBLOCK_BLKS_MAX      32
 
+/* empty super blocks a list keeps instead of freeing them, so a count of small blocks that
+   swings around a super block boundary does not allocate and free it over and over */
+#ifndef XMEM_SUPERBLOCK_KEEP
+#define XMEM_SUPERBLOCK_KEEP    1
+#endif
+
+/* free slots each super block list gets at xMemInit, as if xMemReserve was called for it */
+#ifndef XMEM_SUPERBLOCK_RESERVE
+#define XMEM_SUPERBLOCK_RESERVE    0
+#endif
+
+/* 1 to touch every page of the pool in xMemInit, the first requests do not take page faults */
+#ifndef XMEM_POOL_PREFAULT
+#define XMEM_POOL_PREFAULT    0
+#endif
+
+#define XMEM_PAGE_SIZE    4096
+
+/* 1 when built into the LD_PRELOAD malloc replacement, see xmem_shim.c */
+#ifndef XMEM_SHIM_ENABLE
+#define XMEM_SHIM_ENABLE    0
+#endif
+
+/******************************************************************************************
+ * file backed pool, xMemFileOpen maps a file as the pool instead of xmempool and a later
+ * process re-attaches to the heap in it. xMemFileClose saves the heap state in the file
+ * header. the file is always mapped at the address it was created at, so pointers inside
+ * the heap stay valid, xMemRootSet/xMemRootGet keep the object to start from
+*******************************************************************************************/
+#ifndef XMEM_POOL_FILE_ENABLE
+#define XMEM_POOL_FILE_ENABLE    0
+#endif
+
+#define XMEM_POOL_FILE_HEADER    4096
+#if CPU_64_BIT
+#define XMEM_POOL_FILE_ADDR    0x200000000000
+#else
+#define XMEM_POOL_FILE_ADDR    0x60000000
+#endif
+
+/******************************************************************************************
+ * shared memory pool, xMemSharedOpen maps a POSIX shared memory object (or a memfd) as the
+ * pool and every process that opens it allocates from the same heap. the heap state sits at
+ * the start of the region and a process-shared mutex replaces SYS_ENTER_CRITICAL_SECTION.
+ * the region is mapped at the same address in every process, xMemPtrToOffset and
+ * xMemOffsetToPtr turn pointers into offsets for messages between processes
+*******************************************************************************************/
+#ifndef XMEM_POOL_SHARED_ENABLE
+#define XMEM_POOL_SHARED_ENABLE    0
+#endif
+
+#if CPU_64_BIT
+#define XMEM_POOL_SHARED_ADDR    0x300000000000
+#else
+#define XMEM_POOL_SHARED_ADDR    0x70000000
+#endif
+
 #if XMEM_POOL_OPPOSITE
 /*
 ------------------------------------------------------------------------------
@@ -21,6 +88,11 @@
 */
 #define XMEM_BOUNDRY_CHECK_ENABLE   0
 #define XMEM_HEADER_PROTECT_ENABLE  1
+
+/* headers are taken from pages of XMEM_HEADER_PAGE_SLOTS slots (2..32), slot 0 is the page's free map */
+#ifndef XMEM_HEADER_PAGE_SLOTS
+#define XMEM_HEADER_PAGE_SLOTS  16
+#endif
 #else
 /*
 --------------------------------------------------------------
@@ -33,27 +105,249 @@
 #define XMEM_HEADER_PROTECT_ENABLE  0
 #endif
 
+/******************************************************************************************
+ * heap check cadence, used when XMEM_BOUNDRY_CHECK_ENABLE
+ *
+ * XMEM_CHECK_FULL       walk the whole block list on every xmalloc and xfree
+ * XMEM_CHECK_PERIODIC   walk the whole block list once every XMEM_CHECK_PERIOD calls
+ * XMEM_CHECK_NEIGHBOUR  check only the block being allocated or freed and its neighbours
+ * XMEM_CHECK_BOUNDED    check at most XMEM_CHECK_BUDGET blocks per call, the next call
+ *                       goes on where the previous one stopped
+*******************************************************************************************/
+#define XMEM_CHECK_FULL         0
+#define XMEM_CHECK_PERIODIC     1
+#define XMEM_CHECK_NEIGHBOUR    2
+#define XMEM_CHECK_BOUNDED      3
+
+#ifndef XMEM_CHECK_MODE
+#define XMEM_CHECK_MODE     XMEM_CHECK_BOUNDED
+#endif
+
+#define XMEM_CHECK_PERIOD   64
+#define XMEM_CHECK_BUDGET   8
+
 #if CPU_64_BIT
 #define XMEM_META_BLOCK_SIZE    ((u32)8)
+#ifndef XMEM_8META_ENABLE
 #define XMEM_8META_ENABLE   0
-#define XMEM_SUPERBLOCK_LIST_COUNT  3
+#endif
 #else
 #define XMEM_META_BLOCK_SIZE    ((u32)4)
+#ifndef XMEM_8META_ENABLE
 #define XMEM_8META_ENABLE   1
+#endif
+#endif
+
 #if XMEM_8META_ENABLE
 #define XMEM_SUPERBLOCK_LIST_COUNT  4
 #else
 #define XMEM_SUPERBLOCK_LIST_COUNT  3
 #endif
+
+/*
+ * alignment of the addresses xmalloc returns, block sizes are rounded up to it.
+ * must be a power of 2 that divides XMEM_BLOCK_SIZE when XMEM_POOL_OPPOSITE is 0,
+ * 16 is what a malloc replacement needs on x86_64.
+ */
+#ifndef XMEM_ALIGN_SIZE
+#if XMEM_SHIM_ENABLE
+#define XMEM_ALIGN_SIZE     16
+#elif CPU_64_BIT
+#define XMEM_ALIGN_SIZE     8
+#else
+#define XMEM_ALIGN_SIZE     4
+#endif
+#endif
+
+/******************************************************************************************
+ * placement policy of the block list at start up, xMemPolicySet changes it at run time.
+ * the block list is in address order, XMEM_FIT_FIRST takes the first block that fits,
+ * XMEM_FIT_NEXT does the same from where the last allocation ended, XMEM_FIT_BEST takes
+ * the smallest block that fits
+*******************************************************************************************/
+#ifndef XMEM_FIT_POLICY
+#define XMEM_FIT_POLICY    XMEM_FIT_BEST
+#endif
+
+/******************************************************************************************
+ * canary words guard each allocation, they are verified by xfree and xrealloc for just the
+ * block being released. tail canary follows the bytes asked for and the last word of the
+ * block keeps their count, head canary takes XMEM_ALIGN_SIZE bytes in front of the
+ * returned pointer so alignment is kept
+*******************************************************************************************/
+#ifndef XMEM_CANARY_ENABLE
+#define XMEM_CANARY_ENABLE    0
+#endif
+
+#ifndef XMEM_CANARY_HEAD_ENABLE
+#define XMEM_CANARY_HEAD_ENABLE    0
+#endif
+
+#define XMEM_CANARY_WORD    ((u32)0xC0DEFACE)
+
+/******************************************************************************************
+ * deferred coalescing, xfree puts a block on a quick list without merging it, the quick
+ * list serves exact size requests. blocks are merged in one pass when a request can not
+ * be satisfied or the quick list is full
+*******************************************************************************************/
+#ifndef XMEM_DEFER_COALESCE_ENABLE
+#define XMEM_DEFER_COALESCE_ENABLE    0
+#endif
+
+#define XMEM_QUICKLIST_SIZE    16
+
+/******************************************************************************************
+ * relocatable blocks, allocated by handle and moved by xMemCompact while they are unlocked
+*******************************************************************************************/
+#ifndef XMEM_HANDLE_ENABLE
+#define XMEM_HANDLE_ENABLE    0
+#endif
+
+#define XMEM_HANDLE_MAX    32
+
+/******************************************************************************************
+ * regions, bump pointer allocation from chunks of the block list with mark/release
+*******************************************************************************************/
+#ifndef XMEM_REGION_ENABLE
+#define XMEM_REGION_ENABLE    1
+#endif
+
+#define XMEM_REGION_CHUNK_SIZE    1024
+
+/******************************************************************************************
+ * object caches, exact size objects in dedicated super blocks, needs XMEM_SUPERBLOCK_ENABLE
+*******************************************************************************************/
+#ifndef XMEM_CACHE_ENABLE
+#define XMEM_CACHE_ENABLE    1
+#endif
+
+#define XMEM_CACHE_SLAB_SIZE    1024
+
+/******************************************************************************************
+ * shared buffers, xballoc keeps a reference count in front of the data, xbslice makes views
+ * of a part of a buffer or a chain of buffers without copying, the data is freed with its
+ * last view. the count is changed with gcc atomics, views may be freed from any thread
+*******************************************************************************************/
+#ifndef XMEM_XBUF_ENABLE
+#define XMEM_XBUF_ENABLE    0
+#endif
+
+/******************************************************************************************
+ * size map, one bit for each XMEM_ALIGN_SIZE bytes of the pool marks the super block slots,
+ * so the size of an allocated block is found without searching the super block lists.
+ * costs XMEM_POOL_SIZE/XMEM_ALIGN_SIZE/8 bytes, only used when XMEM_POOL_OPPOSITE is 0
+*******************************************************************************************/
+#ifndef XMEM_SIZE_MAP_ENABLE
+#define XMEM_SIZE_MAP_ENABLE    1
+#endif
+
+/******************************************************************************************
+ * free index, the sizes of the free blocks are kept in a dense aligned array that best fit
+ * scans 4 or 8 at a time with SSE2/AVX2 (one by one on other cpus) instead of walking the
+ * block list. costs XMEM_FREE_INDEX_MAX*8 bytes, while more blocks are free the list walk
+ * is used until the index is rebuilt. only used when XMEM_POOL_OPPOSITE is 0
+*******************************************************************************************/
+#ifndef XMEM_FREE_INDEX_ENABLE
+#define XMEM_FREE_INDEX_ENABLE    0
+#endif
+
+#define XMEM_FREE_INDEX_MAX    256
+
+/******************************************************************************************
+ * heap profiler, xMemProfileStart(interval) records the call stack of about one allocation
+ * every interval bytes with backtrace(), a sample leaves the live set when it is freed.
+ * xMemProfileDump writes the live set in the pprof heap profile format. idle it costs one
+ * counter decrement per xmalloc. needs backtrace() and POSIX files (glibc, musl+libexecinfo)
+*******************************************************************************************/
+#ifndef XMEM_PROFILE_ENABLE
+#define XMEM_PROFILE_ENABLE    0
 #endif
 
+#define XMEM_PROFILE_DEPTH      16
+#define XMEM_PROFILE_BUCKETS    256     //distinct call stacks
+#define XMEM_PROFILE_LIVE       1024    //live sample slots, power of 2, half of them are used
+
+/******************************************************************************************
+ * allocation tags, xmalloc_tag keeps a tag in the spare byte of the block header and counts
+ * the bytes and blocks of each tag. a tag with a quota fails its own requests once the quota
+ * is used up, other tags are not affected. tagged blocks always come from the block list
+*******************************************************************************************/
+#ifndef XMEM_TAG_ENABLE
+#define XMEM_TAG_ENABLE    0
+#endif
+
+#define XMEM_TAG_MAX    32      //tags 1..XMEM_TAG_MAX-1, at most 256
+
+/******************************************************************************************
+ * memory pressure, callbacks registered by xMemPressureRegister hear when the free space of
+ * the block list falls below the watermark, and when xmalloc is about to fail. on failure the
+ * empty super blocks and cache slabs are released first, then the callbacks are called one by one
+ * and xmalloc retries after each one that released memory
+*******************************************************************************************/
+#ifndef XMEM_PRESSURE_ENABLE
+#define XMEM_PRESSURE_ENABLE    0
+#endif
+
+#define XMEM_PRESSURE_MAX    8
+
+/******************************************************************************************
+ * size tuning, counts the requests and the peak of live blocks of each power of 2 size, and
+ * the peak of the pool in use. xMemTuneDump writes them as a header with the super block
+ * counts, the super block lists, the ballance size and the pool size that fit this program.
+ * the settings in it override the defaults here, build with -include of the header
+*******************************************************************************************/
+#ifndef XMEM_TUNE_ENABLE
+#define XMEM_TUNE_ENABLE    0
+#endif
+
+#define XMEM_TUNE_BUCKETS    24     //sizes up to XMEM_META_BLOCK_SIZE<<22, larger ones count in the last
+
+/******************************************************************************************
+ * maintenance, xMemMaintain does off the request path what xfree leaves for it: it merges
+ * the quick list of XMEM_DEFER_COALESCE_ENABLE, frees the empty super blocks over
+ * XMEM_SUPERBLOCK_KEEP (xfree no longer does), tops the super block lists up to
+ * XMEM_MAINT_SPARE free slots and gives the pages of free blocks back to the OS. each step
+ * takes the lock on its own and a pass stops after XMEM_MAINT_SLICE_US. xMemMaintStart runs
+ * it from a thread, that needs pthread and a SYS_ENTER_CRITICAL_SECTION that locks
+*******************************************************************************************/
+#ifndef XMEM_MAINT_ENABLE
+#define XMEM_MAINT_ENABLE    0
+#endif
+
+#define XMEM_MAINT_SLICE_US     200
+#define XMEM_MAINT_SPARE        4       //free slots a super block list keeps ready
+#define XMEM_MAINT_STEP         64      //blocks looked at for page trimming under one lock
+#define XMEM_MAINT_TRIM_MIN     (XMEM_PAGE_SIZE*4)      //free blocks this large give pages back
+
+/******************************************************************************************
+ * epoch based reclamation for lock-free readers, a reader runs between xMemEpochEnter and
+ * xMemEpochExit, xfree_deferred keeps a block until every reader that was running when it
+ * was retired has left, then frees it with the blocks retired in the same epoch in one
+ * batch. the retire lists grow by chunks from the block list. readers never lock, a read
+ * section holds one of XMEM_EPOCH_THREADS slots from its first xMemEpochEnter to its last
+ * xMemEpochExit, more sections at once wait for a slot. xfree_deferred and the epoch
+ * moving on change the retire lists under SYS_ENTER_CRITICAL_SECTION, so it needs one
+ * that locks, and gcc atomics
+*******************************************************************************************/
+#ifndef XMEM_EPOCH_ENABLE
+#define XMEM_EPOCH_ENABLE    0
+#endif
+
+#define XMEM_EPOCH_THREADS      64
+#define XMEM_EPOCH_RETIRE_MAX   256     //blocks of one retire chunk, more chunks come from the pool
+#define XMEM_EPOCH_BATCH        32      //retired blocks that try to move the epoch on
+
+#ifndef XMEM_BALLANCE_SIZE
 #define XMEM_BALLANCE_SIZE    (XMEM_META_BLOCK_SIZE*4)
+#endif
 /******************************************************************************************
- * on 32-bit cpu, xMemMgrHdr requires 8 bytes, xMemBlock requires 16 bytes, to manage a
- * block will spend 24 bytes for a header
+ * on 32-bit cpu, xMemBlock requires 12 bytes in front of a block, when XMEM_POOL_OPPOSITE
+ * is 1 a block spends a 16 bytes header slot
+ *
+ * on 64-bit cpu, xMemBlock requires 16 bytes in front of a block, when XMEM_POOL_OPPOSITE
+ * is 1 a block spends a 24 bytes header slot
  *
- * on 64-bit cpu, xMemMgrHdr requires 12 bytes, xMemBlock requires 24 bytes, to manage a
- * block will spend 36 bytes for a header
+ * header slots come in pages, one slot of each page keeps the page's free map
  *
  * ballance size determined waste size when a free block lager than requrired
 *******************************************************************************************/
@@ -62,10 +356,19 @@
 #define XMEM_4META_BLOCK_SIZE    (XMEM_META_BLOCK_SIZE*4)
 #define XMEM_8META_BLOCK_SIZE    (XMEM_META_BLOCK_SIZE*8)
 
+//slots of the first super block of each list, 2..XMEM_SUPERBLOCK_BLKS_MAX
+#ifndef XMEM_SUPERBLOCK_1META_CNT
 #define XMEM_SUPERBLOCK_1META_CNT        ((u32)16)
+#endif
+#ifndef XMEM_SUPERBLOCK_2META_CNT
 #define XMEM_SUPERBLOCK_2META_CNT        ((u32)32)
+#endif
+#ifndef XMEM_SUPERBLOCK_4META_CNT
 #define XMEM_SUPERBLOCK_4META_CNT        ((u32)16)
+#endif
+#ifndef XMEM_SUPERBLOCK_8META_CNT
 #define XMEM_SUPERBLOCK_8META_CNT        ((u32)16)
+#endif
 
 #define XMEM_SUPERBLOCK_1META_MIN_SIZE (XMEM_META_BLOCK_SIZE*XMEM_SUPERBLOCK_1META_CNT)
 #define XMEM_SUPERBLOCK_2META_MIN_SIZE (XMEM_2META_BLOCK_SIZE*XMEM_SUPERBLOCK_2META_CNT)
@@ -1,6 +1,7 @@
 #include "xconfig.h"
 #include "platform.h"
 #include "xtypes.h"
+#include "xmem.h"
 
 #define XMEM_VER "1.0.0"
 
@@ -34,26 +35,102 @@
 ****************************************************************************/
 
 
-static pxMemMgrHdr xMemMgrHdrList;
+#if XMEM_POOL_SHARED_ENABLE
+#if XMEM_DEFER_COALESCE_ENABLE || XMEM_FREE_INDEX_ENABLE || XMEM_HANDLE_ENABLE || XMEM_PROFILE_ENABLE || XMEM_POOL_FILE_ENABLE || XMEM_TUNE_ENABLE || XMEM_MAINT_ENABLE || XMEM_EPOCH_ENABLE
+#error "quick list, free index, handles, profiler, size tuning, maintenance, epochs and file pool are per process, disable them with XMEM_POOL_SHARED_ENABLE"
+#endif
+
+/*
+ the heap state lives at the start of the shared region, so every process
+ that maps the region works on the same lists
+*/
+typedef struct{
+    u32 magic;
+    u32 config;
+    uptr base;              //address every process maps the region at
+    uptr root;              //offset of the root object from base, 0 if none
+    pthread_mutex_t lock;
+    pxMemHdrPage hdrpages;
+    pxMemBlock blklist;
+    pxMemBlock rover;
+    uptr hdrend;
+    uptr blkstart;
+    u8 policy;
+    #if XMEM_BOUNDRY_CHECK_ENABLE && XMEM_CHECK_MODE == XMEM_CHECK_BOUNDED
+    pxMemBlock checkcursor;
+    #endif
+    #if XMEM_SUPERBLOCK_ENABLE
+    xMemSuperBlock superblocks[XMEM_SUPERBLOCK_LIST_COUNT];
+    #if XMEM_SIZE_MAP_ENABLE && XMEM_BOUNDRY_CHECK_ENABLE
+    u32 sizemap[XMEM_POOL_SIZE/XMEM_ALIGN_SIZE/32+1];
+    #endif
+    #endif
+    #if XMEM_TAG_ENABLE
+    xMemTagInfo tags[XMEM_TAG_MAX];
+    #endif
+    #if XMEM_PRESSURE_ENABLE
+    u32 blockused;
+    #endif
+}xMemSharedState;
+
+static uptr xMemPoolBase=0;
+#define XMEM_SHARED             ((xMemSharedState *)xMemPoolBase)
+#define xMemHdrPageList         (XMEM_SHARED->hdrpages)
+#define xMemBlkList             (XMEM_SHARED->blklist)
+#define xMemFitPolicy           (XMEM_SHARED->policy)
+#define xMemFitRover            (XMEM_SHARED->rover)
+#define xMemMgrHdrListEnd       (XMEM_SHARED->hdrend)
+#define xMemBlkPoolStart        (XMEM_SHARED->blkstart)
+#define xMemCheckCursor         (XMEM_SHARED->checkcursor)
+#define xMemSuperBlockList      (XMEM_SHARED->superblocks)
+#define xMemSizeMap             (XMEM_SHARED->sizemap)
+#define xMemTagTable            (XMEM_SHARED->tags)
+#define xMemBlockUsed           (XMEM_SHARED->blockused)
+#else
+#if XMEM_HEADER_PROTECT_ENABLE
+static pxMemHdrPage xMemHdrPageList;
+static uptr xMemMgrHdrListEnd=0;
+static uptr xMemBlkPoolStart=0;
+#endif
 static pxMemBlock xMemBlkList = NULL;
-static u32 xMemMgrHdrListEnd=0;
-static u32 xMemBlkPoolStart=0;
+static u8 xMemFitPolicy = XMEM_FIT_POLICY;
+static pxMemBlock xMemFitRover = NULL;
+#endif
 
 #if defined(__MT7681)
 extern unsigned long _RAM_SIZE;
 extern unsigned long _BSS_END;
 extern u32 __OS_Heap_Start;
 
-#define XMEM_POOL_START ((u32)&_BSS_END)
-#define XMEM_POOL_END ((u32)&_RAM_SIZE)
+#define XMEM_POOL_START ((uptr)&_BSS_END)
+#define XMEM_POOL_END ((uptr)&_RAM_SIZE)
+#elif XMEM_POOL_FILE_ENABLE
+//mapping of the heap file, the pool follows the file header
+static uptr xMemPoolBase=0;
+#define XMEM_POOL_START (xMemPoolBase+XMEM_POOL_FILE_HEADER)
+#define XMEM_POOL_END (XMEM_POOL_START+XMEM_POOL_SIZE)
+#elif XMEM_POOL_SHARED_ENABLE
+//the pool follows the shared state, page aligned
+#define XMEM_POOL_SHARED_HEADER ((sizeof(xMemSharedState)+4095)&~(uptr)4095)
+#define XMEM_POOL_START (xMemPoolBase+XMEM_POOL_SHARED_HEADER)
+#define XMEM_POOL_END (XMEM_POOL_START+XMEM_POOL_SIZE)
 #else
-static u8 xmempool[XMEM_POOL_SIZE] = {0};
-#define XMEM_POOL_START ((u32)&xmempool[0])
+static u8 xmempool[XMEM_POOL_SIZE] XMEM_ATTR_ALIGNED_POOL = {0};
+#define XMEM_POOL_START ((uptr)&xmempool[0])
 #define XMEM_POOL_END (XMEM_POOL_START+XMEM_POOL_SIZE)
 #endif
 
+//slots of a header page, a heap file or shared heap only attaches to a build with the same count
+#if XMEM_HEADER_PROTECT_ENABLE
+#define XMEM_HEADER_SLOTS_CONFIG    XMEM_HEADER_PAGE_SLOTS
+#else
+#define XMEM_HEADER_SLOTS_CONFIG    0
+#endif
+
 
 #if XMEM_HEADER_PROTECT_ENABLE
+#define XMEM_HEADER_PAGE_FREE   ((((u32)2)<<(XMEM_HEADER_PAGE_SLOTS-1))-2)
+
 /***************************************************************************
  * FUNCTION
  * xMemMgrHdrListInit
@@ -71,11 +148,52 @@ static void xMemMgrHdrListInit(void)
       | Header List|  xMemHdrEnd--->|  ...   |<---xMemBlkStart  |Blocks,Super Blocks|
       -------------------------------------------------------------------------------
       This Structure avoid Header List overwrote by pointer which allocated from X-Memory Pool
+
+      the header list is an array of pages, slot 0 of a page is the page itself,
+      the other slots are block or super block headers
+      -------------------------------------------------
+      | page | hdr | hdr | ... | hdr | page | hdr | ...
+      -------------------------------------------------
      */
-    xMemMgrHdrList = NULL;
+    xMemHdrPageList = NULL;
     xMemMgrHdrListEnd = XMEM_POOL_START;
 }
 
+/***************************************************************************
+ * FUNCTION
+ * xMemHdrPageLink
+ * DESCRIPTION
+ * put a page on the list of pages that have free slots
+ * PARAMETERS
+ * page  [IN]    header page
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemHdrPageLink(pxMemHdrPage page)
+{
+    page->prev = NULL;
+    page->next = xMemHdrPageList;
+    if(xMemHdrPageList) xMemHdrPageList->prev = page;
+    xMemHdrPageList = page;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemHdrPageUnlink
+ * DESCRIPTION
+ * take a page off the list of pages that have free slots
+ * PARAMETERS
+ * page  [IN]    header page
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemHdrPageUnlink(pxMemHdrPage page)
+{
+    if(page->prev) page->prev->next = page->next;
+    else xMemHdrPageList = page->next;
+    if(page->next) page->next->prev = page->prev;
+}
+
 /***************************************************************************
  * FUNCTION
  * xMemMgrHdrGet
@@ -88,72 +206,30 @@ static void xMemMgrHdrListInit(void)
  * *************************************************************************/
 static void * xMemMgrHdrGet(u8 type)
 {
-    pxMemMgrHdr hdr = NULL,hdrnew = NULL, hdrprev = NULL;
-    u16 allocsize;
-
-    /*
-     -------------------------------------------
-     |  ...  |  prev  |  blk  |  next  |  ...  |
-     -------------------------------------------
-    */
+    pxMemHdrPage page;
+    u32 slot;
 
-    hdr = xMemMgrHdrList;
-    if(type == XMEM_LIST_TYPE_BLOCK)
-        allocsize = XMEM_NODE_SIZE(xMemBlock);
-    else if(type == XMEM_LIST_TYPE_SUPERBLOCK)
-        allocsize = XMEM_NODE_SIZE(xMemSuperBlock);
-    else
+    if(type != XMEM_LIST_TYPE_BLOCK && type != XMEM_LIST_TYPE_SUPERBLOCK)
         return NULL;
 
-    while(hdr)
-    {
-        if(hdr->type == XMEM_LIST_TYPE_FREE)
-        {
-           if(hdr->size == allocsize)
-           {
-               //most fitable, block size equals to required size
-               hdr->type = type;
-               return (void*)hdr+XMEM_HEADER_SIZE;
-           }
-           else if(hdr->size > allocsize)
-           {
-               //split into 2 hdrs
-               hdrnew = (pxMemMgrHdr)((void*)hdr+allocsize+XMEM_HEADER_SIZE);
-               hdrnew->type = XMEM_LIST_TYPE_FREE;
-               hdrnew->size = hdr->size - allocsize - XMEM_HEADER_SIZE;
-               hdrnew->next = hdr->next;
-               hdr->next = hdrnew;
-               hdr->size = allocsize;
-               hdr->type = type;
-               return (void*)hdr+XMEM_HEADER_SIZE;
-           }
-        }
-        hdrprev = hdr;
-        hdr = hdr->next;
-    }
-
-    if(xMemMgrHdrListEnd+allocsize+XMEM_HEADER_SIZE<xMemBlkPoolStart)
+    page = xMemHdrPageList;
+    if(page == NULL)
     {
-        hdrnew = (pxMemMgrHdr)xMemMgrHdrListEnd;
-        if(hdrprev)
-        {
-            hdrprev->next = hdrnew;
-        }
-        else
-        {
-            xMemMgrHdrList = hdrnew;
-        }
-
-        hdrnew->type = type;
-        hdrnew->size = allocsize;
-        hdrnew->next = NULL;
-        xMemMgrHdrListEnd += allocsize+XMEM_HEADER_SIZE;
-        hdr = hdrnew;
+        //every page is full, the header list grows by a page into the gap
+        if(xMemMgrHdrListEnd+XMEM_HEADER_PAGE_SIZE > xMemBlkPoolStart)
+            return NULL;
 
-        return (void*)hdr+XMEM_HEADER_SIZE;
+        page = (pxMemHdrPage)xMemMgrHdrListEnd;
+        page->freemap = XMEM_HEADER_PAGE_FREE;
+        xMemMgrHdrListEnd += XMEM_HEADER_PAGE_SIZE;
+        xMemHdrPageLink(page);
     }
 
-    return NULL;
+    slot = __builtin_ctz(page->freemap);
+    page->freemap &= ~((u32)1<<slot);
+    if(page->freemap == 0) xMemHdrPageUnlink(page);
+
+    return (void*)page+slot*XMEM_HEADER_SIZE;
 }
 
 /***************************************************************************
@@ -168,61 +244,31 @@ static void * xMemMgrHdrGet(u8 type)
  * *************************************************************************/
 static void xMemMgrHdrPut(void * header)
 {
-    pxMemMgrHdr hdrfree=NULL,hdrprev=NULL,hdrprev2=NULL;
-    u16 headersize;
-
-    /*
-     -------------------------------------------
-     |  ...  |  prev  |  blk  |  next  |  ...  |
-     -------------------------------------------
-    */
-
-    hdrfree = xMemMgrHdrList;
-    while(hdrfree)
-    {
-        if((u32)hdrfree+XMEM_HEADER_SIZE == header)
-        {
-            xMemAssert(hdrfree->type!=XMEM_LIST_TYPE_FREE);
+    pxMemHdrPage page;
+    u32 slot;
 
-            if(hdrfree->type == XMEM_LIST_TYPE_BLOCK)
-                headersize = XMEM_NODE_SIZE(xMemBlock);
-            else if(hdrfree->type == XMEM_LIST_TYPE_SUPERBLOCK)
-                headersize = XMEM_NODE_SIZE(xMemSuperBlock);
-
-            hdrfree->type = XMEM_LIST_TYPE_FREE;
-            if(hdrprev&&hdrprev->type == XMEM_LIST_TYPE_FREE)
-            {
-                hdrprev->next = hdrfree->next;
-                hdrprev->size += headersize+XMEM_HEADER_SIZE;
-                hdrfree = hdrprev;
-                hdrprev = hdrprev2;
-            }
-            if(hdrfree->next&&hdrfree->next->type == XMEM_LIST_TYPE_FREE)
-            {
-                hdrfree->size += hdrfree->next->size + XMEM_HEADER_SIZE;
-                hdrfree->next = hdrfree->next->next;
-            }
+    //pages are aligned to their size from the pool start
+    page = (pxMemHdrPage)(XMEM_POOL_START+((uptr)header-XMEM_POOL_START)/XMEM_HEADER_PAGE_SIZE*XMEM_HEADER_PAGE_SIZE);
+    slot = ((uptr)header-(uptr)page)/XMEM_HEADER_SIZE;
+    xMemAssert((uptr)header<xMemMgrHdrListEnd);
+    xMemAssert(slot>0 && (page->freemap&((u32)1<<slot))==0);
 
-            if((u32)hdrfree + hdrfree->size+XMEM_HEADER_SIZE==xMemMgrHdrListEnd)
-            {
-                xMemMgrHdrListEnd -= hdrfree->size+XMEM_HEADER_SIZE;
-                if(hdrprev) hdrprev->next = NULL;
-                else xMemMgrHdrList = NULL;
-            }
+    if(page->freemap == 0) xMemHdrPageLink(page);
+    page->freemap |= (u32)1<<slot;
 
-            return;
-        }
+    //empty pages at the end go back to the gap between headers and blocks
+    while(xMemMgrHdrListEnd > XMEM_POOL_START)
+    {
+        page = (pxMemHdrPage)(xMemMgrHdrListEnd-XMEM_HEADER_PAGE_SIZE);
+        if(page->freemap != XMEM_HEADER_PAGE_FREE) break;
 
-        hdrprev2 = hdrprev;
-        hdrprev = hdrfree;
-        hdrfree = hdrfree->next;
+        xMemHdrPageUnlink(page);
+        xMemMgrHdrListEnd -= XMEM_HEADER_PAGE_SIZE;
     }
-
-    xMemAssert(0);
 }
 
 static const char xMemDumpMsgMgrHdrLst[]="-----xMemMgrHdrLst Info-----\n";
-static const char xMemDumpFmtMgrHdrLst[]="hdr:%u,hdrsize:%d,hdrnext:%u,type:%d\n";
+static const char xMemDumpFmtMgrHdrLst[]="page:%p,free map:%x,slots:%d\n";
 
 /***************************************************************************
  * FUNCTION
@@ -236,21 +282,40 @@ static const char xMemDumpFmtMgrHdrLst[]="hdr:%u,hdrsize:%d,hdrnext:%u,type:%d\n
  * *************************************************************************/
 static void xMemMgrHdrListInfoDump(void)
 {
-    pxMemMgrHdr phdrlst;
+    uptr page;
 
-    phdrlst=xMemMgrHdrList;
     xMemPrintf(xMemDumpMsgMgrHdrLst);
 
-    while(phdrlst)
+    for(page=XMEM_POOL_START;page<xMemMgrHdrListEnd;page+=XMEM_HEADER_PAGE_SIZE)
     {
-        xMemPrintf(xMemDumpFmtMgrHdrLst,(u32)phdrlst,phdrlst->size,(u32)phdrlst->next,phdrlst->type);
-        phdrlst=phdrlst->next;
+        xMemPrintf(xMemDumpFmtMgrHdrLst,(void *)page,((pxMemHdrPage)page)->freemap,XMEM_HEADER_PAGE_SLOTS);
     }
     xMemPrintf(xMemDumpMsgMgrHdrLst);
     return;
 }
 #endif
 
+/***************************************************************************
+ * FUNCTION
+ * xMemPoolTouch
+ * DESCRIPTION
+ * fault in the pages of a range of the pool, every page is read and
+ * written back so the content stays as it is
+ * PARAMETERS
+ * addr     [IN]    start of the range
+ * size     [IN]    bytes
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemPoolTouch(void *addr,u32 size)
+{
+    volatile u8 * p=(volatile u8 *)addr;
+    volatile u8 * end=p+size;
+
+    for(;p<end;p+=XMEM_PAGE_SIZE) *p=*p;
+    if(size) end[-1]=end[-1];
+}
+
 /***************************************************************************
  * FUNCTION
  * xMemBlockListInit
@@ -272,25 +337,17 @@ static void xMemBlockListInit(void)
     xMemBlkList->blksize=XMEM_POOL_SIZE-XMEM_BLOCK_SIZE;
     xMemBlkList->next=NULL;
     xMemBlkList->free=1;
+    XMEM_BLOCK_FLAGS(xMemBlkList)=0;
+    XMEM_BLOCK_TAG(xMemBlkList)=0;
     #endif
 }
 
 
-/***************************************************************************
- * FUNCTION
- * xMemBlockListCheck
- * DESCRIPTION
- * check memory block boundry
- * PARAMETERS
- * void
- * RETURNS
- * void
- * *************************************************************************/
 #if XMEM_BOUNDRY_CHECK_ENABLE
-const char xMemDumpFmtBlockList[]="blk:%u,blksize:%d,blknext:%u,free:%d\n";
+const char xMemDumpFmtBlockList[]="blk:%p,blksize:%d,blknext:%p,free:%d\n";
 void dump(unsigned char * mem,size_t size)
 {
-    int i;
+    size_t i;
 
     for(i=0;i<size;i++)
     {
@@ -301,6 +358,44 @@ void dump(unsigned char * mem,size_t size)
     if((i%16)!=0) printf("\n");
 }
 
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockCheck
+ * DESCRIPTION
+ * check boundry of one memory block
+ * PARAMETERS
+ * pmemblk  [IN]    block be checked
+ * preblk   [IN]    previous block, dumped on failure, can be NULL
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemBlockCheck(pxMemBlock pmemblk,pxMemBlock preblk)
+{
+    if(pmemblk->free>XMEM_BLOCK_DEFERRED
+            ||(pmemblk->next&&
+               ((uptr)pmemblk+XMEM_BLOCK_SIZE+pmemblk->blksize!=(uptr)pmemblk->next
+               ||(uptr)pmemblk->next>=XMEM_POOL_END
+               ||(uptr)pmemblk->next<=XMEM_POOL_START)
+               )
+       )
+    {
+        xMemPrintf(xMemDumpFmtBlockList,(void *)pmemblk,pmemblk->blksize,(void *)pmemblk->next,pmemblk->free);
+        if(preblk) dump((unsigned char *)preblk,preblk->blksize+XMEM_BLOCK_SIZE);
+        dump((unsigned char *)pmemblk,128);
+        xMemAssert(0);
+    }
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockListCheck
+ * DESCRIPTION
+ * check memory block boundry of the whole block list
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
 void xMemBlockListCheck()
 {
     pxMemBlock pmemblk,preblk;
@@ -308,756 +403,5540 @@ void xMemBlockListCheck()
 
     while(pmemblk)
     {
-        if(pmemblk->free>1
-                ||(pmemblk->next&&
-                   ((u32)pmemblk+XMEM_BLOCK_SIZE+pmemblk->blksize!=(u32)pmemblk->next
-                   ||pmemblk->next>=XMEM_POOL_END
-                   ||pmemblk->next<=XMEM_POOL_START)
-                   )
-           )
-        {
-            xMemPrintf(xMemDumpFmtBlockList,(u32)pmemblk,pmemblk->blksize,(u32)pmemblk->next,pmemblk->free);
-            dump(preblk,preblk->blksize+XMEM_BLOCK_SIZE);
-            dump(pmemblk,128);
-            xMemAssert(0);
-        }
+        xMemBlockCheck(pmemblk,preblk);
         preblk=pmemblk;
         pmemblk=pmemblk->next;
     }
 
     return;
 }
+
+#if XMEM_CHECK_MODE == XMEM_CHECK_PERIODIC
+static u32 xMemCheckCount=0;
+#elif XMEM_CHECK_MODE == XMEM_CHECK_BOUNDED && !XMEM_POOL_SHARED_ENABLE
+static pxMemBlock xMemCheckCursor=NULL;
 #endif
 
 /***************************************************************************
  * FUNCTION
- * xMemBlockAlloc
+ * xMemHeapCheck
  * DESCRIPTION
- * allocate a memory bock
+ * check memory block boundry at the cadence of XMEM_CHECK_MODE, called
+ * on every xmalloc and xfree
  * PARAMETERS
- * size  [IN] block size that required
+ * void
  * RETURNS
- * void * memory block address that alocated
+ * void
  * *************************************************************************/
-#if XMEM_BOUNDRY_CHECK_ENABLE
-
-static void * xMemBlockAlloc(size_t size)
+static void xMemHeapCheck(void)
 {
-    pxMemBlock blkprev=NULL,blk=NULL,blknew=NULL,blkalloc=NULL;
-    s16 allocsize,remainsize;
-
-    /*
-     --------------------------------------------------------------
-     |       |     prev     |     blk      |    next      |       |
-     |  ...  |--------------|--------------|--------------|  ...  |
-     |       |header|  mem  |header|  mem  |header|  mem  |       |
-     --------------------------------------------------------------
-    */
-
-    blk=xMemBlkList;
-    remainsize=XMEM_POOL_SIZE;
-    blkalloc=NULL;
-    allocsize=size+((size%4)==0?0:(4-size%4));
-
-    while(blk)
+    #if XMEM_CHECK_MODE == XMEM_CHECK_FULL
+    xMemBlockListCheck();
+    #elif XMEM_CHECK_MODE == XMEM_CHECK_PERIODIC
+    if(++xMemCheckCount>=XMEM_CHECK_PERIOD)
     {
-        if(blk->free)
-        {
-           if(blk->blksize==allocsize)
-           {//most fitable, block size equals to required size
-               blk->free=0;
-               return (void*)blk+XMEM_BLOCK_SIZE;
-           }
-           else if(blk->blksize>allocsize&&(blk->blksize-allocsize)<remainsize)
-           {// find minimal fitable size block
-                remainsize=blk->blksize-allocsize;
-                blkalloc=blk;
-           }
-        }
-        blkprev=blk;
-        blk=blk->next;
+        xMemCheckCount=0;
+        xMemBlockListCheck();
     }
+    #elif XMEM_CHECK_MODE == XMEM_CHECK_BOUNDED
+    u32 n;
+    pxMemBlock pmemblk;
 
-    if(blkalloc)
+    pmemblk=xMemCheckCursor?xMemCheckCursor:xMemBlkList;
+    for(n=0;n<XMEM_CHECK_BUDGET&&pmemblk;n++)
     {
-        if(remainsize>(XMEM_BLOCK_SIZE+XMEM_BALLANCE_SIZE))
-        {
-            //split into 2 blocks
-            blknew=(pxMemBlock)((void *)blkalloc+allocsize+XMEM_BLOCK_SIZE);
-            blknew->blksize=remainsize-XMEM_BLOCK_SIZE;
-            blknew->free=1;
-            blknew->next=blkalloc->next;
-            blkalloc->next=blknew;
-            blkalloc->blksize=allocsize;
-        }
-
-        blkalloc->free=0;
-        return (void*)blkalloc+XMEM_BLOCK_SIZE;
+        xMemBlockCheck(pmemblk,NULL);
+        pmemblk=pmemblk->next;
     }
-
-    xMemBlockListCheck();
-    return NULL;
+    //restart from list head when reach the tail
+    xMemCheckCursor=pmemblk;
+    #endif
+    //XMEM_CHECK_NEIGHBOUR checks inside xMemBlockAlloc and xMemBlockFree
 }
+
+#if XMEM_CHECK_MODE == XMEM_CHECK_NEIGHBOUR
+#define XMEM_CHECK_NEIGHBOURS(prev,blk)   do{ \
+        if(prev) xMemBlockCheck(prev,NULL); \
+        xMemBlockCheck(blk,prev); \
+        if((blk)->next) xMemBlockCheck((blk)->next,blk); \
+    }while(0)
 #else
-static void * xMemBlockAlloc(size_t size)
-{
-    pxMemBlock blkprev=NULL,blk=NULL,blknew=NULL,blkalloc=NULL;
-    u16 allocsize,remainsize;
+#define XMEM_CHECK_NEIGHBOURS(prev,blk)   ((void)(prev))
+#endif
 
-    /*
-     -------------------------------------------
-     |  ...  |  next  |  blk  |  prev  |  ...  |
-     -------------------------------------------
-    */
+#if XMEM_CHECK_MODE != XMEM_CHECK_FULL
+//block walks are done anyway, make sure they never follow a broken link
+#define XMEM_CHECK_LINK(blk,prev)   xMemBlockCheck(blk,prev)
+#else
+#define XMEM_CHECK_LINK(blk,prev)
+#endif
+#endif
 
-    blk = xMemBlkList;
-    blkprev = xMemBlkList;
-    remainsize = xMemBlkPoolStart-xMemMgrHdrListEnd;
-    blkalloc=NULL;
-    allocsize=size+((size%4)==0?0:(4-size%4));
+//the free index needs the block header in front of each block
+#define XMEM_FREE_INDEX (XMEM_FREE_INDEX_ENABLE&&XMEM_BOUNDRY_CHECK_ENABLE)
 
-    while(blk)
+#if XMEM_FREE_INDEX
+#if defined(__AVX2__)
+#define XMEM_FREE_INDEX_LANES   8
+#elif defined(__SSE2__)
+#define XMEM_FREE_INDEX_LANES   4
+#else
+#define XMEM_FREE_INDEX_LANES   1
+#endif
+
+#define XMEM_FREE_INDEX_NONE    0xFFFFFFFF
+#define XMEM_FREE_INDEX_BLK(i)  ((pxMemBlock)(XMEM_POOL_START+xMemFreeOffset[i]))
+
+/*
+ free blocks kept as struct of arrays, entry i is the block at pool offset
+ xMemFreeOffset[i] with xMemFreeSize[i] bytes. unused entries hold size 0
+ and offset XMEM_FREE_INDEX_NONE so whole vectors can be compared
+*/
+static u32 xMemFreeSize[XMEM_FREE_INDEX_MAX] XMEM_ATTR_ALIGNED_VECTOR;
+static u32 xMemFreeOffset[XMEM_FREE_INDEX_MAX] XMEM_ATTR_ALIGNED_VECTOR;
+static u32 xMemFreeCount=0;
+static u32 xMemFreeRebuild=0;
+static u8 xMemFreeOverflow=0;
+
+/***************************************************************************
+ * FUNCTION
+ * xMemFreeIndexFind
+ * DESCRIPTION
+ * find the entry of a block in the free index
+ * PARAMETERS
+ * blk      [IN]    block header
+ * RETURNS
+ * int entry, -1 if the block is not in the index
+ * *************************************************************************/
+static int xMemFreeIndexFind(pxMemBlock blk)
+{
+    u32 off=(uptr)blk-XMEM_POOL_START;
+    u32 i,n=(xMemFreeCount+XMEM_FREE_INDEX_LANES-1)&~(u32)(XMEM_FREE_INDEX_LANES-1);
+    #if defined(__AVX2__)
+    __m256i key=_mm256_set1_epi32(off);
+    int mask;
+
+    for(i=0;i<n;i+=8)
     {
-        if(blk->free)
-        {
-           if(blk->blksize==allocsize)
-           {//most fitable, block size equals to required size
-               blk->free=0;
-               return (void*)blk->addr;
-           }
-           else if(blk->blksize>allocsize&&(blk->blksize-allocsize)<remainsize)
-           {// find minimal fitable size block 
-                remainsize=blk->blksize-allocsize;
-                blkalloc=blk;
-            }
-        }
-        blkprev=blk;
-        blk=blk->next;    
+        mask=_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_load_si256((__m256i*)&xMemFreeOffset[i]),key)));
+        if(mask) return i+__builtin_ctz(mask);
     }
+    #elif defined(__SSE2__)
+    __m128i key=_mm_set1_epi32(off);
+    int mask;
 
-    if(blkalloc)
+    for(i=0;i<n;i+=4)
     {
-        if(remainsize>=XMEM_BALLANCE_SIZE)
-        {
-            //split into 2 blocks
-            blknew=(pxMemBlock)xMemMgrHdrGet(XMEM_LIST_TYPE_BLOCK);
-            if(blknew != NULL)
-            {
-                blknew->blksize=remainsize;
-                blknew->free=1;
-                blknew->next=blkalloc->next;
-                blknew->addr=(void*)blkalloc->addr+allocsize;
-                blkalloc->next=blknew;
-                blkalloc->blksize=allocsize;
-            }
-        }
-        
-        blkalloc->free=0;
-        return (void*)blkalloc->addr;
+        mask=_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_load_si128((__m128i*)&xMemFreeOffset[i]),key)));
+        if(mask) return i+__builtin_ctz(mask);
     }
-    else if(remainsize>allocsize)
+    #else
+    for(i=0;i<n;i++)
     {
-        blknew=(pxMemBlock)xMemMgrHdrGet(XMEM_LIST_TYPE_BLOCK);
-        if(blknew != NULL)
-        {
-            if(blkprev)
-            {
-                blkprev->next = blknew;
-            }
-            else
-            {
-                xMemBlkList = blknew;
-            }
-
-            blknew->next = NULL;
-            blknew->blksize = allocsize;
-            blknew->free = 0;
-            xMemBlkPoolStart -= allocsize;
-            blknew->addr = xMemBlkPoolStart;
-            blkalloc = blknew;
-            return (void*)blkalloc->addr;
-        }
+        if(xMemFreeOffset[i]==off) return i;
     }
-
-    return NULL;
+    #endif
+    return -1;
 }
 
-#endif
 /***************************************************************************
  * FUNCTION
- * xMemBlockFree
+ * xMemFreeIndexBest
  * DESCRIPTION
- * free a memory bock
+ * find the smallest free block that is large enough, an exact fit returns
+ * at once
  * PARAMETERS
- * ptr  [IN] block address that be free
+ * allocsize  [IN]  block size that required, not 0
  * RETURNS
- * u8 0-success,1-failure
+ * int entry, -1 if no block fit
  * *************************************************************************/
-#if XMEM_BOUNDRY_CHECK_ENABLE
-static u8 xMemBlockFree(void *ptr){
-    pxMemBlock blkprev=NULL,blkfree=NULL;
-
-    /*
-     --------------------------------------------------------------
-     |       |     prev     |     blk      |    next      |       |
-     |  ...  |--------------|--------------|--------------|  ...  |
-     |       |header|  mem  |header|  mem  |header|  mem  |       |
-     --------------------------------------------------------------
-    */
+static int xMemFreeIndexBest(u32 allocsize)
+{
+    u32 i,best,n=(xMemFreeCount+XMEM_FREE_INDEX_LANES-1)&~(u32)(XMEM_FREE_INDEX_LANES-1);
+    #if defined(__AVX2__)
+    __m256i req=_mm256_set1_epi32(allocsize);
+    __m256i ones=_mm256_set1_epi32(-1);
+    __m256i vmin=ones;
+    __m256i v,fit;
+    u32 lane[8] XMEM_ATTR_ALIGNED_VECTOR;
+    int mask;
 
-    blkfree = xMemBlkList;
-    while(blkfree)
+    for(i=0;i<n;i+=8)
     {
-        if((u32)blkfree+XMEM_BLOCK_SIZE==ptr)
-        {
-            blkfree->free=1;
-            //merge physical neighbor blocks, previous or next, assure block will not overlap reserve space
-            if(blkprev&&blkprev->free)
-            {
-                blkprev->blksize += (blkfree->blksize+XMEM_BLOCK_SIZE);
-                blkprev->next = blkfree->next;
-                blkfree = blkprev;
-            }
-
-            if(blkfree->next&&blkfree->next->free)
-            {
-                blkfree->blksize += (blkfree->next->blksize+XMEM_BLOCK_SIZE);
-                blkfree->next = blkfree->next->next;
-            }
+        v=_mm256_load_si256((__m256i*)&xMemFreeSize[i]);
+        mask=_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v,req)));
+        if(mask) return i+__builtin_ctz(mask);
+        //sizes below the request become 0xFFFFFFFF, then keep the minimum of each lane
+        fit=_mm256_cmpeq_epi32(_mm256_max_epu32(v,req),v);
+        vmin=_mm256_min_epu32(vmin,_mm256_or_si256(v,_mm256_xor_si256(fit,ones)));
+    }
+    _mm256_store_si256((__m256i*)lane,vmin);
+    best=XMEM_FREE_INDEX_NONE;
+    for(i=0;i<8;i++) if(lane[i]<best) best=lane[i];
+    #elif defined(__SSE2__)
+    //SSE2 only compares signed, flip the sign bit to compare unsigned
+    __m128i bias=_mm_set1_epi32(0x80000000);
+    __m128i req=_mm_xor_si128(_mm_set1_epi32(allocsize),bias);
+    __m128i none=_mm_set1_epi32(0x7FFFFFFF);
+    __m128i vmin=none;
+    __m128i v,small,lt;
+    u32 lane[4] XMEM_ATTR_ALIGNED_VECTOR;
+    int mask;
 
-            return 0;
-        }
+    for(i=0;i<n;i+=4)
+    {
+        v=_mm_xor_si128(_mm_load_si128((__m128i*)&xMemFreeSize[i]),bias);
+        mask=_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v,req)));
+        if(mask) return i+__builtin_ctz(mask);
+        small=_mm_cmpgt_epi32(req,v);
+        v=_mm_or_si128(_mm_andnot_si128(small,v),_mm_and_si128(small,none));
+        lt=_mm_cmpgt_epi32(vmin,v);
+        vmin=_mm_or_si128(_mm_and_si128(lt,v),_mm_andnot_si128(lt,vmin));
+    }
+    _mm_store_si128((__m128i*)lane,_mm_xor_si128(vmin,bias));
+    best=XMEM_FREE_INDEX_NONE;
+    for(i=0;i<4;i++) if(lane[i]<best) best=lane[i];
+    #else
+    best=XMEM_FREE_INDEX_NONE;
+    for(i=0;i<n;i++)
+    {
+        if(xMemFreeSize[i]==allocsize) return i;
+        if(xMemFreeSize[i]>allocsize&&xMemFreeSize[i]<best) best=xMemFreeSize[i];
+    }
+    #endif
 
-        blkprev = blkfree;
-        blkfree = blkfree->next;
+    if(best==XMEM_FREE_INDEX_NONE) return -1;
+    for(i=0;i<n;i++)
+    {
+        if(xMemFreeSize[i]==best) return i;
     }
+    return -1;
+}
 
-    return 1;
+/***************************************************************************
+ * FUNCTION
+ * xMemFreeIndexRemove
+ * DESCRIPTION
+ * remove an entry, the last entry moves into its place
+ * PARAMETERS
+ * i        [IN]    entry
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemFreeIndexRemove(u32 i)
+{
+    xMemFreeCount--;
+    xMemFreeSize[i]=xMemFreeSize[xMemFreeCount];
+    xMemFreeOffset[i]=xMemFreeOffset[xMemFreeCount];
+    xMemFreeSize[xMemFreeCount]=0;
+    xMemFreeOffset[xMemFreeCount]=XMEM_FREE_INDEX_NONE;
 }
-#else
-static u8 xMemBlockFree(void *ptr)
+
+/***************************************************************************
+ * FUNCTION
+ * xMemFreeIndexDel
+ * DESCRIPTION
+ * a block is no longer free or no longer exists
+ * PARAMETERS
+ * blk      [IN]    block header
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemFreeIndexDel(pxMemBlock blk)
 {
-    pxMemBlock blkprev=NULL,blkfree=NULL,blkprev2=NULL;
+    int i;
 
-    /*
-     -------------------------------------------
-     |  ...  |  next  |  blk  |  prev  |  ...  |
-     -------------------------------------------
-    */
+    i=xMemFreeIndexFind(blk);
+    if(i>=0) xMemFreeIndexRemove(i);
+}
 
-    blkfree=xMemBlkList;
-    while(blkfree)
+/***************************************************************************
+ * FUNCTION
+ * xMemFreeIndexSet
+ * DESCRIPTION
+ * a block became free or a free block changed its size
+ * PARAMETERS
+ * blk      [IN]    block header
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemFreeIndexSet(pxMemBlock blk)
+{
+    int i;
+
+    i=xMemFreeIndexFind(blk);
+    if(i>=0)
     {
-        if(blkfree->addr==ptr)
-        {
-            blkfree->free = 1;
-            //may move this block of code to memory collection
-            if(blkprev&&blkprev->free)
-            {
-                blkprev->blksize += blkfree->blksize;
-                blkprev->next = blkfree->next;
-                blkprev->addr = blkfree->addr;
-                xMemMgrHdrPut(blkfree);
-                blkfree = blkprev;
-                blkprev = blkprev2;
-            }
+        xMemFreeSize[i]=blk->blksize;
+    }
+    else if(xMemFreeCount<XMEM_FREE_INDEX_MAX)
+    {
+        xMemFreeSize[xMemFreeCount]=blk->blksize;
+        xMemFreeOffset[xMemFreeCount]=(uptr)blk-XMEM_POOL_START;
+        xMemFreeCount++;
+    }
+    else
+    {
+        //index is full, best fit walks the list until the index is rebuilt
+        xMemFreeOverflow=1;
+    }
+}
 
-            if(blkfree->addr==xMemBlkPoolStart)
-            {
-                xMemBlkPoolStart += blkfree->blksize;
-                if(blkprev)
-                {
-                    blkprev->next = blkfree->next;
-                }
-                else
-                {
-                    blkfree->addr = NULL;
-                    blkfree->blksize = 0;
-                    blkfree->next = NULL;
-                }
-                xMemMgrHdrPut(blkfree);
-            }
-            else  if(blkfree->next&&blkfree->next->free)
-            {
-                blkprev = blkfree;
-                blkfree = blkfree->next;
+/***************************************************************************
+ * FUNCTION
+ * xMemFreeIndexBuild
+ * DESCRIPTION
+ * rebuild the free index from the block list
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemFreeIndexBuild(void)
+{
+    pxMemBlock blk;
 
-                blkprev->blksize += blkfree->blksize;
-                blkprev->addr = blkfree->addr;
-                blkprev->next = blkfree->next;
-                xMemMgrHdrPut(blkfree);
-            }
-            //end
-            return 0;
-        }
-        blkprev2 = blkprev;
-        blkprev = blkfree;
-        blkfree = blkfree->next;
+    memset(xMemFreeSize,0,sizeof(xMemFreeSize));
+    memset(xMemFreeOffset,0xFF,sizeof(xMemFreeOffset));
+    xMemFreeCount=0;
+    xMemFreeOverflow=0;
+    xMemFreeRebuild=0;
+    for(blk=xMemBlkList;blk;blk=blk->next)
+    {
+        if(blk->free==XMEM_BLOCK_FREE) xMemFreeIndexSet(blk);
     }
+}
+#endif
 
-    return 1;
+#if XMEM_MAINT_ENABLE
+static pxMemBlock xMemMaintCursor=NULL;     //block the next page trimming step starts at
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockAbsorbed
+ * DESCRIPTION
+ * a block header is merged into another block or released, keep the check
+ * cursor, the next fit rover and the free index valid
+ * PARAMETERS
+ * blk      [IN]    block header that no longer exists
+ * into     [IN]    block that absorbed it, NULL if the space left the list
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemBlockAbsorbed(pxMemBlock blk,pxMemBlock into)
+{
+    #if XMEM_BOUNDRY_CHECK_ENABLE && XMEM_CHECK_MODE == XMEM_CHECK_BOUNDED
+    if(xMemCheckCursor==blk) xMemCheckCursor=into;
+    #endif
+    #if XMEM_MAINT_ENABLE
+    if(xMemMaintCursor==blk) xMemMaintCursor=into;
+    #endif
+    if(xMemFitRover==blk) xMemFitRover=into;
+    #if XMEM_FREE_INDEX
+    xMemFreeIndexDel(blk);
+    #endif
+}
+
+#if XMEM_TAG_ENABLE
+#if !XMEM_POOL_SHARED_ENABLE
+static xMemTagInfo xMemTagTable[XMEM_TAG_MAX];
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemTagRelease
+ * DESCRIPTION
+ * take a tagged block out of the count of its tag, before it is freed
+ * PARAMETERS
+ * blk      [IN]    used block
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemTagRelease(pxMemBlock blk)
+{
+    xMemTagInfo * info=&xMemTagTable[XMEM_BLOCK_TAG(blk)];
+
+    info->bytes-=blk->blksize;
+    info->count--;
+    XMEM_BLOCK_TAG(blk)=0;
 }
+#endif
 
+//the pressure watermark and the size tuning follow the bytes in use
+#define XMEM_USED_COUNT     (XMEM_PRESSURE_ENABLE||XMEM_TUNE_ENABLE)
 
+#if XMEM_USED_COUNT
+#if !XMEM_POOL_SHARED_ENABLE
+//bytes of the used blocks in the block list, super blocks count as the blocks they take
+static u32 xMemBlockUsed=0;
 #endif
-static const char xMemDumpMsgBlock[]="-----Block Info-----\n";
-static const char xMemDumpFmtBlock[]="blk:%u,blksize:%d,blknext:%u,free:%d\n";
+#define XMEM_USED_ADD(blk)  (xMemBlockUsed+=(blk)->blksize)
+#else
+#define XMEM_USED_ADD(blk)
+#endif
+
+#if XMEM_DEFER_COALESCE_ENABLE
+static pxMemBlock xMemQuickList[XMEM_QUICKLIST_SIZE];
+static u8 xMemQuickCount=0;
 
 /***************************************************************************
  * FUNCTION
- * xMemBLockListInfoDump
+ * xMemQuickListGet
  * DESCRIPTION
- * Dump block lists information
+ * take a deferred block which size equals to required size
+ * PARAMETERS
+ * allocsize  [IN]  block size that required
+ * RETURNS
+ * pxMemBlock  block, NULL if no block fit
+ * *************************************************************************/
+static pxMemBlock xMemQuickListGet(u32 allocsize)
+{
+    u8 i;
+    pxMemBlock blk;
+
+    for(i=0;i<xMemQuickCount;i++)
+    {
+        blk=xMemQuickList[i];
+        if(blk->blksize==allocsize)
+        {
+            xMemQuickList[i]=xMemQuickList[--xMemQuickCount];
+            #if XMEM_BOUNDRY_CHECK_ENABLE
+            XMEM_CHECK_NEIGHBOURS(NULL,blk);
+            #endif
+            blk->free=XMEM_BLOCK_USED;
+            return blk;
+        }
+    }
+    return NULL;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockCoalesce
+ * DESCRIPTION
+ * release all deferred blocks and merge physical neighbor free blocks
  * PARAMETERS
  * void
  * RETURNS
  * void
  * *************************************************************************/
-static void xMemBlockListInfoDump(void)
+static void xMemBlockCoalesce(void)
 {
-    pxMemBlock pmemblk;
+    pxMemBlock blk,blkprev=NULL,blknext;
 
-    pmemblk=xMemBlkList;
-    xMemPrintf(xMemDumpMsgBlock);
-
-    while(pmemblk)
+    xMemQuickCount=0;
+    for(blk=xMemBlkList;blk;blkprev=blk,blk=blk->next)
     {
+        if(blk->free==XMEM_BLOCK_USED) continue;
+
+        blk->free=XMEM_BLOCK_FREE;
+        while(blk->next&&blk->next->free!=XMEM_BLOCK_USED)
+        {
+            blknext=blk->next;
+            #if XMEM_BOUNDRY_CHECK_ENABLE
+            blk->blksize+=blknext->blksize+XMEM_BLOCK_SIZE;
+            blk->next=blknext->next;
+            xMemBlockAbsorbed(blknext,blk);
+            #else
+            //list runs from high to low address
+            blk->blksize+=blknext->blksize;
+            blk->addr=blknext->addr;
+            blk->next=blknext->next;
+            xMemBlockAbsorbed(blknext,blk);
+            xMemMgrHdrPut(blknext);
+            #endif
+        }
+
         #if XMEM_HEADER_PROTECT_ENABLE
-        xMemPrintf(xMemDumpFmtBlock,(u32)pmemblk->addr,pmemblk->blksize,(u32)pmemblk->next,pmemblk->free);
+        if((uptr)blk->addr==xMemBlkPoolStart)
+        {
+            //lowest block gives its space back to the gap between headers and blocks
+            xMemBlkPoolStart+=blk->blksize;
+            if(blkprev) blkprev->next=NULL;
+            else xMemBlkList=NULL;
+            xMemBlockAbsorbed(blk,NULL);
+            xMemMgrHdrPut(blk);
+            return;
+        }
         #else
-        xMemPrintf(xMemDumpFmtBlock,(u32)pmemblk,pmemblk->blksize,(u32)pmemblk->next,pmemblk->free);
+        (void)blkprev;
         #endif
-        pmemblk=pmemblk->next;
     }
-    xMemPrintf(xMemDumpMsgBlock);
-    return;
+    #if XMEM_FREE_INDEX
+    xMemFreeIndexBuild();
+    #endif
 }
 
-
-#if XMEM_SUPERBLOCK_ENABLE
-static xMemSuperBlock xMemSuperBlockList[XMEM_SUPERBLOCK_LIST_COUNT]={0};
-
-static const char xMemSuperBlkInitFailureFmt[]="Init Super Block [Failed], super block:%u, address:%u, blocks:%d,block size:%d\n";
 /***************************************************************************
  * FUNCTION
- * xMemSuperBlockInit
+ * xMemBlockDefer
  * DESCRIPTION
- * Init super block
+ * put a block on the quick list instead of merging it
  * PARAMETERS
- * psuperblock  [IN/OUT]    super block be initial
- * addr         [IN]    meta blocks address
- * nblks        [IN]    blocks count
- * blksize      [IN]    block size
+ * blk      [IN]    block be free
  * RETURNS
  * void
  * *************************************************************************/
-static void xMemSuperBlockInit (xMemSuperBlock * psuperblock,void *addr, u8 nblks, u16 blksize)
-{  
-    xMemAssert(nblks<=XMEM_SUPERBLOCK_BLKS_MAX);
- 
-    if (addr == NULL||nblks < 2||blksize < sizeof(void *)||psuperblock == NULL)
+static void xMemBlockDefer(pxMemBlock blk)
+{
+    if(xMemQuickCount>=XMEM_QUICKLIST_SIZE)
     {
-        XMEM_LOG(xMemSuperBlkInitFailureFmt,(u32)psuperblock,(u32)addr,nblks,blksize);
-        return ;
+        xMemBlockCoalesce();
     }
-    psuperblock->addr     = addr;
-    psuperblock->freeList = (nblks==XMEM_SUPERBLOCK_BLKS_MAX)?0xFFFFFFFF:((1<<nblks)-1);
-    psuperblock->nfree    = nblks;
-    psuperblock->nblk    = nblks;
-    psuperblock->blksize  = blksize;
-    psuperblock->next = NULL;
+    blk->free=XMEM_BLOCK_DEFERRED;
+    xMemQuickList[xMemQuickCount++]=blk;
+}
+#endif
 
-    return ;
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockAlloc
+ * DESCRIPTION
+ * allocate a memory bock
+ * PARAMETERS
+ * size  [IN] block size that required
+ * RETURNS
+ * void * memory block address that alocated
+ * *************************************************************************/
+#if XMEM_BOUNDRY_CHECK_ENABLE
+
+static void * xMemBlockAlloc(size_t size)
+{
+    pxMemBlock blkprev=NULL,blk=NULL,blknew=NULL,blkalloc=NULL,blkallocprev=NULL,blkstart;
+    u32 allocsize,remainsize;
+    #if XMEM_FREE_INDEX
+    int i=-1;
+    #endif
+
+    /*
+     --------------------------------------------------------------
+     |       |     prev     |     blk      |    next      |       |
+     |  ...  |--------------|--------------|--------------|  ...  |
+     |       |header|  mem  |header|  mem  |header|  mem  |       |
+     --------------------------------------------------------------
+    */
+
+    blk=xMemBlkList;
+    remainsize=XMEM_POOL_SIZE;
+    blkalloc=NULL;
+    allocsize=(size+XMEM_ALIGN_SIZE-1)&~(u32)(XMEM_ALIGN_SIZE-1);
+
+    #if XMEM_DEFER_COALESCE_ENABLE
+    blkalloc=xMemQuickListGet(allocsize);
+    if(blkalloc)
+    {
+        XMEM_USED_ADD(blkalloc);
+        return XMEM_BLOCK_ADDR(blkalloc);
+    }
+    #endif
+
+    //list is in address order, next fit starts from the rover and wraps around to the head
+    if(xMemFitPolicy==XMEM_FIT_NEXT&&xMemFitRover) blk=xMemFitRover;
+    blkstart=blk;
+
+    #if XMEM_FREE_INDEX
+    if(xMemFreeOverflow&&++xMemFreeRebuild>=XMEM_FREE_INDEX_MAX) xMemFreeIndexBuild();
+    if(xMemFitPolicy==XMEM_FIT_BEST&&!xMemFreeOverflow)
+    {
+        //best fit searches the free index, the list walk is skipped
+        i=xMemFreeIndexBest(allocsize);
+        if(i>=0)
+        {
+            blkalloc=XMEM_FREE_INDEX_BLK(i);
+            remainsize=blkalloc->blksize-allocsize;
+            xMemFreeIndexRemove(i);
+        }
+        blk=NULL;
+    }
+    #endif
+    while(blk)
+    {
+        if(blk->free==XMEM_BLOCK_FREE)
+        {
+           if(blk->blksize==allocsize)
+           {//most fitable, block size equals to required size
+               XMEM_CHECK_NEIGHBOURS(blkprev,blk);
+               blk->free=0;
+               XMEM_USED_ADD(blk);
+               xMemFitRover=blk->next;
+               #if XMEM_FREE_INDEX
+               xMemFreeIndexDel(blk);
+               #endif
+               return (void*)blk+XMEM_BLOCK_SIZE;
+           }
+           else if(blk->blksize>allocsize&&(blk->blksize-allocsize)<remainsize)
+           {// find minimal fitable size block
+                remainsize=blk->blksize-allocsize;
+                blkalloc=blk;
+                blkallocprev=blkprev;
+                //first fit and next fit take the first block that is large enough
+                if(xMemFitPolicy!=XMEM_FIT_BEST) break;
+           }
+        }
+        XMEM_CHECK_LINK(blk,blkprev);
+        blkprev=blk;
+        blk=blk->next;
+        if(blk==NULL&&blkstart!=xMemBlkList)
+        {
+            blk=xMemBlkList;
+            blkprev=NULL;
+        }
+        if(blk==blkstart) break;
+    }
+
+    if(blkalloc)
+    {
+        XMEM_CHECK_NEIGHBOURS(blkallocprev,blkalloc);
+        #if XMEM_FREE_INDEX
+        if(i<0) xMemFreeIndexDel(blkalloc);
+        #endif
+        if(remainsize>(XMEM_BLOCK_SIZE+XMEM_BALLANCE_SIZE))
+        {
+            //split into 2 blocks
+            blknew=(pxMemBlock)((void *)blkalloc+allocsize+XMEM_BLOCK_SIZE);
+            blknew->blksize=remainsize-XMEM_BLOCK_SIZE;
+            blknew->free=1;
+            XMEM_BLOCK_FLAGS(blknew)=0;
+            XMEM_BLOCK_TAG(blknew)=0;
+            blknew->next=blkalloc->next;
+            blkalloc->next=blknew;
+            blkalloc->blksize=allocsize;
+            #if XMEM_FREE_INDEX
+            xMemFreeIndexSet(blknew);
+            #endif
+        }
+
+        blkalloc->free=0;
+        XMEM_USED_ADD(blkalloc);
+        xMemFitRover=blkalloc->next;
+        return (void*)blkalloc+XMEM_BLOCK_SIZE;
+    }
+
+    #if XMEM_DEFER_COALESCE_ENABLE
+    if(xMemQuickCount)
+    {
+        xMemBlockCoalesce();
+        return xMemBlockAlloc(size);
+    }
+    #endif
+
+    xMemBlockListCheck();
+    return NULL;
+}
+#else
+static void * xMemBlockAlloc(size_t size)
+{
+    pxMemBlock blkprev=NULL,blk=NULL,blknew=NULL,blkalloc=NULL,blkstart,blktail=NULL;
+    u32 allocsize,remainsize,gapsize,gapneed;
+
+    /*
+     -------------------------------------------
+     |  ...  |  next  |  blk  |  prev  |  ...  |
+     -------------------------------------------
+    */
+
+    blk = xMemBlkList;
+    blkprev = xMemBlkList;
+    gapsize = xMemBlkPoolStart-xMemMgrHdrListEnd;
+    //best fit weighs the gap between headers and blocks like a free block, the gap is the lowest address.
+    //a gap that can not hold the request must not turn down the free blocks, with every header page
+    //full its header takes a new page from the gap as well
+    allocsize=(size+XMEM_ALIGN_SIZE-1)&~(u32)(XMEM_ALIGN_SIZE-1);
+    gapneed = allocsize+(xMemHdrPageList?0:XMEM_HEADER_PAGE_SIZE);
+    remainsize = xMemFitPolicy==XMEM_FIT_BEST&&gapsize>=gapneed?gapsize-allocsize:XMEM_POOL_SIZE;
+    blkalloc=NULL;
+
+    #if XMEM_DEFER_COALESCE_ENABLE
+    blkalloc=xMemQuickListGet(allocsize);
+    if(blkalloc)
+    {
+        XMEM_USED_ADD(blkalloc);
+        return XMEM_BLOCK_ADDR(blkalloc);
+    }
+    #endif
+
+    //list is in address order, next fit starts from the rover and wraps around to the head
+    if(xMemFitPolicy==XMEM_FIT_NEXT&&xMemFitRover) blk=xMemFitRover;
+    blkstart=blk;
+    while(blk)
+    {
+        if(blk->free==XMEM_BLOCK_FREE)
+        {
+           if(blk->blksize==allocsize)
+           {//most fitable, block size equals to required size
+               blk->free=0;
+               XMEM_USED_ADD(blk);
+               xMemFitRover=blk->next;
+               return (void*)blk->addr;
+           }
+           else if(blk->blksize>allocsize&&(blk->blksize-allocsize)<remainsize)
+           {// find minimal fitable size block 
+                remainsize=blk->blksize-allocsize;
+                blkalloc=blk;
+                //first fit and next fit take the first block that is large enough
+                if(xMemFitPolicy!=XMEM_FIT_BEST) break;
+            }
+        }
+        blkprev=blk;
+        blk=blk->next;    
+        if(blk==NULL)
+        {
+            //new blocks are linked after the tail
+            blktail=blkprev;
+            if(blkstart!=xMemBlkList) blk=xMemBlkList;
+        }
+        if(blk==blkstart) break;
+    }
+
+    if(blkalloc)
+    {
+        if(remainsize>=XMEM_BALLANCE_SIZE)
+        {
+            //split into 2 blocks
+            blknew=(pxMemBlock)xMemMgrHdrGet(XMEM_LIST_TYPE_BLOCK);
+            if(blknew != NULL)
+            {
+                blknew->blksize=remainsize;
+                blknew->free=1;
+                XMEM_BLOCK_FLAGS(blknew)=0;
+                XMEM_BLOCK_TAG(blknew)=0;
+                blknew->next=blkalloc->next;
+                //list runs from high to low address, the remain part stays below
+                blknew->addr=blkalloc->addr;
+                blkalloc->addr=(void*)blkalloc->addr+remainsize;
+                blkalloc->next=blknew;
+                blkalloc->blksize=allocsize;
+            }
+        }
+        
+        blkalloc->free=0;
+        XMEM_USED_ADD(blkalloc);
+        xMemFitRover=blkalloc->next;
+        return (void*)blkalloc->addr;
+    }
+    else if(gapsize>=gapneed)
+    {
+        blknew=(pxMemBlock)xMemMgrHdrGet(XMEM_LIST_TYPE_BLOCK);
+        if(blknew != NULL)
+        {
+            if(blktail)
+            {
+                blktail->next = blknew;
+            }
+            else
+            {
+                xMemBlkList = blknew;
+            }
+
+            blknew->next = NULL;
+            blknew->blksize = allocsize;
+            blknew->free = 0;
+            XMEM_BLOCK_FLAGS(blknew) = 0;
+            XMEM_BLOCK_TAG(blknew)=0;
+            xMemBlkPoolStart -= allocsize;
+            blknew->addr = (void*)xMemBlkPoolStart;
+            blkalloc = blknew;
+            XMEM_USED_ADD(blkalloc);
+            return (void*)blkalloc->addr;
+        }
+    }
+
+    #if XMEM_DEFER_COALESCE_ENABLE
+    if(xMemQuickCount)
+    {
+        xMemBlockCoalesce();
+        return xMemBlockAlloc(size);
+    }
+    #endif
+
+    return NULL;
+}
+
+#endif
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockFree
+ * DESCRIPTION
+ * free a memory bock
+ * PARAMETERS
+ * ptr  [IN] block address that be free
+ * RETURNS
+ * u8 0-success,1-failure
+ * *************************************************************************/
+#if XMEM_BOUNDRY_CHECK_ENABLE
+static u8 xMemBlockFree(void *ptr){
+    pxMemBlock blkprev=NULL,blkfree=NULL;
+
+    /*
+     --------------------------------------------------------------
+     |       |     prev     |     blk      |    next      |       |
+     |  ...  |--------------|--------------|--------------|  ...  |
+     |       |header|  mem  |header|  mem  |header|  mem  |       |
+     --------------------------------------------------------------
+    */
+
+    blkfree = xMemBlkList;
+    while(blkfree)
+    {
+        if((uptr)blkfree+XMEM_BLOCK_SIZE==(uptr)ptr)
+        {
+            XMEM_CHECK_NEIGHBOURS(blkprev,blkfree);
+            #if XMEM_TAG_ENABLE
+            if(XMEM_BLOCK_TAG(blkfree)) xMemTagRelease(blkfree);
+            #endif
+            #if XMEM_USED_COUNT
+            if(blkfree->free==XMEM_BLOCK_USED) xMemBlockUsed-=blkfree->blksize;
+            #endif
+            #if XMEM_DEFER_COALESCE_ENABLE
+            if(blkfree->free!=XMEM_BLOCK_USED) return 1;
+            xMemBlockDefer(blkfree);
+            return 0;
+            #endif
+            blkfree->free=1;
+            //merge physical neighbor blocks, previous or next, assure block will not overlap reserve space
+            if(blkprev&&blkprev->free)
+            {
+                blkprev->blksize += (blkfree->blksize+XMEM_BLOCK_SIZE);
+                blkprev->next = blkfree->next;
+                xMemBlockAbsorbed(blkfree,blkprev);
+                blkfree = blkprev;
+            }
+
+            if(blkfree->next&&blkfree->next->free)
+            {
+                blkfree->blksize += (blkfree->next->blksize+XMEM_BLOCK_SIZE);
+                xMemBlockAbsorbed(blkfree->next,blkfree);
+                blkfree->next = blkfree->next->next;
+            }
+            #if XMEM_FREE_INDEX
+            xMemFreeIndexSet(blkfree);
+            #endif
+
+            return 0;
+        }
+
+        XMEM_CHECK_LINK(blkfree,blkprev);
+        blkprev = blkfree;
+        blkfree = blkfree->next;
+    }
+
+    return 1;
+}
+#else
+static u8 xMemBlockFree(void *ptr)
+{
+    pxMemBlock blkprev=NULL,blkfree=NULL,blkprev2=NULL;
+
+    /*
+     -------------------------------------------
+     |  ...  |  next  |  blk  |  prev  |  ...  |
+     -------------------------------------------
+    */
+
+    blkfree=xMemBlkList;
+    while(blkfree)
+    {
+        if(blkfree->addr==ptr)
+        {
+            #if XMEM_TAG_ENABLE
+            if(XMEM_BLOCK_TAG(blkfree)) xMemTagRelease(blkfree);
+            #endif
+            #if XMEM_USED_COUNT
+            if(blkfree->free==XMEM_BLOCK_USED) xMemBlockUsed-=blkfree->blksize;
+            #endif
+            #if XMEM_DEFER_COALESCE_ENABLE
+            if(blkfree->free!=XMEM_BLOCK_USED) return 1;
+            xMemBlockDefer(blkfree);
+            return 0;
+            #endif
+            blkfree->free = 1;
+            //may move this block of code to memory collection
+            if(blkprev&&blkprev->free)
+            {
+                blkprev->blksize += blkfree->blksize;
+                blkprev->next = blkfree->next;
+                blkprev->addr = blkfree->addr;
+                xMemBlockAbsorbed(blkfree,blkprev);
+                xMemMgrHdrPut(blkfree);
+                blkfree = blkprev;
+                blkprev = blkprev2;
+            }
+
+            if((uptr)blkfree->addr==xMemBlkPoolStart)
+            {
+                xMemBlkPoolStart += blkfree->blksize;
+                if(blkprev)
+                {
+                    blkprev->next = blkfree->next;
+                }
+                else
+                {
+                    xMemBlkList = NULL;
+                }
+                xMemBlockAbsorbed(blkfree,NULL);
+                xMemMgrHdrPut(blkfree);
+            }
+            else  if(blkfree->next&&blkfree->next->free)
+            {
+                blkprev = blkfree;
+                blkfree = blkfree->next;
+
+                blkprev->blksize += blkfree->blksize;
+                blkprev->addr = blkfree->addr;
+                blkprev->next = blkfree->next;
+                xMemBlockAbsorbed(blkfree,blkprev);
+                xMemMgrHdrPut(blkfree);
+            }
+            //end
+            return 0;
+        }
+        blkprev2 = blkprev;
+        blkprev = blkfree;
+        blkfree = blkfree->next;
+    }
+
+    return 1;
+}
+
+
+#endif
+static const char xMemDumpMsgBlock[]="-----Block Info-----\n";
+static const char xMemDumpFmtBlock[]="blk:%p,blksize:%d,blknext:%p,free:%d\n";
+
+/***************************************************************************
+ * FUNCTION
+ * xMemBLockListInfoDump
+ * DESCRIPTION
+ * Dump block lists information
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemBlockListInfoDump(void)
+{
+    pxMemBlock pmemblk;
+
+    pmemblk=xMemBlkList;
+    xMemPrintf(xMemDumpMsgBlock);
+
+    while(pmemblk)
+    {
+        #if XMEM_HEADER_PROTECT_ENABLE
+        xMemPrintf(xMemDumpFmtBlock,pmemblk->addr,pmemblk->blksize,(void *)pmemblk->next,pmemblk->free);
+        #else
+        xMemPrintf(xMemDumpFmtBlock,(void *)pmemblk,pmemblk->blksize,(void *)pmemblk->next,pmemblk->free);
+        #endif
+        pmemblk=pmemblk->next;
+    }
+    xMemPrintf(xMemDumpMsgBlock);
+    return;
+}
+
+
+#if XMEM_SUPERBLOCK_ENABLE
+#if !XMEM_POOL_SHARED_ENABLE
+static xMemSuperBlock xMemSuperBlockList[XMEM_SUPERBLOCK_LIST_COUNT]={0};
+#endif
+
+//the size map needs the block header in front of each super block
+#define XMEM_SIZE_MAP   (XMEM_SIZE_MAP_ENABLE&&XMEM_BOUNDRY_CHECK_ENABLE)
+
+#if XMEM_SIZE_MAP
+#if !XMEM_POOL_SHARED_ENABLE
+static u32 xMemSizeMap[XMEM_POOL_SIZE/XMEM_ALIGN_SIZE/32+1];
+#endif
+
+#define XMEM_SIZE_MAP_UNIT(p)   (((uptr)(p)-XMEM_POOL_START)/XMEM_ALIGN_SIZE)
+#define XMEM_SIZE_MAP_BIT(u)    (xMemSizeMap[(u)>>5]&((u32)1<<((u)&31)))
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSizeMapMark
+ * DESCRIPTION
+ * mark or unmark the slots of a super block in the size map, the slot size
+ * is kept in the header of the block that holds the slots
+ * PARAMETERS
+ * psuperblock  [IN]    super block
+ * set          [IN]    1-mark, 0-unmark
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemSizeMapMark(xMemSuperBlock * psuperblock,u8 set)
+{
+    uptr u,end;
+
+    u=XMEM_SIZE_MAP_UNIT(psuperblock->addr);
+    end=XMEM_SIZE_MAP_UNIT(psuperblock->addr+psuperblock->blksize*psuperblock->nblk);
+    for(;u<end;u++)
+    {
+        if(set) xMemSizeMap[u>>5]|=(u32)1<<(u&31);
+        else xMemSizeMap[u>>5]&=~((u32)1<<(u&31));
+    }
+    if(set) XMEM_BLOCK_SLOT((pxMemBlock)(psuperblock->addr-XMEM_BLOCK_SIZE))=psuperblock->blksize;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSizeMapGet
+ * DESCRIPTION
+ * get the slot size of a meta block, marked units run back to the start of
+ * its super block which is at most XMEM_SUPERBLOCK_BLKS_MAX slots away
+ * PARAMETERS
+ * ptr      [IN]    block address
+ * RETURNS
+ * u32 slot size, 0 if ptr is not in a super block
+ * *************************************************************************/
+static u32 xMemSizeMapGet(void *ptr)
+{
+    uptr u;
+
+    if((uptr)ptr<XMEM_POOL_START||(uptr)ptr>=XMEM_POOL_END) return 0;
+    u=XMEM_SIZE_MAP_UNIT(ptr);
+    if(!XMEM_SIZE_MAP_BIT(u)) return 0;
+    //the header in front of a super block is never marked, so u stops at its first slot
+    while(u&&XMEM_SIZE_MAP_BIT(u-1)) u--;
+    return XMEM_BLOCK_SLOT((pxMemBlock)(XMEM_POOL_START+u*XMEM_ALIGN_SIZE-XMEM_BLOCK_SIZE));
+}
+#endif
+
+#if XMEM_DEBUG
+static const char xMemSuperBlkInitFailureFmt[]="Init Super Block [Failed], super block:%p, address:%p, blocks:%d,block size:%d\n";
+#endif
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockInit
+ * DESCRIPTION
+ * Init super block
+ * PARAMETERS
+ * psuperblock  [IN/OUT]    super block be initial
+ * addr         [IN]    meta blocks address
+ * nblks        [IN]    blocks count
+ * blksize      [IN]    block size
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemSuperBlockInit (xMemSuperBlock * psuperblock,void *addr, u8 nblks, u16 blksize)
+{  
+    xMemAssert(nblks<=XMEM_SUPERBLOCK_BLKS_MAX);
+ 
+    if (addr == NULL||nblks < 2||blksize < sizeof(void *)||psuperblock == NULL)
+    {
+        XMEM_LOG(xMemSuperBlkInitFailureFmt,(void *)psuperblock,addr,nblks,blksize);
+        return ;
+    }
+    psuperblock->addr     = addr;
+    psuperblock->freeList = (nblks==XMEM_SUPERBLOCK_BLKS_MAX)?0xFFFFFFFF:(((u32)1<<nblks)-1);
+    psuperblock->nfree    = nblks;
+    psuperblock->nblk    = nblks;
+    psuperblock->blksize  = blksize;
+    psuperblock->next = NULL;
+
+    return ;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockAppend
+ * DESCRIPTION
+ * Add a new super block behind the first one, super blocks grow
+ * geometrically from half of the first one up to XMEM_SUPERBLOCK_BLKS_MAX
+ * slots
+ * PARAMETERS
+ * psuperblock  [IN/OUT] super block list
+ * RETURNS
+ * xMemSuperBlock *  new super block
+ * *************************************************************************/
+static xMemSuperBlock * xMemSuperBlockAppend(xMemSuperBlock * superblocklist)
+{
+    xMemSuperBlock * pmem,*pmemnew=NULL;
+    void *blk;
+    u32 nblk;
+
+    nblk=superblocklist->nblk/4;
+    for(pmem=superblocklist->next;pmem;pmem=pmem->next)
+    {
+        if(pmem->nblk>nblk) nblk=pmem->nblk;
+    }
+    nblk*=2;
+    if(nblk>XMEM_SUPERBLOCK_BLKS_MAX) nblk=XMEM_SUPERBLOCK_BLKS_MAX;
+    if(nblk<2) nblk=2;
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    pmemnew=(xMemSuperBlock *)xMemBlockAlloc(XMEM_NODE_SIZE(xMemSuperBlock));
+    #else
+    pmemnew=(xMemSuperBlock *)xMemMgrHdrGet(XMEM_LIST_TYPE_SUPERBLOCK);
+    #endif
+    if(pmemnew)
+    {
+        blk=xMemBlockAlloc(superblocklist->blksize*nblk);
+        if(blk)
+        {
+            xMemSuperBlockInit(pmemnew,blk,nblk,superblocklist->blksize);
+            #if XMEM_SIZE_MAP
+            xMemSizeMapMark(pmemnew,1);
+            #endif
+            //super blocks with free slots come first
+            pmemnew->next=superblocklist->next;
+            superblocklist->next=pmemnew;
+        }else
+        {
+            #if XMEM_BOUNDRY_CHECK_ENABLE
+            xMemBlockFree(pmemnew);
+            #else
+            xMemMgrHdrPut(pmemnew);
+            #endif
+            pmemnew=NULL;
+        }
+    }
+    return pmemnew;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockListInit
+ * DESCRIPTION
+ * Init super block list
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemSuperBlockListInit(void)
+{
+    static const u8 cnt[]={
+        XMEM_SUPERBLOCK_1META_CNT,
+        XMEM_SUPERBLOCK_2META_CNT,
+        XMEM_SUPERBLOCK_4META_CNT,
+        #if XMEM_8META_ENABLE
+        XMEM_SUPERBLOCK_8META_CNT,
+        #endif
+    };
+    void * blk;
+    u8 i;
+
+    #if XMEM_SIZE_MAP
+    memset(xMemSizeMap,0,sizeof(xMemSizeMap));
+    #endif
+
+    //one block for each list, every super block has a header in front of it
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
+    {
+        memset(&xMemSuperBlockList[i],0,sizeof(xMemSuperBlock));
+        blk=xMemBlockAlloc(cnt[i]*(XMEM_META_BLOCK_SIZE<<i));
+        if(blk)
+        {
+            xMemSuperBlockInit(&xMemSuperBlockList[i],blk,cnt[i],XMEM_META_BLOCK_SIZE<<i);
+            #if XMEM_SIZE_MAP
+            xMemSizeMapMark(&xMemSuperBlockList[i],1);
+            #endif
+        }
+    }
+}
+
+static const char xMemDumpMsgSuperBblock[]="-----SuperBlock Info-----\n";
+static const char xMemDumpFmtSuperBlock[]="size:%d,free:%d,total:%d\n";
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockInfoDump
+ * DESCRIPTION
+ * Dump super block lists information
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemSuperBlockInfoDump(void)
+{
+    u8 i;
+
+    xMemSuperBlock * psuperblock;
+    xMemPrintf(xMemDumpMsgSuperBblock);
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
+    {
+        psuperblock=&xMemSuperBlockList[i];
+        while(psuperblock)
+        {
+            xMemPrintf(xMemDumpFmtSuperBlock,psuperblock->blksize,psuperblock->nfree,psuperblock->nblk);
+            psuperblock=psuperblock->next;
+        }
+    }
+    xMemPrintf(xMemDumpMsgSuperBblock);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockTake
+ * DESCRIPTION
+ * Take a free meta block from a super block
+ * PARAMETERS
+ * psuperblock  [IN/OUT]    super block which has free meta blocks
+ * RETURNS
+ * void * meta block
+ * *************************************************************************/
+static void * xMemSuperBlockTake(xMemSuperBlock * psuperblock)
+{
+    u32 i;
+    void      *pblk;
+
+    for(i=0;i<psuperblock->nblk;i++)
+    {
+       if((1<<i)&(psuperblock->freeList))
+       {
+          psuperblock->freeList&=(~(1<<i));
+          break;
+       }
+    }
+    xMemAssert(i<psuperblock->nblk);
+    pblk = (void *)(psuperblock->addr+i*(u32)(psuperblock->blksize));
+    //xMemPrintf("get %u\n",pblk);
+    psuperblock->nfree--;        
+    return (pblk);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMallocMetaBlockGet
+ * DESCRIPTION
+ * Get a meta block
+ * PARAMETERS
+ * superblocklist   [IN/OUT]    super block list
+ * size             [IN]    Meta block size required
+ * RETURNS
+ * void * meta block
+ * *************************************************************************/
+static void * xMallocMetaBlockGet(xMemSuperBlock * superblocklist,size_t size)
+{
+    xMemSuperBlock *pmemiter,*pmemprev=NULL,*pmemtail;
+    void * pblk;
+    
+    if (superblocklist == NULL||size>superblocklist->blksize)    return NULL;
+
+    /*
+     behind the first super block the ones with free slots come before the
+     full ones, the walk stops at the first or the second one
+    */
+    pmemiter=superblocklist;
+
+    while(pmemiter)
+    {
+        if (pmemiter->nfree > 0)
+        {
+            break;
+        }
+        
+        pmemprev=pmemiter;
+        pmemiter=pmemiter->next;
+    }
+    
+    if(pmemiter==NULL)
+    {
+        pmemiter=xMemSuperBlockAppend(superblocklist);
+        pmemprev=superblocklist;
+    }
+
+    if(pmemiter)
+    {
+        pblk=xMemSuperBlockTake(pmemiter);
+        //a super block that just became full goes to the tail
+        if(pmemiter->nfree==0&&pmemprev&&pmemiter->next)
+        {
+            pmemprev->next=pmemiter->next;
+            for(pmemtail=pmemiter->next;pmemtail->next;pmemtail=pmemtail->next);
+            pmemtail->next=pmemiter;
+            pmemiter->next=NULL;
+        }
+        return pblk;
+    }
+                
+    return NULL;   
+
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMallocMetaBlockPut
+ * DESCRIPTION
+ * put a meta block
+ * PARAMETERS
+ * superblocklist   [IN/OUT]    super block list
+ * pblk             [IN]    meta block be put
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void  xMallocMetaBlockPut (xMemSuperBlock  *superblocklist, void *pblk)
+{
+    u8 i;
+
+    if (superblocklist == NULL||pblk == NULL||superblocklist->nfree >= superblocklist->nblk)  return ;
+
+    i=(u32)(pblk-superblocklist->addr)/superblocklist->blksize;
+    superblocklist->freeList|=(1<<i);
+    superblocklist->nfree++;
+    return;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemMetaClassGet
+ * DESCRIPTION
+ * get the super block list that serves a size
+ * PARAMETERS
+ * size     [IN]    meta block size that required
+ * RETURNS
+ * int index of xMemSuperBlockList, -1 if the size is not served by super blocks
+ * *************************************************************************/
+static int xMemMetaClassGet(size_t size)
+{
+    #if XMEM_8META_ENABLE
+    if(size>XMEM_8META_BLOCK_SIZE) return -1;
+    if(size>XMEM_4META_BLOCK_SIZE) return 3;
+    #else
+    if(size>XMEM_4META_BLOCK_SIZE) return -1;
+    #endif
+    if(size>XMEM_2META_BLOCK_SIZE) return 2;
+    if(size>XMEM_META_BLOCK_SIZE) return 1;
+    if(size>0) return 0;
+    return -1;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMallocMetaBlockAlloc
+ * DESCRIPTION
+ * Allocate a meta block
+ * PARAMETERS
+ * size     [IN]    meta block size that required
+ * RETURNS
+ * void * meta block
+ * *************************************************************************/
+static void * xMallocMetaBlockAlloc(size_t size)
+{
+    void * ptr;
+    int i;
+
+    i=xMemMetaClassGet(size);
+    if(i<0) return NULL;
+    ptr=xMallocMetaBlockGet(&xMemSuperBlockList[i],size);
+
+    #if !XMEM_PRESSURE_ENABLE
+    //with XMEM_PRESSURE_ENABLE the callbacks hear about it instead
+    if(ptr==NULL)
+    {
+        xMemSuperBlockInfoDump();
+    }
+    #endif
+
+    return ptr;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockRelease
+ * DESCRIPTION
+ * unlink an empty super block and give its memory back
+ * PARAMETERS
+ * pmemprev [IN/OUT]    super block in front of it
+ * pmem     [IN]    empty super block, not the first of its list
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemSuperBlockRelease(xMemSuperBlock * pmemprev,xMemSuperBlock * pmem)
+{
+    pmemprev->next=pmem->next;
+    #if XMEM_SIZE_MAP
+    xMemSizeMapMark(pmem,0);
+    #endif
+    xMemBlockFree(pmem->addr);
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    xMemBlockFree(pmem);
+    #else
+    xMemMgrHdrPut(pmem);
+    #endif
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockEmptyCount
+ * DESCRIPTION
+ * count the empty super blocks of a list, the first one does not count
+ * PARAMETERS
+ * superblocklist   [IN]    super block list
+ * RETURNS
+ * u32 number of empty super blocks
+ * *************************************************************************/
+static u32 xMemSuperBlockEmptyCount(xMemSuperBlock * superblocklist)
+{
+    xMemSuperBlock * pmem;
+    u32 n=0;
+
+    for(pmem=superblocklist->next;pmem;pmem=pmem->next)
+    {
+        if(pmem->nfree==pmem->nblk) n++;
+    }
+    return n;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockReserve
+ * DESCRIPTION
+ * add super blocks to a list until it has count free slots, their pages
+ * are faulted in
+ * PARAMETERS
+ * superblocklist   [IN/OUT]    super block list
+ * count            [IN]    free slots required
+ * RETURNS
+ * int 0-success, -1-out of memory
+ * *************************************************************************/
+static int xMemSuperBlockReserve(xMemSuperBlock * superblocklist,u32 count)
+{
+    xMemSuperBlock * pmem;
+    u32 nfree=0;
+
+    if(superblocklist->blksize==0) return -1;
+    for(pmem=superblocklist;pmem;pmem=pmem->next) nfree+=pmem->nfree;
+
+    while(nfree<count)
+    {
+        pmem=xMemSuperBlockAppend(superblocklist);
+        if(pmem==NULL) return -1;
+        xMemPoolTouch(pmem->addr,pmem->blksize*pmem->nblk);
+        nfree+=pmem->nfree;
+    }
+    return 0;
+}
+
+#if XMEM_PRESSURE_ENABLE
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockReclaim
+ * DESCRIPTION
+ * free the empty super blocks every list keeps
+ * PARAMETERS
+ * void
+ * RETURNS
+ * u32 number of super blocks freed
+ * *************************************************************************/
+static u32 xMemSuperBlockReclaim(void)
+{
+    xMemSuperBlock * pmem,*pmemprev;
+    u32 i,n=0;
+
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
+    {
+        pmemprev=&xMemSuperBlockList[i];
+        while((pmem=pmemprev->next)!=NULL)
+        {
+            if(pmem->nfree==pmem->nblk)
+            {
+                xMemSuperBlockRelease(pmemprev,pmem);
+                n++;
+            }
+            else
+            {
+                pmemprev=pmem;
+            }
+        }
+    }
+    return n;
+}
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemMetaBlockListFree
+ * DESCRIPTION
+ * free a meta block that belongs to a super block list
+ * PARAMETERS
+ * superblocklist   [IN/OUT]    super block list
+ * pblk             [IN] meta block be free
+ * RETURNS
+ * u8 0-success, 1-pblk is not in the list
+ * *************************************************************************/
+static u8 xMemMetaBlockListFree(xMemSuperBlock * superblocklist,void * pblk)
+{
+    uptr start,end,p;
+    xMemSuperBlock  *pmem,*pmemprev=NULL;
+
+    p=(uptr)pblk;
+    pmem=superblocklist;
+    while(pmem)
+    {
+        start=(uptr)pmem->addr;
+        end=start+pmem->blksize*pmem->nblk;
+        if(p>=start&&p<end)
+        {
+            xMallocMetaBlockPut(pmem,pblk);
+            //the first super block is never freed or moved, with XMEM_MAINT_ENABLE xMemMaintain frees them
+            if(!XMEM_MAINT_ENABLE&&pmemprev&&pmem->nfree==pmem->nblk&&xMemSuperBlockEmptyCount(superblocklist)>XMEM_SUPERBLOCK_KEEP)
+            {
+                xMemSuperBlockRelease(pmemprev,pmem);
+            }
+            else if(pmemprev&&pmem->nfree==1&&pmemprev!=superblocklist)
+            {
+                //it was full, move it in front of the full ones
+                pmemprev->next=pmem->next;
+                pmem->next=superblocklist->next;
+                superblocklist->next=pmem;
+            }
+            return 0;
+        }
+        pmemprev=pmem;
+        pmem=pmem->next;        
+    }
+    return 1;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemMetaBlockFree
+ * DESCRIPTION
+ * free a meta block
+ * PARAMETERS
+ * pblk     [IN] meta block be free
+ * RETURNS
+ * u8 0-success, 1-failure
+ * *************************************************************************/
+static u8 xMemMetaBlockFree(void * pblk)
+{
+    int i;
+
+    if (pblk == NULL)   return 0;
+
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
+    {
+        if(xMemMetaBlockListFree(&xMemSuperBlockList[i],pblk)==0) return 0;
+    }
+    return 1;
+}
+
+#if !XMEM_SIZE_MAP
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockFind
+ * DESCRIPTION
+ * find the super block which a meta block belongs to
+ * PARAMETERS
+ * pblk     [IN] meta block
+ * RETURNS
+ * xMemSuperBlock * super block, NULL if pblk is not a meta block
+ * *************************************************************************/
+static xMemSuperBlock * xMemSuperBlockFind(void * pblk)
+{
+    int i;
+    uptr start,p;
+    xMemSuperBlock  *pmem;
+
+    p=(uptr)pblk;
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
+    {
+        for(pmem=&xMemSuperBlockList[i];pmem;pmem=pmem->next)
+        {
+            start=(uptr)pmem->addr;
+            if(p>=start&&p<start+pmem->blksize*pmem->nblk) return pmem;
+        }
+    }
+    return NULL;
+}
+#endif
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockSizeGet
+ * DESCRIPTION
+ * get the size of a meta block or memory block that allocated
+ * PARAMETERS
+ * ptr      [IN] block address
+ * RETURNS
+ * u32 block size, 0 if ptr is not an allocated block
+ * *************************************************************************/
+static u32 xMemBlockSizeGet(void *ptr)
+{
+    #if XMEM_SIZE_MAP
+    u32 slotsize;
+
+    slotsize=xMemSizeMapGet(ptr);
+    if(slotsize) return slotsize;
+    #elif XMEM_SUPERBLOCK_ENABLE
+    xMemSuperBlock * psuperblock;
+
+    psuperblock=xMemSuperBlockFind(ptr);
+    if(psuperblock) return psuperblock->blksize;
+    #endif
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    if((uptr)ptr<XMEM_POOL_START+XMEM_BLOCK_SIZE||(uptr)ptr>=XMEM_POOL_END) return 0;
+    return ((pxMemBlock)(ptr-XMEM_BLOCK_SIZE))->blksize;
+    #else
+    pxMemBlock blk;
+
+    //header is away from the block, look it up the same way as xMemBlockFree
+    for(blk=xMemBlkList;blk;blk=blk->next)
+    {
+        if(blk->addr==ptr) return blk->free?0:blk->blksize;
+    }
+    return 0;
+    #endif
+}
+
+#if XMEM_CANARY_ENABLE || XMEM_CANARY_HEAD_ENABLE
+#if XMEM_CANARY_HEAD_ENABLE
+#define XMEM_CANARY_HEAD_SIZE   ((u32)XMEM_ALIGN_SIZE)
+#else
+#define XMEM_CANARY_HEAD_SIZE   0
+#endif
+#if XMEM_CANARY_ENABLE
+#define XMEM_CANARY_TAIL_SIZE   ((u32)sizeof(u32)*2)    //canary word, size asked for in the last word
+#else
+#define XMEM_CANARY_TAIL_SIZE   0
+#endif
+#define XMEM_CANARY_SIZE    (XMEM_CANARY_HEAD_SIZE+XMEM_CANARY_TAIL_SIZE)
+
+static const char xMemCanaryFailureFmt[]="xMem canary broken, ptr:%p, size:%u, head:%08x, tail:%08x\n";
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCanarySet
+ * DESCRIPTION
+ * write canary words around a block that just allocated. the tail canary
+ * follows the bytes asked for, the last word of the block keeps their count
+ * PARAMETERS
+ * pblk     [IN] block address
+ * size     [IN] size asked for, without the canaries
+ * RETURNS
+ * void * address returned to user
+ * *************************************************************************/
+static void * xMemCanarySet(void *pblk,u32 size)
+{
+    #if XMEM_CANARY_HEAD_ENABLE
+    u32 i;
+    #endif
+    #if XMEM_CANARY_ENABLE
+    u32 word=XMEM_CANARY_WORD;
+    #endif
+
+    #if XMEM_CANARY_HEAD_ENABLE
+    for(i=0;i<XMEM_CANARY_HEAD_SIZE;i+=sizeof(u32)) *(u32*)(pblk+i)=XMEM_CANARY_WORD;
+    #endif
+    #if XMEM_CANARY_ENABLE
+    //any size may be asked for, the tail is not aligned
+    memcpy(pblk+XMEM_CANARY_HEAD_SIZE+size,&word,sizeof(u32));
+    *(u32*)(pblk+xMemBlockSizeGet(pblk)-sizeof(u32))=size;
+    #else
+    (void)size;
+    #endif
+    return pblk+XMEM_CANARY_HEAD_SIZE;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCanaryCheck
+ * DESCRIPTION
+ * verify canary words of one block, report the block when they are broken
+ * PARAMETERS
+ * ptr      [IN] address that returned to user
+ * RETURNS
+ * u32 size usable by user, the size asked for with a tail canary. 0 if ptr
+ * is not an allocated block
+ * *************************************************************************/
+static u32 xMemCanaryCheck(void *ptr)
+{
+    void * pblk;
+    u32 blksize,size,head,tail;
+
+    pblk=ptr-XMEM_CANARY_HEAD_SIZE;
+    blksize=xMemBlockSizeGet(pblk);
+    if(blksize<XMEM_CANARY_SIZE) return 0;
+
+    size=blksize-XMEM_CANARY_SIZE;
+    head=tail=XMEM_CANARY_WORD;
+    #if XMEM_CANARY_HEAD_ENABLE
+    head=*(u32*)(ptr-sizeof(u32));
+    #endif
+    #if XMEM_CANARY_ENABLE
+    size=*(u32*)(pblk+blksize-sizeof(u32));
+    //a size past the block means the count itself was overwritten
+    if(size>blksize-XMEM_CANARY_SIZE) tail=~XMEM_CANARY_WORD;
+    else memcpy(&tail,ptr+size,sizeof(u32));
+    #endif
+    if(head!=XMEM_CANARY_WORD||tail!=XMEM_CANARY_WORD)
+    {
+        xMemPrintf(xMemCanaryFailureFmt,ptr,size,head,tail);
+        xMemAssert(0);
+    }
+    return size;
+}
+#else
+#define XMEM_CANARY_HEAD_SIZE   0
+#define XMEM_CANARY_SIZE    0
+#endif
+
+static u8 xmem_init_flag=0;
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPoolInit
+ * DESCRIPTION
+ * Init Header List, Block List and Super Block Lists over the whole pool
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemPoolInit(void)
+{
+    #if XMEM_SUPERBLOCK_ENABLE && XMEM_SUPERBLOCK_RESERVE
+    int i;
+    #endif
+
+    #if XMEM_HEADER_PROTECT_ENABLE
+    xMemMgrHdrListInit();
+    #endif
+
+    xMemBlockListInit();
+    xMemFitRover=NULL;
+    #if XMEM_MAINT_ENABLE
+    xMemMaintCursor=NULL;
+    #endif
+    #if XMEM_USED_COUNT
+    xMemBlockUsed=0;
+    #endif
+    #if XMEM_FREE_INDEX
+    xMemFreeIndexBuild();
+    #endif
+
+    #if XMEM_SUPERBLOCK_ENABLE
+    xMemSuperBlockListInit();
+    #if XMEM_SUPERBLOCK_RESERVE
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++) xMemSuperBlockReserve(&xMemSuperBlockList[i],XMEM_SUPERBLOCK_RESERVE);
+    #endif
+    #endif
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemInit
+ * DESCRIPTION
+ * Init X-Memory Pool
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemInit(void)
+{
+    xMemPrintf("xMem Version: %s\n",XMEM_VER);
+    #if XMEM_POOL_FILE_ENABLE
+    //the pool is the file mapped by xMemFileOpen
+    xMemAssert(xMemPoolBase!=0);
+    #elif XMEM_POOL_SHARED_ENABLE
+    //the pool is the region mapped by xMemSharedOpen
+    xMemAssert(xMemPoolBase!=0);
+    #endif
+    xMemAssert(XMEM_POOL_END-XMEM_POOL_START>=XMEM_POOL_SIZE);
+    xMemAssert((XMEM_POOL_START%XMEM_ALIGN_SIZE)==0&&(XMEM_POOL_END%XMEM_ALIGN_SIZE)==0);
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    xMemAssert((XMEM_BLOCK_SIZE%XMEM_ALIGN_SIZE)==0);
+    #endif
+    #if defined(__MT7681)
+    __OS_Heap_Start += XMEM_POOL_SIZE;//reserve space for other using
+    #endif
+    #if XMEM_POOL_PREFAULT
+    xMemPoolTouch((void *)XMEM_POOL_START,XMEM_POOL_SIZE);
+    #endif
+
+    xMemPoolInit();
+
+    xmem_init_flag=1;    
+    return;
+}
+
+#if XMEM_PROFILE_ENABLE || XMEM_TUNE_ENABLE
+/***************************************************************************
+ * FUNCTION
+ * xMemFdWrite
+ * DESCRIPTION
+ * formatted write to a file without stdio, which might allocate
+ * PARAMETERS
+ * fd       [IN]    file descriptor
+ * fmt      [IN]    printf format
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemFdWrite(int fd,const char *fmt,...)
+{
+    char buf[128];
+    va_list ap;
+    int n;
+
+    va_start(ap,fmt);
+    n=vsnprintf(buf,sizeof(buf),fmt,ap);
+    va_end(ap);
+    if(n>=(int)sizeof(buf)) n=sizeof(buf)-1;
+    if(n>0&&write(fd,buf,n)<0) return;
+}
+#endif
+
+#if XMEM_PROFILE_ENABLE
+//frames of xMemProfileSample and xmalloc are not part of the profile
+#define XMEM_PROFILE_SKIP       2
+#define XMEM_PROFILE_IDLE       0x7FFFFFFF
+#define XMEM_PROFILE_HASH(p)    ((u32)(((uptr)(p)>>3)*2654435761u)&(XMEM_PROFILE_LIVE-1))
+
+typedef struct{
+    void * pc[XMEM_PROFILE_DEPTH];
+    u32 depth;          //0 if the bucket is empty
+    u32 hash;
+    u32 allocs;         //sampled allocations scaled to estimated objects and bytes
+    u32 inuse;
+    u64 allocbytes;
+    u64 inusebytes;
+}xMemProfileBucket;
+
+typedef struct{
+    void * ptr;         //NULL if the slot is empty
+    u32 bytes;          //estimated bytes the sample stands for
+    u16 objs;
+    u16 bucket;
+}xMemProfileLiveSample;
+
+static xMemProfileBucket xMemProfileBuckets[XMEM_PROFILE_BUCKETS];
+static xMemProfileLiveSample xMemProfileLiveTable[XMEM_PROFILE_LIVE];
+static s32 xMemProfileCountdown=XMEM_PROFILE_IDLE;
+static u32 xMemProfileInterval=0;
+static u32 xMemProfileLive=0;
+static u32 xMemProfileDropped=0;
+static u32 xMemProfileSeed=2463534242u;
+
+/***************************************************************************
+ * FUNCTION
+ * xMemProfileNext
+ * DESCRIPTION
+ * bytes until the next sample, uniform in 1..2*interval-1 so periodic
+ * allocation patterns are not sampled at the same phase
+ * PARAMETERS
+ * void
+ * RETURNS
+ * s32 bytes
+ * *************************************************************************/
+static s32 xMemProfileNext(void)
+{
+    xMemProfileSeed^=xMemProfileSeed<<13;
+    xMemProfileSeed^=xMemProfileSeed>>17;
+    xMemProfileSeed^=xMemProfileSeed<<5;
+    return 1+xMemProfileSeed%(2*xMemProfileInterval-1);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemProfileBucketGet
+ * DESCRIPTION
+ * find or add the bucket of a call stack
+ * PARAMETERS
+ * pc       [IN]    return addresses
+ * depth    [IN]    number of return addresses
+ * RETURNS
+ * int bucket, -1 if the bucket table is full
+ * *************************************************************************/
+static int xMemProfileBucketGet(void **pc,u32 depth)
+{
+    xMemProfileBucket * bkt;
+    u32 hash=0,i,n;
+
+    for(i=0;i<depth;i++) hash=(hash^(u32)(uptr)pc[i])*16777619u;
+
+    i=hash%XMEM_PROFILE_BUCKETS;
+    for(n=0;n<XMEM_PROFILE_BUCKETS;n++,i=(i+1)%XMEM_PROFILE_BUCKETS)
+    {
+        bkt=&xMemProfileBuckets[i];
+        if(bkt->depth==0)
+        {
+            memcpy(bkt->pc,pc,depth*sizeof(void*));
+            bkt->depth=depth;
+            bkt->hash=hash;
+            return i;
+        }
+        if(bkt->hash==hash&&bkt->depth==depth&&memcmp(bkt->pc,pc,depth*sizeof(void*))==0) return i;
+    }
+    return -1;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemProfileSample
+ * DESCRIPTION
+ * the byte countdown ran out, record the call stack of an allocation
+ * PARAMETERS
+ * ptr      [IN]    memory block address returned by xmalloc
+ * size     [IN]    block size that required
+ * RETURNS
+ * void
+ * *************************************************************************/
+static __attribute__((noinline)) void xMemProfileSample(void *ptr,u32 size)
+{
+    void * pc[XMEM_PROFILE_DEPTH+XMEM_PROFILE_SKIP];
+    xMemProfileBucket * bkt;
+    u32 bytes,objs,i;
+    int depth,b;
+
+    if(xMemProfileInterval==0)
+    {
+        xMemProfileCountdown=XMEM_PROFILE_IDLE;
+        return;
+    }
+    xMemProfileCountdown=xMemProfileNext();
+
+    if(xMemProfileLive>=XMEM_PROFILE_LIVE/2)
+    {
+        xMemProfileDropped++;
+        return;
+    }
+    depth=xMemBacktrace(pc,XMEM_PROFILE_DEPTH+XMEM_PROFILE_SKIP)-XMEM_PROFILE_SKIP;
+    b=depth>0?xMemProfileBucketGet(pc+XMEM_PROFILE_SKIP,depth):-1;
+    if(b<0)
+    {
+        xMemProfileDropped++;
+        return;
+    }
+
+    //a sample stands for the interval, a larger block stands for itself
+    bytes=size>xMemProfileInterval?size:xMemProfileInterval;
+    objs=size?bytes/size:1;
+    if(objs>0xFFFF) objs=0xFFFF;
+
+    bkt=&xMemProfileBuckets[b];
+    bkt->allocs+=objs;
+    bkt->allocbytes+=bytes;
+    bkt->inuse+=objs;
+    bkt->inusebytes+=bytes;
+
+    for(i=XMEM_PROFILE_HASH(ptr);xMemProfileLiveTable[i].ptr;i=(i+1)&(XMEM_PROFILE_LIVE-1));
+    xMemProfileLiveTable[i].ptr=ptr;
+    xMemProfileLiveTable[i].bytes=bytes;
+    xMemProfileLiveTable[i].objs=objs;
+    xMemProfileLiveTable[i].bucket=b;
+    xMemProfileLive++;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemProfileUnsample
+ * DESCRIPTION
+ * a block is freed, take it out of the live set if it was sampled
+ * PARAMETERS
+ * ptr      [IN]    memory block address
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemProfileUnsample(void *ptr)
+{
+    xMemProfileLiveSample * smp;
+    u32 i,j,k;
+
+    for(i=XMEM_PROFILE_HASH(ptr);xMemProfileLiveTable[i].ptr!=ptr;i=(i+1)&(XMEM_PROFILE_LIVE-1))
+    {
+        if(xMemProfileLiveTable[i].ptr==NULL) return;
+    }
+
+    smp=&xMemProfileLiveTable[i];
+    xMemProfileBuckets[smp->bucket].inuse-=smp->objs;
+    xMemProfileBuckets[smp->bucket].inusebytes-=smp->bytes;
+    xMemProfileLive--;
+
+    //shift the following entries back so no probe sequence is broken
+    for(j=(i+1)&(XMEM_PROFILE_LIVE-1);xMemProfileLiveTable[j].ptr;j=(j+1)&(XMEM_PROFILE_LIVE-1))
+    {
+        k=XMEM_PROFILE_HASH(xMemProfileLiveTable[j].ptr);
+        if(i<=j?(i<k&&k<=j):(i<k||k<=j)) continue;
+        xMemProfileLiveTable[i]=xMemProfileLiveTable[j];
+        i=j;
+    }
+    xMemProfileLiveTable[i].ptr=NULL;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemProfileClear
+ * DESCRIPTION
+ * forget all samples and call stacks
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemProfileClear(void)
+{
+    memset(xMemProfileBuckets,0,sizeof(xMemProfileBuckets));
+    memset(xMemProfileLiveTable,0,sizeof(xMemProfileLiveTable));
+    xMemProfileLive=0;
+    xMemProfileDropped=0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemProfileStart
+ * DESCRIPTION
+ * start a new profile, about one allocation every interval bytes is sampled
+ * PARAMETERS
+ * interval [IN]    mean bytes between samples, 0 stops sampling
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemProfileStart(size_t interval)
+{
+    void * pc[1];
+
+    //backtrace loads its unwinder on the first call, which allocates
+    xMemBacktrace(pc,1);
+
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemProfileClear();
+    xMemProfileInterval=interval>XMEM_POOL_SIZE?XMEM_POOL_SIZE:interval;
+    xMemProfileCountdown=xMemProfileInterval?xMemProfileNext():XMEM_PROFILE_IDLE;
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemProfileStop
+ * DESCRIPTION
+ * stop sampling, the live set is still updated by xfree and can be dumped
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemProfileStop(void)
+{
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemProfileInterval=0;
+    xMemProfileCountdown=XMEM_PROFILE_IDLE;
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemProfileDump
+ * DESCRIPTION
+ * write the live samples of each call stack in the legacy pprof heap
+ * profile format, followed by the memory map of the process
+ * PARAMETERS
+ * path     [IN]    file to write
+ * RETURNS
+ * int 0-success, -1-file can not be written
+ * *************************************************************************/
+int xMemProfileDump(const char *path)
+{
+    xMemProfileBucket * bkt;
+    u32 inuse=0,allocs=0,i,d;
+    u64 inusebytes=0,allocbytes=0;
+    char buf[512];
+    int fd,maps,n;
+
+    fd=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd<0) return -1;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    for(i=0;i<XMEM_PROFILE_BUCKETS;i++)
+    {
+        bkt=&xMemProfileBuckets[i];
+        inuse+=bkt->inuse;
+        inusebytes+=bkt->inusebytes;
+        allocs+=bkt->allocs;
+        allocbytes+=bkt->allocbytes;
+    }
+    xMemFdWrite(fd,"heap profile: %u: %llu [%u: %llu] @ heapprofile\n",inuse,inusebytes,allocs,allocbytes);
+    for(i=0;i<XMEM_PROFILE_BUCKETS;i++)
+    {
+        bkt=&xMemProfileBuckets[i];
+        if(bkt->depth==0) continue;
+        xMemFdWrite(fd,"%u: %llu [%u: %llu] @",bkt->inuse,bkt->inusebytes,bkt->allocs,bkt->allocbytes);
+        for(d=0;d<bkt->depth;d++) xMemFdWrite(fd," 0x%llx",(u64)(uptr)bkt->pc[d]);
+        xMemFdWrite(fd,"\n");
+    }
+    if(xMemProfileDropped) xMemFdWrite(fd,"# dropped samples: %u\n",xMemProfileDropped);
+    SYS_EXIT_CRITICAL_SECTION;
+
+    //pprof maps the addresses to symbols with the memory map
+    xMemFdWrite(fd,"\nMAPPED_LIBRARIES:\n");
+    maps=open("/proc/self/maps",O_RDONLY);
+    if(maps>=0)
+    {
+        while((n=read(maps,buf,sizeof(buf)))>0)
+        {
+            if(write(fd,buf,n)!=n) break;
+        }
+        close(maps);
+    }
+
+    close(fd);
+    return 0;
+}
+#endif
+
+#if XMEM_TUNE_ENABLE
+#if XMEM_SUPERBLOCK_ENABLE
+#define XMEM_TUNE_LISTED(size)  ((size)>(XMEM_META_BLOCK_SIZE<<(XMEM_SUPERBLOCK_LIST_COUNT-1)))
+#else
+#define XMEM_TUNE_LISTED(size)  1
+#endif
+#define XMEM_TUNE_LIST_MIN      4       //live blocks that make a 4th super block list pay off
+#define XMEM_TUNE_BALLANCE_MAX  (XMEM_META_BLOCK_SIZE*64)
+
+typedef struct{
+    u32 requests;       //requests of the sizes of the bucket
+    u32 live;           //allocated blocks of these sizes
+    u32 peak;           //largest live
+}xMemTuneBucket;
+
+static xMemTuneBucket xMemTuneBuckets[XMEM_TUNE_BUCKETS];
+static u32 xMemTuneListLive=0;      //live blocks with a header in the block list
+static u32 xMemTunePeakUsed=0;      //largest bytes of the pool in use, headers included
+static u32 xMemTuneFailed=0;
+
+/***************************************************************************
+ * FUNCTION
+ * xMemTuneBucketGet
+ * DESCRIPTION
+ * bucket of a block size, bucket i holds the sizes up to
+ * XMEM_META_BLOCK_SIZE<<i, so the first buckets are the super block lists
+ * PARAMETERS
+ * size     [IN]    block size, canaries included
+ * RETURNS
+ * u32 bucket
+ * *************************************************************************/
+static u32 xMemTuneBucketGet(u32 size)
+{
+    u32 i=0;
+
+    while(i<XMEM_TUNE_BUCKETS-1&&size>(XMEM_META_BLOCK_SIZE<<i)) i++;
+    return i;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemTuneAlloc
+ * DESCRIPTION
+ * count a request, and the block that was given for it. the live blocks
+ * are counted by the size of the block, the size xfree finds again
+ * PARAMETERS
+ * ptr      [IN]    block address, in front of the head canary, NULL if failed
+ * size     [IN]    size required, canaries included
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemTuneAlloc(void *ptr,u32 size)
+{
+    xMemTuneBucket * bkt;
+    u32 used;
+
+    xMemTuneBuckets[xMemTuneBucketGet(size)].requests++;
+    if(ptr==NULL)
+    {
+        xMemTuneFailed++;
+        return;
+    }
+
+    size=xMemBlockSizeGet(ptr);
+    bkt=&xMemTuneBuckets[xMemTuneBucketGet(size)];
+    if(++bkt->live>bkt->peak) bkt->peak=bkt->live;
+    if(XMEM_TUNE_LISTED(size)) xMemTuneListLive++;
+
+    used=xMemBlockUsed+xMemTuneListLive*XMEM_BLOCK_SIZE;
+    if(used>xMemTunePeakUsed) xMemTunePeakUsed=used;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemTuneFree
+ * DESCRIPTION
+ * take a block that is being freed off the live counts
+ * PARAMETERS
+ * ptr      [IN]    block address, in front of the head canary
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemTuneFree(void *ptr)
+{
+    xMemTuneBucket * bkt;
+    u32 size;
+
+    size=xMemBlockSizeGet(ptr);
+    if(size==0) return;
+
+    bkt=&xMemTuneBuckets[xMemTuneBucketGet(size)];
+    if(bkt->live) bkt->live--;
+    if(XMEM_TUNE_LISTED(size)&&xMemTuneListLive) xMemTuneListLive--;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemTuneDump
+ * DESCRIPTION
+ * write a config header for the requests counted so far. the first super
+ * block of each list holds the peak of its size, the 4th list is built
+ * when enough blocks of its size live at once, the ballance size is the
+ * smallest size asked for by 1% of the block list requests, so smaller
+ * remainders are not split off, and the pool is the peak in use plus a
+ * quarter. the histogram goes into a comment of the header
+ * PARAMETERS
+ * path     [IN]    header to write
+ * RETURNS
+ * int 0-success, -1-file can not be written
+ * *************************************************************************/
+int xMemTuneDump(const char *path)
+{
+    xMemTuneBucket bkt[XMEM_TUNE_BUCKETS];
+    u32 cnt[4],lists,ballance,pool,failed,requests=0,listreq=0,i;
+    int fd;
+
+    fd=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd<0) return -1;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    memcpy(bkt,xMemTuneBuckets,sizeof(bkt));
+    pool=xMemTunePeakUsed;
+    failed=xMemTuneFailed;
+    SYS_EXIT_CRITICAL_SECTION;
+
+    lists=bkt[3].peak>=XMEM_TUNE_LIST_MIN?4:3;
+    for(i=0;i<4;i++)
+    {
+        cnt[i]=bkt[i].peak;
+        if(cnt[i]<2) cnt[i]=2;
+        if(cnt[i]>XMEM_SUPERBLOCK_BLKS_MAX) cnt[i]=XMEM_SUPERBLOCK_BLKS_MAX;
+    }
+
+    for(i=0;i<XMEM_TUNE_BUCKETS;i++)
+    {
+        requests+=bkt[i].requests;
+        if(i>=lists) listreq+=bkt[i].requests;
+    }
+    ballance=XMEM_BALLANCE_SIZE;
+    for(i=lists;i<XMEM_TUNE_BUCKETS&&listreq;i++)
+    {
+        if((u64)bkt[i].requests*100>=listreq)
+        {
+            ballance=XMEM_META_BLOCK_SIZE<<(i-1);
+            break;
+        }
+    }
+    if(ballance>XMEM_TUNE_BALLANCE_MAX) ballance=XMEM_TUNE_BALLANCE_MAX;
+
+    pool+=pool/4;
+    pool=(pool+1023)/1024;
+    if(pool==0) pool=1;
+
+    xMemFdWrite(fd,"/* generated by xMemTuneDump from %u requests, build xmem with -include of this file */\n",requests);
+    xMemFdWrite(fd,"#ifndef __XCONFIG_TUNED_H__\n#define __XCONFIG_TUNED_H__\n\n");
+    xMemFdWrite(fd,"/*\n *       size   requests  peak live\n");
+    for(i=0;i<XMEM_TUNE_BUCKETS;i++)
+    {
+        if(bkt[i].requests==0&&bkt[i].peak==0) continue;
+        if(i==XMEM_TUNE_BUCKETS-1) xMemFdWrite(fd," * > %8u %10u %10u\n",XMEM_META_BLOCK_SIZE<<(i-1),bkt[i].requests,bkt[i].peak);
+        else xMemFdWrite(fd," * <=%8u %10u %10u\n",XMEM_META_BLOCK_SIZE<<i,bkt[i].requests,bkt[i].peak);
+    }
+    if(failed) xMemFdWrite(fd," *\n * %u requests failed, the pool was too small for the run\n",failed);
+    xMemFdWrite(fd," */\n\n");
+
+    xMemFdWrite(fd,"#define XMEM_POOL_SIZE    (1024*%u)\n",pool);
+    xMemFdWrite(fd,"#define XMEM_BALLANCE_SIZE    ((u32)%u)\n",ballance);
+    xMemFdWrite(fd,"#define XMEM_8META_ENABLE    %u\n",lists==4);
+    xMemFdWrite(fd,"#define XMEM_SUPERBLOCK_1META_CNT    ((u32)%u)\n",cnt[0]);
+    xMemFdWrite(fd,"#define XMEM_SUPERBLOCK_2META_CNT    ((u32)%u)\n",cnt[1]);
+    xMemFdWrite(fd,"#define XMEM_SUPERBLOCK_4META_CNT    ((u32)%u)\n",cnt[2]);
+    xMemFdWrite(fd,"#define XMEM_SUPERBLOCK_8META_CNT    ((u32)%u)\n",cnt[3]);
+    xMemFdWrite(fd,"\n#endif // __XCONFIG_TUNED_H__\n");
+
+    close(fd);
+    return 0;
+}
+#endif
+
+#if XMEM_HANDLE_ENABLE || XMEM_TAG_ENABLE
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockHeaderGet
+ * DESCRIPTION
+ * get the header of a memory block
+ * PARAMETERS
+ * ptr      [IN]    block address
+ * RETURNS
+ * pxMemBlock block header
+ * *************************************************************************/
+static pxMemBlock xMemBlockHeaderGet(void *ptr)
+{
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    return (pxMemBlock)(ptr-XMEM_BLOCK_SIZE);
+    #else
+    pxMemBlock blk;
+
+    for(blk=xMemBlkList;blk;blk=blk->next)
+    {
+        if(blk->addr==ptr) return blk;
+    }
+    return NULL;
+    #endif
+}
+#endif
+
+#if XMEM_PRESSURE_ENABLE
+typedef struct{
+    xMemPressureFunc func;
+    void * arg;
+}xMemPressureEntry;
+
+static xMemPressureEntry xMemPressureTable[XMEM_PRESSURE_MAX];
+static u32 xMemPressureCount=0;
+static u32 xMemPressureWatermark=0;
+static u8 xMemPressureArmed=1;      //the low watermark is heard once each time it is crossed
+static u8 xMemPressureBusy=0;       //callbacks are running, their own requests do not call them again
+static u8 xMemPressureFailed=0;     //the last request failed after the callbacks ran
+
+#if XMEM_SUPERBLOCK_ENABLE && XMEM_CACHE_ENABLE
+static u32 xMemCacheReclaim(void);
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPressureCheck
+ * DESCRIPTION
+ * level of pressure an allocation left behind, must be called inside
+ * SYS_ENTER_CRITICAL_SECTION
+ * PARAMETERS
+ * ptr      [IN]    result of the allocation
+ * RETURNS
+ * u8 XMEM_PRESSURE_NONE if the callbacks need not be called
+ * *************************************************************************/
+static u8 xMemPressureCheck(void *ptr)
+{
+    if(xMemPressureBusy) return XMEM_PRESSURE_NONE;
+    if(ptr==NULL) return XMEM_PRESSURE_OOM;
+
+    xMemPressureFailed=0;
+    if(xMemBlockUsed+xMemPressureWatermark<=XMEM_POOL_SIZE)
+    {
+        xMemPressureArmed=1;
+        return XMEM_PRESSURE_NONE;
+    }
+    if(!xMemPressureArmed) return XMEM_PRESSURE_NONE;
+    xMemPressureArmed=0;
+    return XMEM_PRESSURE_LOW;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPressureRetry
+ * DESCRIPTION
+ * make a failed request again after memory was released
+ * PARAMETERS
+ * size     [IN]    size of the request
+ * tag      [IN]    tag of the request, 0 for xmalloc
+ * RETURNS
+ * void * memory block address, NULL if failed
+ * *************************************************************************/
+static void * xMemPressureRetry(size_t size,u32 tag)
+{
+    #if XMEM_TAG_ENABLE
+    if(tag) return xmalloc_tag(size,tag);
+    #else
+    (void)tag;
+    #endif
+    return xmalloc(size);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPressureRaise
+ * DESCRIPTION
+ * tell the callbacks about the pressure, called outside the critical
+ * section. when a request failed, the empty cache slabs are released and
+ * the callbacks are called in the order they were registered until the
+ * request can be satisfied
+ * PARAMETERS
+ * level    [IN]    XMEM_PRESSURE_LOW or XMEM_PRESSURE_OOM
+ * size     [IN]    size of the request
+ * tag      [IN]    tag of the request, 0 for xmalloc
+ * RETURNS
+ * void * memory block for a failed request, NULL if still failed
+ * *************************************************************************/
+static void * xMemPressureRaise(u8 level,size_t size,u32 tag)
+{
+    xMemPressureEntry table[XMEM_PRESSURE_MAX];
+    u32 i,n,released=0;
+    void * ptr=NULL;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    if(xMemPressureBusy)
+    {
+        SYS_EXIT_CRITICAL_SECTION;
+        return NULL;
+    }
+    xMemPressureBusy=1;
+    if(level==XMEM_PRESSURE_OOM)
+    {
+        #if XMEM_SUPERBLOCK_ENABLE
+        released=xMemSuperBlockReclaim();
+        #endif
+        #if XMEM_SUPERBLOCK_ENABLE && XMEM_CACHE_ENABLE
+        released+=xMemCacheReclaim();
+        #endif
+    }
+    //callbacks may unregister themselves while they run
+    n=xMemPressureCount;
+    memcpy(table,xMemPressureTable,n*sizeof(xMemPressureEntry));
+    SYS_EXIT_CRITICAL_SECTION;
+
+    if(level==XMEM_PRESSURE_LOW)
+    {
+        for(i=0;i<n;i++) table[i].func(XMEM_PRESSURE_LOW,size,table[i].arg);
+    }
+    else
+    {
+        if(released) ptr=xMemPressureRetry(size,tag);
+        for(i=0;ptr==NULL&&i<n;i++)
+        {
+            if(table[i].func(XMEM_PRESSURE_OOM,size,table[i].arg)) ptr=xMemPressureRetry(size,tag);
+        }
+    }
+
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemPressureBusy=0;
+    if(level==XMEM_PRESSURE_OOM) xMemPressureFailed=ptr==NULL;
+    SYS_EXIT_CRITICAL_SECTION;
+    return ptr;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPressureRegister
+ * DESCRIPTION
+ * add a callback that sheds memory under pressure. it is called with
+ * XMEM_PRESSURE_LOW when the free space falls below the watermark, and
+ * with XMEM_PRESSURE_OOM before xmalloc fails, xmalloc retries if it
+ * returns non-zero
+ * PARAMETERS
+ * func     [IN]    callback
+ * arg      [IN]    passed to func
+ * RETURNS
+ * int 0-success, -1-table is full
+ * *************************************************************************/
+int xMemPressureRegister(xMemPressureFunc func,void *arg)
+{
+    int ret=-1;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    if(func&&xMemPressureCount<XMEM_PRESSURE_MAX)
+    {
+        xMemPressureTable[xMemPressureCount].func=func;
+        xMemPressureTable[xMemPressureCount].arg=arg;
+        xMemPressureCount++;
+        ret=0;
+    }
+    SYS_EXIT_CRITICAL_SECTION;
+    return ret;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPressureUnregister
+ * DESCRIPTION
+ * remove a callback added by xMemPressureRegister
+ * PARAMETERS
+ * func     [IN]    callback
+ * arg      [IN]    the arg it was registered with
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemPressureUnregister(xMemPressureFunc func,void *arg)
+{
+    u32 i;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    for(i=0;i<xMemPressureCount;i++)
+    {
+        if(xMemPressureTable[i].func==func&&xMemPressureTable[i].arg==arg)
+        {
+            //keep the order, it is the order callbacks are asked to shed memory
+            memmove(&xMemPressureTable[i],&xMemPressureTable[i+1],(xMemPressureCount-i-1)*sizeof(xMemPressureEntry));
+            xMemPressureCount--;
+            break;
+        }
+    }
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPressureWatermarkSet
+ * DESCRIPTION
+ * free space of the block list below which XMEM_PRESSURE_LOW is raised
+ * PARAMETERS
+ * freebytes    [IN]    watermark, 0 to never raise XMEM_PRESSURE_LOW
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemPressureWatermarkSet(size_t freebytes)
+{
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemPressureWatermark=freebytes>XMEM_POOL_SIZE?XMEM_POOL_SIZE:freebytes;
+    xMemPressureArmed=1;
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPressureLevel
+ * DESCRIPTION
+ * current pressure on the pool
+ * PARAMETERS
+ * void
+ * RETURNS
+ * int XMEM_PRESSURE_OOM if the last request failed, XMEM_PRESSURE_LOW if
+ * the free space is below the watermark, otherwise XMEM_PRESSURE_NONE
+ * *************************************************************************/
+int xMemPressureLevel(void)
+{
+    int level;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    if(xMemPressureFailed) level=XMEM_PRESSURE_OOM;
+    else if(xMemBlockUsed+xMemPressureWatermark>XMEM_POOL_SIZE) level=XMEM_PRESSURE_LOW;
+    else level=XMEM_PRESSURE_NONE;
+    SYS_EXIT_CRITICAL_SECTION;
+    return level;
+}
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xmalloc
+ * DESCRIPTION
+ * allocate a memory block
+ * PARAMETERS
+ * size     [IN]    block size that required
+ * RETURNS
+ * void * memory block address
+ * *************************************************************************/
+void * xmalloc(size_t size)
+{
+    void * ptr;
+    #if XMEM_PRESSURE_ENABLE
+    u8 level;
+    #endif
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    if(!xmem_init_flag){
+        xMemInit();
+    }
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    xMemHeapCheck();
+    #endif
+
+    //larger than the pool, also keeps the u32 block sizes from wrapping
+    if(size>XMEM_POOL_SIZE)
+    {
+        SYS_EXIT_CRITICAL_SECTION;
+        return NULL;
+    }
+    size+=XMEM_CANARY_SIZE;
+
+    #if XMEM_SUPERBLOCK_ENABLE
+    #if XMEM_8META_ENABLE
+    if(size<=XMEM_8META_BLOCK_SIZE)
+    #else
+    if(size<=XMEM_4META_BLOCK_SIZE)
+    #endif
+    {
+        ptr=xMallocMetaBlockAlloc(size);
+    }else{
+    #endif
+        ptr=xMemBlockAlloc(size);
+    #if XMEM_SUPERBLOCK_ENABLE
+    }
+    #endif
+
+    #if XMEM_TUNE_ENABLE
+    xMemTuneAlloc(ptr,size);
+    #endif
+
+    #if XMEM_CANARY_ENABLE || XMEM_CANARY_HEAD_ENABLE
+    if(ptr) ptr=xMemCanarySet(ptr,size-XMEM_CANARY_SIZE);
+    #endif
+
+    #if XMEM_PROFILE_ENABLE
+    if(ptr&&(xMemProfileCountdown-=(s32)size)<0) xMemProfileSample(ptr,size);
+    #endif
+
+    #if XMEM_PRESSURE_ENABLE
+    level=xMemPressureCheck(ptr);
+    SYS_EXIT_CRITICAL_SECTION;
+    //callbacks run outside the critical section, they free and may allocate
+    if(level==XMEM_PRESSURE_OOM) return xMemPressureRaise(level,size-XMEM_CANARY_SIZE,0);
+    if(level==XMEM_PRESSURE_LOW) xMemPressureRaise(level,size-XMEM_CANARY_SIZE,0);
+    return ptr;
+    #else
+    SYS_EXIT_CRITICAL_SECTION;
+    return ptr;
+    #endif
+}
+
+#if XMEM_TAG_ENABLE
+/***************************************************************************
+ * FUNCTION
+ * xMemTagGet
+ * DESCRIPTION
+ * tag of a memory block, super block slots are never tagged
+ * PARAMETERS
+ * ptr      [IN]    block address, in front of the head canary
+ * RETURNS
+ * u8 tag, 0 if untagged
+ * *************************************************************************/
+static u8 xMemTagGet(void *ptr)
+{
+    pxMemBlock blk;
+
+    #if XMEM_SIZE_MAP
+    if(xMemSizeMapGet(ptr)) return 0;
+    #elif XMEM_SUPERBLOCK_ENABLE
+    if(xMemSuperBlockFind(ptr)) return 0;
+    #endif
+    blk=xMemBlockHeaderGet(ptr);
+    return blk?XMEM_BLOCK_TAG(blk):0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xmalloc_tag
+ * DESCRIPTION
+ * allocate a memory block counted to a tag, the block always comes from
+ * the block list because super block slots have no header for the tag
+ * PARAMETERS
+ * size     [IN]    block size that required
+ * tag      [IN]    1..XMEM_TAG_MAX-1, 0 for an untagged xmalloc
+ * RETURNS
+ * void * memory block address, NULL if failed or over the tag's quota
+ * *************************************************************************/
+void * xmalloc_tag(size_t size,unsigned int tag)
+{
+    xMemTagInfo * info;
+    pxMemBlock blk;
+    void * ptr=NULL;
+    #if XMEM_PRESSURE_ENABLE
+    u8 level=XMEM_PRESSURE_NONE;
+    #endif
+
+    if(tag==0) return xmalloc(size);
+    if(tag>=XMEM_TAG_MAX) return NULL;
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    if(!xmem_init_flag){
+        xMemInit();
+    }
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    xMemHeapCheck();
+    #endif
+
+    info=&xMemTagTable[tag];
+    if(size<=XMEM_POOL_SIZE&&(!info->quota||info->bytes+size<=info->quota))
+    {
+        size+=XMEM_CANARY_SIZE;
+        ptr=xMemBlockAlloc(size);
+        #if XMEM_PRESSURE_ENABLE
+        //a request the quota turns down is not pressure on the pool
+        if(ptr==NULL) level=xMemPressureCheck(ptr);
+        #endif
+    }
+    if(ptr)
+    {
+        blk=xMemBlockHeaderGet(ptr);
+        //the block may be larger than asked for, the quota holds for what the pool gives
+        if(info->quota&&info->bytes+blk->blksize>info->quota)
+        {
+            xMemBlockFree(ptr);
+            ptr=NULL;
+        }
+        else
+        {
+            XMEM_BLOCK_TAG(blk)=tag;
+            info->bytes+=blk->blksize;
+            info->count++;
+            if(info->bytes>info->peak) info->peak=info->bytes;
+            #if XMEM_PRESSURE_ENABLE
+            //only a block that stays may raise LOW, a rolled back one leaves it armed
+            level=xMemPressureCheck(ptr);
+            #endif
+        }
+    }
+    if(ptr==NULL)
+    {
+        #if XMEM_PRESSURE_ENABLE
+        if(level==XMEM_PRESSURE_OOM)
+        {
+            SYS_EXIT_CRITICAL_SECTION;
+            //the request is made again under the same tag once the callbacks released memory
+            return xMemPressureRaise(level,size-XMEM_CANARY_SIZE,tag);
+        }
+        #endif
+        info->failed++;
+        SYS_EXIT_CRITICAL_SECTION;
+        return NULL;
+    }
+
+    #if XMEM_TUNE_ENABLE
+    xMemTuneAlloc(ptr,size);
+    #endif
+
+    #if XMEM_CANARY_ENABLE || XMEM_CANARY_HEAD_ENABLE
+    ptr=xMemCanarySet(ptr,size-XMEM_CANARY_SIZE);
+    #endif
+
+    #if XMEM_PROFILE_ENABLE
+    if((xMemProfileCountdown-=(s32)size)<0) xMemProfileSample(ptr,size);
+    #endif
+
+    SYS_EXIT_CRITICAL_SECTION;
+    #if XMEM_PRESSURE_ENABLE
+    if(level==XMEM_PRESSURE_LOW) xMemPressureRaise(level,size-XMEM_CANARY_SIZE,tag);
+    #endif
+    return ptr;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemTagQuotaSet
+ * DESCRIPTION
+ * limit the bytes a tag may hold, blocks it already holds are kept
+ * PARAMETERS
+ * tag      [IN]    1..XMEM_TAG_MAX-1
+ * quota    [IN]    bytes, 0 for no limit
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemTagQuotaSet(unsigned int tag,size_t quota)
+{
+    if(tag==0||tag>=XMEM_TAG_MAX) return;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemTagTable[tag].quota=quota>XMEM_POOL_SIZE?XMEM_POOL_SIZE:quota;
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemTagInfoGet
+ * DESCRIPTION
+ * bytes and blocks a tag holds
+ * PARAMETERS
+ * tag      [IN]    1..XMEM_TAG_MAX-1
+ * info     [OUT]   usage of the tag
+ * RETURNS
+ * int 0-success, -1-no such tag
+ * *************************************************************************/
+int xMemTagInfoGet(unsigned int tag,xMemTagInfo *info)
+{
+    if(tag==0||tag>=XMEM_TAG_MAX) return -1;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    *info=xMemTagTable[tag];
+    SYS_EXIT_CRITICAL_SECTION;
+    return 0;
+}
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemFree
+ * DESCRIPTION
+ * free a memory block, inside SYS_ENTER_CRITICAL_SECTION
+ * PARAMETERS
+ * void *       [IN]    memory block pointer
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemFree(void *ptr)
+{
+    #if XMEM_SIZE_MAP
+    u32 slotsize;
+    #endif
+
+    #if XMEM_PROFILE_ENABLE
+    if(xMemProfileLive&&ptr) xMemProfileUnsample(ptr);
+    #endif
+
+    #if XMEM_CANARY_ENABLE || XMEM_CANARY_HEAD_ENABLE
+    if(ptr)
+    {
+        xMemCanaryCheck(ptr);
+        ptr-=XMEM_CANARY_HEAD_SIZE;
+    }
+    #endif
+
+    #if XMEM_TUNE_ENABLE
+    if(ptr) xMemTuneFree(ptr);
+    #endif
+
+    #if XMEM_SIZE_MAP
+    slotsize=ptr?xMemSizeMapGet(ptr):0;
+    if(slotsize?
+        xMemMetaBlockListFree(&xMemSuperBlockList[xMemMetaClassGet(slotsize)],ptr):
+        ptr&&xMemBlockFree(ptr))
+    #else
+    if(
+        #if XMEM_SUPERBLOCK_ENABLE
+        xMemMetaBlockFree(ptr)&&
+        #endif
+        xMemBlockFree(ptr))
+    #endif
+    {//Meta block first, then common block, avoid super block start addr equals common block start addr
+
+        xMemPrintf("prt:%p\n",ptr);
+        #if XMEM_SUPERBLOCK_ENABLE
+        xMemSuperBlockInfoDump();
+        #endif
+    }
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xfree
+ * DESCRIPTION
+ * free a memory block
+ * PARAMETERS
+ * void *       [IN]    memory block pointer
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xfree(void *ptr)
+{
+    SYS_ENTER_CRITICAL_SECTION;
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    xMemHeapCheck();
+    #endif
+
+    xMemFree(ptr);
+
+    SYS_EXIT_CRITICAL_SECTION;
+    return;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xfree_batch
+ * DESCRIPTION
+ * free a number of memory blocks under one lock
+ * PARAMETERS
+ * ptrs     [IN]    memory block pointers, NULL entries are skipped
+ * n        [IN]    number of pointers
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xfree_batch(void **ptrs,unsigned int n)
+{
+    unsigned int i;
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    xMemHeapCheck();
+    #endif
+
+    for(i=0;i<n;i++) xMemFree(ptrs[i]);
+
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xrealloc
+ * DESCRIPTION
+ * change the size of a memory block, content is kept up to the smaller
+ * of the old and new sizes
+ * PARAMETERS
+ * ptr      [IN]    memory block pointer, NULL to allocate a new block
+ * size     [IN]    block size that required, 0 to free the block
+ * RETURNS
+ * void * memory block address, NULL if failed and ptr is kept
+ * *************************************************************************/
+void * xrealloc(void *ptr,size_t size)
+{
+    void * pnew;
+    u32 oldsize;
+    #if XMEM_TAG_ENABLE
+    u8 tag;
+    #endif
+
+    if(ptr==NULL) return xmalloc(size);
+    if(size==0)
+    {
+        xfree(ptr);
+        return NULL;
+    }
+
+    SYS_ENTER_CRITICAL_SECTION;
+    #if XMEM_CANARY_ENABLE || XMEM_CANARY_HEAD_ENABLE
+    oldsize=xMemCanaryCheck(ptr);
+    #else
+    oldsize=xMemBlockSizeGet(ptr);
+    #endif
+    #if XMEM_CANARY_ENABLE
+    //the block has room past the size asked for, the tail canary moves to the new size
+    if(oldsize&&size<=xMemBlockSizeGet(ptr-XMEM_CANARY_HEAD_SIZE)-XMEM_CANARY_SIZE)
+    {
+        xMemCanarySet(ptr-XMEM_CANARY_HEAD_SIZE,size);
+        SYS_EXIT_CRITICAL_SECTION;
+        return ptr;
+    }
+    #endif
+    #if XMEM_TAG_ENABLE
+    tag=xMemTagGet(ptr-XMEM_CANARY_HEAD_SIZE);
+    #endif
+    SYS_EXIT_CRITICAL_SECTION;
+
+    //not a block of the pool, there is nothing to move or free
+    if(oldsize==0) return NULL;
+
+    //still fit in the block that owned
+    if(size<=oldsize) return ptr;
+
+    #if XMEM_TAG_ENABLE
+    //the new block is counted to the tag of the old one
+    pnew=xmalloc_tag(size,tag);
+    #else
+    pnew=xmalloc(size);
+    #endif
+    if(pnew)
+    {
+        memcpy(pnew,ptr,oldsize);
+        xfree(ptr);
+    }
+    return pnew;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xfree_sized
+ * DESCRIPTION
+ * free a memory block whose size is known, only the super block list of
+ * that size is searched, larger blocks skip the super blocks
+ * PARAMETERS
+ * ptr      [IN]    memory block pointer
+ * size     [IN]    size that was passed to xmalloc
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xfree_sized(void *ptr,size_t size)
+{
+    u8 ret;
+    #if XMEM_SUPERBLOCK_ENABLE
+    int i;
+    #endif
+
+    if(ptr==NULL) return;
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    xMemHeapCheck();
+    #endif
+
+    #if XMEM_PROFILE_ENABLE
+    if(xMemProfileLive) xMemProfileUnsample(ptr);
+    #endif
+
+    #if XMEM_CANARY_ENABLE || XMEM_CANARY_HEAD_ENABLE
+    xMemCanaryCheck(ptr);
+    ptr-=XMEM_CANARY_HEAD_SIZE;
+    #endif
+
+    #if XMEM_TUNE_ENABLE
+    xMemTuneFree(ptr);
+    #endif
+
+    #if XMEM_SUPERBLOCK_ENABLE
+    i=xMemMetaClassGet(size+XMEM_CANARY_SIZE);
+    if(i>=0) ret=xMemMetaBlockListFree(&xMemSuperBlockList[i],ptr);
+    else ret=xMemBlockFree(ptr);
+    //size does not match, take the way xfree does
+    if(ret) ret=xMemMetaBlockFree(ptr)&&xMemBlockFree(ptr);
+    #else
+    (void)size;
+    ret=xMemBlockFree(ptr);
+    #endif
+
+    if(ret)
+    {
+        xMemPrintf("prt:%p\n",ptr);
+    }
+
+    SYS_EXIT_CRITICAL_SECTION;
+    return;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xmalloc_aligned
+ * DESCRIPTION
+ * allocate a memory block with an alignment stronger than XMEM_ALIGN_SIZE,
+ * the offset to the real block is kept in the word in front of it
+ * PARAMETERS
+ * size     [IN]    block size that required
+ * align    [IN]    alignment, power of 2
+ * RETURNS
+ * void * memory block address, free it with xfree_aligned_sized
+ * *************************************************************************/
+void * xmalloc_aligned(size_t size,size_t align)
+{
+    void * raw;
+    void * ptr;
+
+    if(align<=XMEM_ALIGN_SIZE) return xmalloc(size);
+    if(align&(align-1)) return NULL;
+    //size+align must not wrap past the pool size check of xmalloc
+    if(size>XMEM_POOL_SIZE||size>(size_t)-1-align) return NULL;
+
+    raw=xmalloc(size+align);
+    if(raw==NULL) return NULL;
+
+    //raw is at least 4 bytes aligned, so there is room for the offset word
+    ptr=(void *)(((uptr)raw+sizeof(u32)+align-1)&~(uptr)(align-1));
+    *(u32 *)(ptr-sizeof(u32))=(u32)(ptr-raw);
+    return ptr;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xfree_aligned_sized
+ * DESCRIPTION
+ * free a memory block from xmalloc_aligned
+ * PARAMETERS
+ * ptr      [IN]    memory block pointer
+ * size     [IN]    size that was passed to xmalloc_aligned
+ * align    [IN]    alignment that was passed to xmalloc_aligned
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xfree_aligned_sized(void *ptr,size_t size,size_t align)
+{
+    if(ptr==NULL) return;
+    if(align<=XMEM_ALIGN_SIZE)
+    {
+        xfree_sized(ptr,size);
+        return;
+    }
+    xfree_sized(ptr-*(u32 *)(ptr-sizeof(u32)),size+align);
+}
+
+#if XMEM_EPOCH_ENABLE
+#define XMEM_EPOCH_ACTIVE   1           //low bit of a slot state, the epoch is above it
+#define XMEM_EPOCH_WRAP     ((u32)3<<29)    //a multiple of 3, the retire lists stay in step
+
+typedef struct{
+    u32 state;          //epoch<<1|XMEM_EPOCH_ACTIVE while the thread reads, 0 outside
+    u32 owner;          //1 while a read section holds the slot
+}XMEM_ATTR_ALIGNED_CACHE xMemEpochSlot;
+
+static xMemEpochSlot xMemEpochSlots[XMEM_EPOCH_THREADS];
+typedef struct t_xMemEpochChunk{
+    struct t_xMemEpochChunk * next;
+    u32 count;
+    void * ptrs[XMEM_EPOCH_RETIRE_MAX];
+}xMemEpochChunk;
+
+static u32 xMemEpochGlobal=0;
+//blocks retired in each of the last 3 epochs, kept under SYS_ENTER_CRITICAL_SECTION
+static xMemEpochChunk xMemEpochRetired[3];
+static u32 xMemEpochRetiredCount[3];
+static __thread xMemEpochSlot * xMemEpochSelf;     //slot of the read section the thread is in
+static __thread u32 xMemEpochNest;                  //xMemEpochEnter calls not exited
+static __thread u32 xMemEpochHint;                  //slot the thread had last time
+
+/***************************************************************************
+ * FUNCTION
+ * xMemEpochSlotGet
+ * DESCRIPTION
+ * take a free slot for a read section. the slot the thread had last time
+ * is tried first, so a thread keeps to its own cache line
+ * PARAMETERS
+ * void
+ * RETURNS
+ * xMemEpochSlot * slot, waits while XMEM_EPOCH_THREADS read sections run
+ * *************************************************************************/
+static xMemEpochSlot * xMemEpochSlotGet(void)
+{
+    u32 i,n,free;
+
+    for(;;)
+    {
+        for(n=0;n<XMEM_EPOCH_THREADS;n++)
+        {
+            i=(xMemEpochHint+n)%XMEM_EPOCH_THREADS;
+            if(__atomic_load_n(&xMemEpochSlots[i].owner,__ATOMIC_RELAXED)) continue;
+            free=0;
+            if(__atomic_compare_exchange_n(&xMemEpochSlots[i].owner,&free,1,0,__ATOMIC_ACQUIRE,__ATOMIC_RELAXED))
+            {
+                xMemEpochHint=i;
+                return &xMemEpochSlots[i];
+            }
+        }
+        //every slot is in a read section, they end without taking a lock
+        sched_yield();
+    }
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemEpochEnter
+ * DESCRIPTION
+ * start reading a lock-free structure, blocks retired from now on are not
+ * freed until xMemEpochExit. calls nest
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemEpochEnter(void)
+{
+    xMemEpochSlot * slot;
+    u32 epoch;
+
+    if(xMemEpochNest++) return;
+    slot=xMemEpochSelf=xMemEpochSlotGet();
+
+    epoch=__atomic_load_n(&xMemEpochGlobal,__ATOMIC_RELAXED);
+    __atomic_store_n(&slot->state,epoch<<1|XMEM_EPOCH_ACTIVE,__ATOMIC_RELAXED);
+    //the reads of the structure come after the state is seen, pairs with xMemEpochAdvance
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemEpochExit
+ * DESCRIPTION
+ * stop reading, pointers read since xMemEpochEnter must not be used again.
+ * the last exit gives the slot back
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemEpochExit(void)
+{
+    xMemEpochSlot * slot=xMemEpochSelf;
+
+    if(xMemEpochNest==0||--xMemEpochNest) return;
+    xMemEpochSelf=NULL;
+    __atomic_store_n(&slot->state,0,__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->owner,0,__ATOMIC_RELEASE);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemEpochAdvance
+ * DESCRIPTION
+ * move to the next epoch if every reader is in the current one, the
+ * blocks retired two epochs ago can not be seen any more and are freed.
+ * inside SYS_ENTER_CRITICAL_SECTION
+ * PARAMETERS
+ * void
+ * RETURNS
+ * u32 number of blocks freed, 0 also if a reader holds the epoch
+ * *************************************************************************/
+static u32 xMemEpochAdvance(void)
+{
+    xMemEpochChunk * chunk,*chunknext;
+    u32 epoch,state,i,n;
+
+    epoch=__atomic_load_n(&xMemEpochGlobal,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for(i=0;i<XMEM_EPOCH_THREADS;i++)
+    {
+        state=__atomic_load_n(&xMemEpochSlots[i].state,__ATOMIC_ACQUIRE);
+        if((state&XMEM_EPOCH_ACTIVE)&&(state>>1)!=epoch) return 0;
+    }
+    epoch=(epoch+1)%XMEM_EPOCH_WRAP;
+    __atomic_store_n(&xMemEpochGlobal,epoch,__ATOMIC_RELEASE);
+
+    //epoch-2 uses the same list as epoch+1
+    chunk=&xMemEpochRetired[(epoch+1)%3];
+    n=xMemEpochRetiredCount[(epoch+1)%3];
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    if(n) xMemHeapCheck();
+    #endif
+    for(i=0;i<chunk->count;i++) xMemFree(chunk->ptrs[i]);
+    for(chunknext=chunk->next;chunknext;)
+    {
+        chunk=chunknext;
+        chunknext=chunk->next;
+        for(i=0;i<chunk->count;i++) xMemFree(chunk->ptrs[i]);
+        xMemBlockFree(chunk);
+    }
+    xMemEpochRetired[(epoch+1)%3].next=NULL;
+    xMemEpochRetired[(epoch+1)%3].count=0;
+    xMemEpochRetiredCount[(epoch+1)%3]=0;
+    return n;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xfree_deferred
+ * DESCRIPTION
+ * free a block once the readers that might still see it have left, the
+ * block must already be unreachable for new readers. it may be called
+ * between xMemEpochEnter and xMemEpochExit
+ * PARAMETERS
+ * ptr      [IN]    memory block pointer
+ * RETURNS
+ * int 0 if the block is retired, -1 if the pool has no room for the retire
+ * list and the caller is in a read section, which may hold the epoch itself.
+ * the block is then still the caller's
+ * *************************************************************************/
+int xfree_deferred(void *ptr)
+{
+    xMemEpochChunk * chunk,*chunknew;
+    u32 i;
+
+    if(ptr==NULL) return 0;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    i=__atomic_load_n(&xMemEpochGlobal,__ATOMIC_RELAXED)%3;
+    if(xMemEpochRetiredCount[i]>=XMEM_EPOCH_BATCH)
+    {
+        xMemEpochAdvance();
+        i=__atomic_load_n(&xMemEpochGlobal,__ATOMIC_RELAXED)%3;
+    }
+
+    chunk=&xMemEpochRetired[i];
+    while(chunk->count>=XMEM_EPOCH_RETIRE_MAX)
+    {
+        //the full blocks move to a chunk behind the first one
+        chunknew=(xMemEpochChunk *)xMemBlockAlloc(sizeof(xMemEpochChunk));
+        if(chunknew)
+        {
+            memcpy(chunknew,chunk,sizeof(xMemEpochChunk));
+            chunk->next=chunknew;
+            chunk->count=0;
+            break;
+        }
+        //out of memory, only the readers can help. a reader would wait for itself
+        xMemEpochAdvance();
+        if(__atomic_load_n(&xMemEpochGlobal,__ATOMIC_RELAXED)%3==i)
+        {
+            SYS_EXIT_CRITICAL_SECTION;
+            if(xMemEpochNest) return -1;
+            sched_yield();
+            SYS_ENTER_CRITICAL_SECTION;
+        }
+        i=__atomic_load_n(&xMemEpochGlobal,__ATOMIC_RELAXED)%3;
+        chunk=&xMemEpochRetired[i];
+    }
+    chunk->ptrs[chunk->count++]=ptr;
+    xMemEpochRetiredCount[i]++;
+    SYS_EXIT_CRITICAL_SECTION;
+    return 0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemEpochReclaim
+ * DESCRIPTION
+ * free what the readers allow now, without waiting. with no reader
+ * running every retired block is freed
+ * PARAMETERS
+ * void
+ * RETURNS
+ * unsigned int number of blocks freed
+ * *************************************************************************/
+unsigned int xMemEpochReclaim(void)
+{
+    u32 i,n=0;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    //three moves take every list through the free
+    for(i=0;i<3;i++) n+=xMemEpochAdvance();
+    SYS_EXIT_CRITICAL_SECTION;
+    return n;
+}
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xmalloc_usable_size
+ * DESCRIPTION
+ * get the number of bytes that can be used in a memory block, it might be
+ * more than the size required. with XMEM_CANARY_ENABLE it is the size required,
+ * the tail canary follows it. a header read when XMEM_SIZE_MAP_ENABLE is set
+ * and XMEM_POOL_OPPOSITE is 0, otherwise the block is searched
+ * PARAMETERS
+ * ptr      [IN]    memory block pointer
+ * RETURNS
+ * size_t usable size, 0 if ptr is NULL or not an allocated block
+ * *************************************************************************/
+size_t xmalloc_usable_size(void *ptr)
+{
+    u32 size;
+
+    if(ptr==NULL) return 0;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    #if XMEM_CANARY_ENABLE || XMEM_CANARY_HEAD_ENABLE
+    size=xMemCanaryCheck(ptr);
+    #else
+    size=xMemBlockSizeGet(ptr);
+    #endif
+    SYS_EXIT_CRITICAL_SECTION;
+
+    return size;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xmalloc_good_size
+ * DESCRIPTION
+ * get the size that xmalloc would really give for a request, growing a
+ * buffer to it costs no more memory
+ * PARAMETERS
+ * size     [IN]    block size that required
+ * RETURNS
+ * size_t usable size of a block allocated for size, size itself if it can not be allocated
+ * or a tail canary follows it
+ * *************************************************************************/
+size_t xmalloc_good_size(size_t size)
+{
+    u32 allocsize;
+    #if XMEM_SUPERBLOCK_ENABLE
+    int i;
+    #endif
+
+    if(size==0||size>XMEM_POOL_SIZE) return size;
+    #if XMEM_CANARY_ENABLE
+    //the tail canary follows the size asked for, the rest of the block is not usable
+    return size;
+    #endif
+
+    allocsize=size+XMEM_CANARY_SIZE;
+    #if XMEM_SUPERBLOCK_ENABLE
+    i=xMemMetaClassGet(allocsize);
+    if(i>=0) return (XMEM_META_BLOCK_SIZE<<i)-XMEM_CANARY_SIZE;
+    #endif
+    allocsize=(allocsize+XMEM_ALIGN_SIZE-1)&~(u32)(XMEM_ALIGN_SIZE-1);
+    return allocsize-XMEM_CANARY_SIZE;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemOwns
+ * DESCRIPTION
+ * check if an address is inside the pool, the pointer is not required to
+ * be an allocated block
+ * PARAMETERS
+ * ptr      [IN]    address
+ * RETURNS
+ * int 1 if ptr is inside the pool, otherwise 0
+ * *************************************************************************/
+int xMemOwns(const void *ptr)
+{
+    return (uptr)ptr>=XMEM_POOL_START&&(uptr)ptr<XMEM_POOL_END;
+}
+
+#if XMEM_HANDLE_ENABLE
+typedef struct{
+    void * ptr;
+    u8 lock;
+}xMemHandleEntry;
+
+static xMemHandleEntry xMemHandleTable[XMEM_HANDLE_MAX];
+
+/***************************************************************************
+ * FUNCTION
+ * xMemHandleMove
+ * DESCRIPTION
+ * point the handle of a moved block to its new address
+ * PARAMETERS
+ * oldptr   [IN]    block address before moved
+ * newptr   [IN]    block address after moved
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemHandleMove(void *oldptr,void *newptr)
+{
+    u32 i;
+
+    for(i=0;i<XMEM_HANDLE_MAX;i++)
+    {
+        if(xMemHandleTable[i].ptr==oldptr)
+        {
+            xMemHandleTable[i].ptr=newptr;
+            return;
+        }
+    }
+    xMemAssert(0);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemBlockMovable
+ * DESCRIPTION
+ * check if a block is a handle block that not locked
+ * PARAMETERS
+ * blk      [IN]    block header
+ * RETURNS
+ * u8 1-movable, 0-not movable
+ * *************************************************************************/
+static u8 xMemBlockMovable(pxMemBlock blk)
+{
+    u32 i;
+    void * ptr;
+
+    if(blk->free!=XMEM_BLOCK_USED||!(XMEM_BLOCK_FLAGS(blk)&XMEM_BLOCK_FLAG_HANDLE)) return 0;
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    ptr=(void*)blk+XMEM_BLOCK_SIZE;
+    #else
+    ptr=blk->addr;
+    #endif
+    for(i=0;i<XMEM_HANDLE_MAX;i++)
+    {
+        if(xMemHandleTable[i].ptr==ptr) return xMemHandleTable[i].lock==0;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xhalloc
+ * DESCRIPTION
+ * allocate a relocatable memory block
+ * PARAMETERS
+ * size     [IN]    block size that required
+ * RETURNS
+ * xhandle  handle of the block, 0 if failed
+ * *************************************************************************/
+xhandle xhalloc(size_t size)
+{
+    u32 i;
+    void * ptr=NULL;
+
+    //larger than the pool, also keeps the u32 block size from wrapping
+    if(size>XMEM_POOL_SIZE) return 0;
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    if(!xmem_init_flag){
+        xMemInit();
+    }
+
+    for(i=0;i<XMEM_HANDLE_MAX;i++)
+    {
+        if(xMemHandleTable[i].ptr==NULL) break;
+    }
+
+    //handle blocks always come from block list, meta blocks can not move
+    if(i<XMEM_HANDLE_MAX) ptr=xMemBlockAlloc(size);
+    if(ptr)
+    {
+        XMEM_BLOCK_FLAGS(xMemBlockHeaderGet(ptr))|=XMEM_BLOCK_FLAG_HANDLE;
+        xMemHandleTable[i].ptr=ptr;
+        xMemHandleTable[i].lock=0;
+    }
+
+    SYS_EXIT_CRITICAL_SECTION;
+    return ptr?(xhandle)(i+1):0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xhlock
+ * DESCRIPTION
+ * lock a relocatable block, it will not move until unlocked
+ * PARAMETERS
+ * h        [IN]    handle
+ * RETURNS
+ * void * block address, valid until xhunlock
+ * *************************************************************************/
+void * xhlock(xhandle h)
+{
+    void * ptr;
+
+    if(h==0||h>XMEM_HANDLE_MAX) return NULL;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemAssert(xMemHandleTable[h-1].lock<0xFF);
+    xMemHandleTable[h-1].lock++;
+    ptr=xMemHandleTable[h-1].ptr;
+    SYS_EXIT_CRITICAL_SECTION;
+    return ptr;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xhunlock
+ * DESCRIPTION
+ * unlock a relocatable block
+ * PARAMETERS
+ * h        [IN]    handle
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xhunlock(xhandle h)
+{
+    if(h==0||h>XMEM_HANDLE_MAX) return;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemAssert(xMemHandleTable[h-1].lock>0);
+    xMemHandleTable[h-1].lock--;
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xhfree
+ * DESCRIPTION
+ * free a relocatable block
+ * PARAMETERS
+ * h        [IN]    handle
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xhfree(xhandle h)
+{
+    void * ptr;
+
+    if(h==0||h>XMEM_HANDLE_MAX) return;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    ptr=xMemHandleTable[h-1].ptr;
+    if(ptr)
+    {
+        XMEM_BLOCK_FLAGS(xMemBlockHeaderGet(ptr))&=~XMEM_BLOCK_FLAG_HANDLE;
+        xMemBlockFree(ptr);
+        xMemHandleTable[h-1].ptr=NULL;
+        xMemHandleTable[h-1].lock=0;
+    }
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCompact
+ * DESCRIPTION
+ * slide unlocked handle blocks over the free blocks in front of them along
+ * the block list, the free space gathers and merges toward the end
+ * PARAMETERS
+ * void
+ * RETURNS
+ * u32 largest free block size after compaction
+ * *************************************************************************/
+u32 xMemCompact(void)
+{
+    pxMemBlock blk,blknext;
+    #if XMEM_HEADER_PROTECT_ENABLE
+    pxMemBlock blkfree;
+    #endif
+    u32 freesize,largest=0;
+    void * oldptr;
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    #if XMEM_DEFER_COALESCE_ENABLE
+    xMemBlockCoalesce();
+    #endif
+
+    blk=xMemBlkList;
+    while(blk&&blk->next)
+    {
+        blknext=blk->next;
+        if(blk->free!=XMEM_BLOCK_FREE||!xMemBlockMovable(blknext))
+        {
+            blk=blknext;
+            continue;
+        }
+
+        freesize=blk->blksize;
+        #if XMEM_BOUNDRY_CHECK_ENABLE
+        /*
+         ---------------------------------          ---------------------------------
+         | hdr | free | hdr | handle blk  |   -->   | hdr | handle blk  | hdr | free |
+         ---------------------------------          ---------------------------------
+        */
+        oldptr=(void*)blknext+XMEM_BLOCK_SIZE;
+        memmove(blk,blknext,XMEM_BLOCK_SIZE+blknext->blksize);
+        xMemBlockAbsorbed(blknext,blk);
+        xMemHandleMove(oldptr,(void*)blk+XMEM_BLOCK_SIZE);
+
+        blknext=(pxMemBlock)((void*)blk+XMEM_BLOCK_SIZE+blk->blksize);
+        blknext->blksize=freesize;
+        blknext->free=XMEM_BLOCK_FREE;
+        XMEM_BLOCK_FLAGS(blknext)=0;
+        XMEM_BLOCK_TAG(blknext)=0;
+        blknext->next=blk->next;
+        blk->next=blknext;
+
+        if(blknext->next&&blknext->next->free==XMEM_BLOCK_FREE)
+        {
+            blknext->blksize+=blknext->next->blksize+XMEM_BLOCK_SIZE;
+            xMemBlockAbsorbed(blknext->next,blknext);
+            blknext->next=blknext->next->next;
+        }
+        #else
+        /*
+         list runs from high to low address, handle block moves up
+         -------------------------------          -------------------------------
+         |  next: handle  |  blk: free  |   -->   |  next: free  |  blk: handle |
+         -------------------------------          -------------------------------
+        */
+        oldptr=blknext->addr;
+        blk->addr=blk->addr+freesize-blknext->blksize;
+        memmove(blk->addr,oldptr,blknext->blksize);
+        xMemHandleMove(oldptr,blk->addr);
+
+        blk->blksize=blknext->blksize;
+        blk->free=XMEM_BLOCK_USED;
+        XMEM_BLOCK_FLAGS(blk)=XMEM_BLOCK_FLAG_HANDLE;
+        blknext->addr=oldptr;
+        blknext->blksize=freesize;
+        blknext->free=XMEM_BLOCK_FREE;
+        XMEM_BLOCK_FLAGS(blknext)=0;
+        XMEM_BLOCK_TAG(blknext)=0;
+
+        if(blknext->next&&blknext->next->free==XMEM_BLOCK_FREE)
+        {
+            blkfree=blknext->next;
+            blknext->blksize+=blkfree->blksize;
+            blknext->addr=blkfree->addr;
+            blknext->next=blkfree->next;
+            xMemBlockAbsorbed(blkfree,blknext);
+            xMemMgrHdrPut(blkfree);
+        }
+        if((uptr)blknext->addr==xMemBlkPoolStart)
+        {
+            //free space at the end goes back to the gap between headers and blocks
+            xMemBlkPoolStart+=blknext->blksize;
+            blk->next=NULL;
+            xMemBlockAbsorbed(blknext,NULL);
+            xMemMgrHdrPut(blknext);
+            break;
+        }
+        #endif
+        blk=blknext;
+    }
+    #if XMEM_FREE_INDEX
+    xMemFreeIndexBuild();
+    #endif
+
+    for(blk=xMemBlkList;blk;blk=blk->next)
+    {
+        if(blk->free==XMEM_BLOCK_FREE&&blk->blksize>largest) largest=blk->blksize;
+    }
+    #if XMEM_HEADER_PROTECT_ENABLE
+    if(xMemBlkPoolStart-xMemMgrHdrListEnd>largest) largest=xMemBlkPoolStart-xMemMgrHdrListEnd;
+    #endif
+
+    SYS_EXIT_CRITICAL_SECTION;
+    return largest;
+}
+#endif
+
+#if XMEM_REGION_ENABLE
+typedef struct t_xRegionChunk{
+    struct t_xRegionChunk * prev;
+    u32 size;
+}xRegionChunk;
+
+#define XMEM_REGION_CHUNK_HDR_SIZE  ((sizeof(xRegionChunk)+XMEM_META_BLOCK_SIZE-1)&~(XMEM_META_BLOCK_SIZE-1))
+
+/***************************************************************************
+ * FUNCTION
+ * xRegionInit
+ * DESCRIPTION
+ * Init a region, chunks are taken from the block list on demand
+ * PARAMETERS
+ * rgn          [OUT]   region
+ * chunksize    [IN]    default chunk size, 0 to use XMEM_REGION_CHUNK_SIZE
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xRegionInit(xRegion *rgn,size_t chunksize)
+{
+    rgn->chunk=NULL;
+    rgn->used=0;
+    rgn->chunksize=chunksize?chunksize:XMEM_REGION_CHUNK_SIZE;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xRegionAlloc
+ * DESCRIPTION
+ * allocate from a region by bumping the pointer of its current chunk,
+ * memory is given back by xRegionRelease or xRegionReset only
+ * PARAMETERS
+ * rgn      [IN/OUT]    region
+ * size     [IN]    size that required
+ * RETURNS
+ * void * memory address
+ * *************************************************************************/
+void * xRegionAlloc(xRegion *rgn,size_t size)
+{
+    xRegionChunk * chunk;
+    size_t chunksize;
+    void * ptr;
+
+    //larger than the pool, also keeps the rounding and the u32 chunk size from wrapping
+    if(size>XMEM_POOL_SIZE) return NULL;
+    size=(size+XMEM_META_BLOCK_SIZE-1)&~(XMEM_META_BLOCK_SIZE-1);
+    chunk=(xRegionChunk *)rgn->chunk;
+    if(chunk==NULL||rgn->used+size>chunk->size)
+    {
+        chunksize=rgn->chunksize;
+        if(size+XMEM_REGION_CHUNK_HDR_SIZE>chunksize) chunksize=size+XMEM_REGION_CHUNK_HDR_SIZE;
+
+        SYS_ENTER_CRITICAL_SECTION;
+        if(!xmem_init_flag){
+            xMemInit();
+        }
+        chunk=(xRegionChunk *)xMemBlockAlloc(chunksize);
+        SYS_EXIT_CRITICAL_SECTION;
+        if(chunk==NULL) return NULL;
+
+        chunk->prev=(xRegionChunk *)rgn->chunk;
+        chunk->size=chunksize;
+        rgn->chunk=chunk;
+        rgn->used=XMEM_REGION_CHUNK_HDR_SIZE;
+    }
+
+    ptr=(void*)chunk+rgn->used;
+    rgn->used+=size;
+    return ptr;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xRegionMark
+ * DESCRIPTION
+ * save the current position of a region for a nested scope
+ * PARAMETERS
+ * rgn      [IN]    region
+ * pos      [OUT]   position
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xRegionMark(xRegion *rgn,xRegionPos *pos)
+{
+    pos->chunk=rgn->chunk;
+    pos->used=rgn->used;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xRegionRelease
+ * DESCRIPTION
+ * give back everything allocated from a region after a mark, chunks
+ * taken after the mark are returned to the block list
+ * PARAMETERS
+ * rgn      [IN/OUT]    region
+ * pos      [IN]    position saved by xRegionMark
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xRegionRelease(xRegion *rgn,const xRegionPos *pos)
+{
+    xRegionChunk * chunk;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    while(rgn->chunk&&rgn->chunk!=pos->chunk)
+    {
+        chunk=(xRegionChunk *)rgn->chunk;
+        rgn->chunk=chunk->prev;
+        xMemBlockFree(chunk);
+    }
+    SYS_EXIT_CRITICAL_SECTION;
+
+    rgn->used=rgn->chunk?pos->used:0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xRegionReset
+ * DESCRIPTION
+ * give back all chunks of a region at once
+ * PARAMETERS
+ * rgn      [IN/OUT]    region
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xRegionReset(xRegion *rgn)
+{
+    xRegionPos pos={NULL,0};
+
+    xRegionRelease(rgn,&pos);
+}
+#endif
+
+#if XMEM_SUPERBLOCK_ENABLE && XMEM_CACHE_ENABLE
+struct t_xMemCache{
+    struct t_xMemCache * next;          //all caches, their empty slabs are released under pressure
+    xMemSuperBlock * slabs;
+    void (*ctor)(void *obj);
+    void (*dtor)(void *obj);
+    u16 objsize;
+    u16 align;
+    u8 nobj;
+};
+
+static xMemCache * xMemCacheList=NULL;
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheSlabAppend
+ * DESCRIPTION
+ * add a slab, a dedicated super block for the objects of a cache, all
+ * objects are constructed here
+ * PARAMETERS
+ * cache    [IN/OUT]    object cache
+ * RETURNS
+ * xMemSuperBlock * new slab
+ * *************************************************************************/
+static xMemSuperBlock * xMemCacheSlabAppend(xMemCache *cache)
+{
+    xMemSuperBlock * slab;
+    void * raw,*addr;
+    u32 i,pad;
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    slab=(xMemSuperBlock *)xMemBlockAlloc(XMEM_NODE_SIZE(xMemSuperBlock));
+    #else
+    slab=(xMemSuperBlock *)xMemMgrHdrGet(XMEM_LIST_TYPE_SUPERBLOCK);
+    #endif
+    if(slab==NULL) return NULL;
+
+    //blocks are XMEM_ALIGN_SIZE aligned, stronger alignment keeps the pad in the byte in front of the objects
+    pad=cache->align>XMEM_ALIGN_SIZE?cache->align:0;
+    raw=xMemBlockAlloc(cache->objsize*cache->nobj+pad);
+    if(raw==NULL)
+    {
+        #if XMEM_BOUNDRY_CHECK_ENABLE
+        xMemBlockFree(slab);
+        #else
+        xMemMgrHdrPut(slab);
+        #endif
+        return NULL;
+    }
+    addr=raw;
+    if(pad)
+    {
+        addr=(void*)(((uptr)raw+cache->align)&~(uptr)(cache->align-1));
+        *(u8*)(addr-1)=(u8)(addr-raw);
+    }
+
+    xMemSuperBlockInit(slab,addr,cache->nobj,cache->objsize);
+    if(cache->ctor)
+    {
+        for(i=0;i<cache->nobj;i++) cache->ctor(addr+i*cache->objsize);
+    }
+    slab->next=cache->slabs;
+    cache->slabs=slab;
+    return slab;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheSlabRelease
+ * DESCRIPTION
+ * destruct all objects of a slab and give its memory back
+ * PARAMETERS
+ * cache    [IN]    object cache
+ * slab     [IN]    slab that already unlinked
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemCacheSlabRelease(xMemCache *cache,xMemSuperBlock *slab)
+{
+    u32 i;
+    void * raw;
+
+    if(cache->dtor)
+    {
+        for(i=0;i<slab->nblk;i++) cache->dtor(slab->addr+i*cache->objsize);
+    }
+    raw=slab->addr;
+    if(cache->align>XMEM_ALIGN_SIZE) raw-=*(u8*)(slab->addr-1);
+    xMemBlockFree(raw);
+    #if XMEM_BOUNDRY_CHECK_ENABLE
+    xMemBlockFree(slab);
+    #else
+    xMemMgrHdrPut(slab);
+    #endif
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheCreate
+ * DESCRIPTION
+ * create a cache of objects that have the exact same size, objects stay
+ * constructed while they are free in the cache
+ * PARAMETERS
+ * size     [IN]    object size
+ * align    [IN]    object alignment, power of 2, 0 for default
+ * ctor     [IN]    called once for each object when a slab is added, can be NULL
+ * dtor     [IN]    called once for each object when a slab is released, can be NULL
+ * RETURNS
+ * xMemCache * object cache, NULL if failed
+ * *************************************************************************/
+xMemCache * xMemCacheCreate(size_t size,size_t align,void (*ctor)(void *obj),void (*dtor)(void *obj))
+{
+    xMemCache * cache;
+    u32 objsize,nobj;
+
+    if(align==0) align=4;
+    if(size==0||(align&(align-1))||align>0x80) return NULL;
+
+    objsize=size<sizeof(void *)?sizeof(void *):size;
+    objsize=(objsize+align-1)&~(align-1);
+    if(objsize>0xFFFF) return NULL;
+
+    nobj=XMEM_CACHE_SLAB_SIZE/objsize;
+    if(nobj>XMEM_SUPERBLOCK_BLKS_MAX) nobj=XMEM_SUPERBLOCK_BLKS_MAX;
+    if(nobj<2) nobj=2;
+
+    cache=(xMemCache *)xmalloc(sizeof(xMemCache));
+    if(cache)
+    {
+        cache->slabs=NULL;
+        cache->ctor=ctor;
+        cache->dtor=dtor;
+        cache->objsize=objsize;
+        cache->align=align;
+        cache->nobj=nobj;
+
+        SYS_ENTER_CRITICAL_SECTION;
+        cache->next=xMemCacheList;
+        xMemCacheList=cache;
+        SYS_EXIT_CRITICAL_SECTION;
+    }
+    return cache;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheAlloc
+ * DESCRIPTION
+ * allocate an object from a cache
+ * PARAMETERS
+ * cache    [IN/OUT]    object cache
+ * RETURNS
+ * void * constructed object, NULL if failed
+ * *************************************************************************/
+void * xMemCacheAlloc(xMemCache *cache)
+{
+    xMemSuperBlock * slab;
+    void * obj=NULL;
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    for(slab=cache->slabs;slab;slab=slab->next)
+    {
+        if(slab->nfree>0) break;
+    }
+    if(slab==NULL) slab=xMemCacheSlabAppend(cache);
+    if(slab) obj=xMemSuperBlockTake(slab);
+
+    SYS_EXIT_CRITICAL_SECTION;
+    return obj;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheFree
+ * DESCRIPTION
+ * give an object back to its cache, it is not destructed
+ * PARAMETERS
+ * cache    [IN/OUT]    object cache
+ * obj      [IN]    object
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemCacheFree(xMemCache *cache,void *obj)
+{
+    xMemSuperBlock * slab;
+    uptr start,p;
+
+    if(obj==NULL) return;
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    p=(uptr)obj;
+    for(slab=cache->slabs;slab;slab=slab->next)
+    {
+        start=(uptr)slab->addr;
+        if(p>=start&&p<start+slab->blksize*slab->nblk)
+        {
+            xMallocMetaBlockPut(slab,obj);
+            break;
+        }
+    }
+    xMemAssert(slab);
+
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheSlabsRelease
+ * DESCRIPTION
+ * release the slabs of a cache which have no object in use, must be called
+ * inside SYS_ENTER_CRITICAL_SECTION
+ * PARAMETERS
+ * cache    [IN/OUT]    object cache
+ * RETURNS
+ * u32 number of slabs released
+ * *************************************************************************/
+static u32 xMemCacheSlabsRelease(xMemCache *cache)
+{
+    xMemSuperBlock * slab,*prev=NULL,*next;
+    u32 n=0;
+
+    for(slab=cache->slabs;slab;slab=next)
+    {
+        next=slab->next;
+        if(slab->nfree==slab->nblk)
+        {
+            if(prev) prev->next=next;
+            else cache->slabs=next;
+            xMemCacheSlabRelease(cache,slab);
+            n++;
+        }
+        else
+        {
+            prev=slab;
+        }
+    }
+    return n;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheShrink
+ * DESCRIPTION
+ * release the slabs of a cache which have no object in use
+ * PARAMETERS
+ * cache    [IN/OUT]    object cache
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemCacheShrink(xMemCache *cache)
+{
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemCacheSlabsRelease(cache);
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+#if XMEM_PRESSURE_ENABLE
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheReclaim
+ * DESCRIPTION
+ * release the empty slabs of every cache, must be called inside
+ * SYS_ENTER_CRITICAL_SECTION
+ * PARAMETERS
+ * void
+ * RETURNS
+ * u32 number of slabs released
+ * *************************************************************************/
+static u32 xMemCacheReclaim(void)
+{
+    xMemCache * cache;
+    u32 n=0;
+
+    for(cache=xMemCacheList;cache;cache=cache->next)
+    {
+        n+=xMemCacheSlabsRelease(cache);
+    }
+    return n;
+}
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemCacheDestroy
+ * DESCRIPTION
+ * destruct all objects and release a cache
+ * PARAMETERS
+ * cache    [IN]    object cache
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemCacheDestroy(xMemCache *cache)
+{
+    xMemSuperBlock * slab;
+    xMemCache ** pp;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    for(pp=&xMemCacheList;*pp;pp=&(*pp)->next)
+    {
+        if(*pp==cache)
+        {
+            *pp=cache->next;
+            break;
+        }
+    }
+    while(cache->slabs)
+    {
+        slab=cache->slabs;
+        cache->slabs=slab->next;
+        xMemCacheSlabRelease(cache,slab);
+    }
+    SYS_EXIT_CRITICAL_SECTION;
+
+    xfree(cache);
+}
+#endif
+
+#if XMEM_XBUF_ENABLE
+typedef struct{
+    u32 refs;           //views of the data
+    u32 size;
+}xBufStore;
+
+//the first view lives in the allocation, between the count and the data
+#define XMEM_XBUF_ROOT(store)   ((xbuf *)((u8 *)(store)+sizeof(xBufStore)))
+#define XMEM_XBUF_HDR_SIZE      ((sizeof(xBufStore)+sizeof(xbuf)+XMEM_ALIGN_SIZE-1)&~(XMEM_ALIGN_SIZE-1))
+
+/***************************************************************************
+ * FUNCTION
+ * xballoc
+ * DESCRIPTION
+ * allocate a shared buffer, the view returned and the data take one block
+ * PARAMETERS
+ * size     [IN]    bytes of data
+ * RETURNS
+ * xbuf * view of the whole buffer, NULL if failed
+ * *************************************************************************/
+xbuf * xballoc(size_t size)
+{
+    xBufStore * store;
+    xbuf * buf;
+
+    if(size>XMEM_POOL_SIZE) return NULL;
+    store=(xBufStore *)xmalloc(XMEM_XBUF_HDR_SIZE+size);
+    if(store==NULL) return NULL;
+
+    store->refs=1;
+    store->size=size;
+    buf=XMEM_XBUF_ROOT(store);
+    buf->next=NULL;
+    buf->data=(u8 *)store+XMEM_XBUF_HDR_SIZE;
+    buf->len=size;
+    buf->store=store;
+    return buf;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemBufPut
+ * DESCRIPTION
+ * drop one view, the data goes with the last one
+ * PARAMETERS
+ * buf      [IN]    view, not used afterwards
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemBufPut(xbuf *buf)
+{
+    xBufStore * store=(xBufStore *)buf->store;
+
+    //the first view is freed with the data
+    if(buf!=XMEM_XBUF_ROOT(store)) xfree(buf);
+    if(__atomic_sub_fetch(&store->refs,1,__ATOMIC_ACQ_REL)==0) xfree(store);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xbfree
+ * DESCRIPTION
+ * free a view and the views chained behind it
+ * PARAMETERS
+ * chain    [IN]    first view, NULL is ignored
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xbfree(xbuf *chain)
+{
+    xbuf * next;
+
+    while(chain)
+    {
+        next=chain->next;
+        xMemBufPut(chain);
+        chain=next;
+    }
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xbslice
+ * DESCRIPTION
+ * make views of len bytes from off of a chain, one view for each buffer
+ * the range touches. the data is shared, not copied
+ * PARAMETERS
+ * chain    [IN]    views to slice, they are kept
+ * off      [IN]    first byte, counted over the whole chain
+ * len      [IN]    bytes
+ * RETURNS
+ * xbuf * new chain, NULL if the range is outside the chain, empty or no memory
+ * *************************************************************************/
+xbuf * xbslice(const xbuf *chain,size_t off,size_t len)
+{
+    xbuf * head=NULL,**tail=&head,*buf;
+    size_t n;
+
+    for(;chain&&off>=chain->len;chain=chain->next) off-=chain->len;
+
+    while(len&&chain)
+    {
+        n=chain->len-off;
+        if(n>len) n=len;
+
+        buf=(xbuf *)xmalloc(sizeof(xbuf));
+        if(buf==NULL) break;
+        __atomic_add_fetch(&((xBufStore *)chain->store)->refs,1,__ATOMIC_RELAXED);
+        buf->next=NULL;
+        buf->data=(u8 *)chain->data+off;
+        buf->len=n;
+        buf->store=chain->store;
+        *tail=buf;
+        tail=&buf->next;
+
+        len-=n;
+        off=0;
+        chain=chain->next;
+    }
+
+    if(len)
+    {
+        xbfree(head);
+        return NULL;
+    }
+    return head;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xbchain
+ * DESCRIPTION
+ * put a chain behind another one
+ * PARAMETERS
+ * head     [IN/OUT]    chain, NULL for an empty one
+ * tail     [IN]    chain that goes to its end
+ * RETURNS
+ * xbuf * first view of the joined chain
+ * *************************************************************************/
+xbuf * xbchain(xbuf *head,xbuf *tail)
+{
+    xbuf * buf;
+
+    if(head==NULL) return tail;
+    for(buf=head;buf->next;buf=buf->next);
+    buf->next=tail;
+    return head;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xblength
+ * DESCRIPTION
+ * bytes of a chain
+ * PARAMETERS
+ * chain    [IN]    first view
+ * RETURNS
+ * size_t sum of the view lengths
+ * *************************************************************************/
+size_t xblength(const xbuf *chain)
+{
+    size_t len=0;
+
+    for(;chain;chain=chain->next) len+=chain->len;
+    return len;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xbgather
+ * DESCRIPTION
+ * copy bytes of a chain into one flat buffer, for the parts that have to
+ * be contiguous
+ * PARAMETERS
+ * chain    [IN]    first view
+ * off      [IN]    first byte, counted over the whole chain
+ * dst      [OUT]   destination
+ * len      [IN]    bytes wanted
+ * RETURNS
+ * size_t bytes copied, less than len if the chain ends first
+ * *************************************************************************/
+size_t xbgather(const xbuf *chain,size_t off,void *dst,size_t len)
+{
+    size_t n,copied=0;
+
+    for(;chain&&off>=chain->len;chain=chain->next) off-=chain->len;
+
+    for(;chain&&copied<len;chain=chain->next)
+    {
+        n=chain->len-off;
+        if(n>len-copied) n=len-copied;
+        memcpy((u8 *)dst+copied,(u8 *)chain->data+off,n);
+        copied+=n;
+        off=0;
+    }
+    return copied;
+}
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemReset
+ * DESCRIPTION
+ * drop every allocation at once and start over with an empty pool, all
+ * pointers, handles and regions taken before become invalid
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemReset(void)
+{
+    #if XMEM_TAG_ENABLE || XMEM_TUNE_ENABLE
+    u32 i;
+    #endif
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    xMemPoolInit();
+
+    #if XMEM_DEFER_COALESCE_ENABLE
+    xMemQuickCount=0;
+    #endif
+    #if XMEM_BOUNDRY_CHECK_ENABLE && XMEM_CHECK_MODE == XMEM_CHECK_BOUNDED
+    xMemCheckCursor=NULL;
+    #endif
+    #if XMEM_HANDLE_ENABLE
+    memset(xMemHandleTable,0,sizeof(xMemHandleTable));
+    #endif
+    #if XMEM_PROFILE_ENABLE
+    xMemProfileClear();
+    #endif
+    #if XMEM_SUPERBLOCK_ENABLE && XMEM_CACHE_ENABLE
+    //the caches went with the pool
+    xMemCacheList=NULL;
+    #endif
+    #if XMEM_TAG_ENABLE
+    for(i=1;i<XMEM_TAG_MAX;i++)
+    {
+        //quotas stay set
+        xMemTagTable[i].bytes=0;
+        xMemTagTable[i].count=0;
+        xMemTagTable[i].peak=0;
+        xMemTagTable[i].failed=0;
+    }
+    #endif
+    #if XMEM_TUNE_ENABLE
+    //the blocks went with the pool, what was asked for and the peaks stay
+    for(i=0;i<XMEM_TUNE_BUCKETS;i++) xMemTuneBuckets[i].live=0;
+    xMemTuneListLive=0;
+    #endif
+    #if XMEM_EPOCH_ENABLE
+    //retired blocks and retire chunks went with the pool
+    memset(xMemEpochRetired,0,sizeof(xMemEpochRetired));
+    memset(xMemEpochRetiredCount,0,sizeof(xMemEpochRetiredCount));
+    #endif
+
+    xmem_init_flag=1;
+    SYS_EXIT_CRITICAL_SECTION;
+}
+
+#if XMEM_POOL_FILE_ENABLE
+#define XMEM_FILE_MAGIC     0x50414548      //"HEAP"
+#define XMEM_FILE_VERSION   1
+//options that change the layout of the pool, a file only attaches to the same build
+#define XMEM_FILE_CONFIG    ((u32)XMEM_POOL_OPPOSITE|XMEM_SUPERBLOCK_ENABLE<<1|XMEM_HANDLE_ENABLE<<2| \
+                             XMEM_CANARY_ENABLE<<3|XMEM_CANARY_HEAD_ENABLE<<4|XMEM_SUPERBLOCK_LIST_COUNT<<5| \
+                             XMEM_ALIGN_SIZE<<8|XMEM_TAG_ENABLE<<15|(u32)sizeof(xMemBlock)<<16| \
+                             (u32)XMEM_HEADER_SLOTS_CONFIG<<24)
+
+#ifdef MAP_FIXED_NOREPLACE
+#define XMEM_MAP_FIXED      MAP_FIXED_NOREPLACE
+#else
+#define XMEM_MAP_FIXED      0
+#endif
+
+/*
+ the file starts with XMEM_POOL_FILE_HEADER bytes for this header, the pool
+ follows. the header keeps the state that xmem has outside the pool
+*/
+typedef struct{
+    u32 magic;
+    u32 version;
+    u32 poolsize;
+    u32 config;
+    uptr base;              //address the file is mapped at
+    uptr root;              //offset of the root object from base, 0 if none
+    u32 clean;              //1 after xMemFileClose, 0 while a process has it open
+    u8 policy;
+    pxMemBlock blklist;
+    #if XMEM_HEADER_PROTECT_ENABLE
+    pxMemHdrPage hdrpages;
+    uptr hdrend;
+    uptr blkstart;
+    #endif
+    #if XMEM_SUPERBLOCK_ENABLE
+    xMemSuperBlock superblocks[XMEM_SUPERBLOCK_LIST_COUNT];
+    #endif
+    #if XMEM_HANDLE_ENABLE
+    xMemHandleEntry handles[XMEM_HANDLE_MAX];
+    #endif
+    #if XMEM_TAG_ENABLE
+    xMemTagInfo tags[XMEM_TAG_MAX];
+    #endif
+}xMemFileHeader;
+
+#define XMEM_FILE_HDR       ((xMemFileHeader *)xMemPoolBase)
+#define XMEM_FILE_SIZE      (XMEM_POOL_FILE_HEADER+XMEM_POOL_SIZE)
+#define XMEM_POOL_ROOT      (XMEM_FILE_HDR->root)
+
+/***************************************************************************
+ * FUNCTION
+ * xMemFileSave
+ * DESCRIPTION
+ * write the heap state into the file header
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemFileSave(void)
+{
+    xMemFileHeader * hdr=XMEM_FILE_HDR;
+
+    hdr->policy=xMemFitPolicy;
+    hdr->blklist=xMemBlkList;
+    #if XMEM_HEADER_PROTECT_ENABLE
+    hdr->hdrpages=xMemHdrPageList;
+    hdr->hdrend=xMemMgrHdrListEnd;
+    hdr->blkstart=xMemBlkPoolStart;
+    #endif
+    #if XMEM_SUPERBLOCK_ENABLE
+    memcpy(hdr->superblocks,xMemSuperBlockList,sizeof(xMemSuperBlockList));
+    #endif
+    #if XMEM_HANDLE_ENABLE
+    memcpy(hdr->handles,xMemHandleTable,sizeof(xMemHandleTable));
+    #endif
+    #if XMEM_TAG_ENABLE
+    memcpy(hdr->tags,xMemTagTable,sizeof(xMemTagTable));
+    #endif
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemFileRestore
+ * DESCRIPTION
+ * read the heap state from the file header, rebuild what is derived from
+ * the pool
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+static void xMemFileRestore(void)
+{
+    xMemFileHeader * hdr=XMEM_FILE_HDR;
+    #if XMEM_SIZE_MAP
+    xMemSuperBlock * psuperblock;
+    int i;
+    #endif
+    #if XMEM_USED_COUNT
+    pxMemBlock blk;
+    #endif
+
+    xMemFitPolicy=hdr->policy;
+    xMemBlkList=hdr->blklist;
+    xMemFitRover=NULL;
+    #if XMEM_MAINT_ENABLE
+    xMemMaintCursor=NULL;
+    #endif
+    #if XMEM_HEADER_PROTECT_ENABLE
+    xMemHdrPageList=hdr->hdrpages;
+    xMemMgrHdrListEnd=hdr->hdrend;
+    xMemBlkPoolStart=hdr->blkstart;
+    #endif
+    #if XMEM_SUPERBLOCK_ENABLE
+    memcpy(xMemSuperBlockList,hdr->superblocks,sizeof(xMemSuperBlockList));
+    #endif
+    #if XMEM_HANDLE_ENABLE
+    memcpy(xMemHandleTable,hdr->handles,sizeof(xMemHandleTable));
+    #endif
+    #if XMEM_TAG_ENABLE
+    memcpy(xMemTagTable,hdr->tags,sizeof(xMemTagTable));
+    #endif
+
+    #if XMEM_SIZE_MAP
+    memset(xMemSizeMap,0,sizeof(xMemSizeMap));
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
+    {
+        for(psuperblock=&xMemSuperBlockList[i];psuperblock;psuperblock=psuperblock->next)
+            xMemSizeMapMark(psuperblock,1);
+    }
+    #endif
+    #if XMEM_FREE_INDEX
+    xMemFreeIndexBuild();
+    #endif
+    #if XMEM_DEFER_COALESCE_ENABLE
+    xMemQuickCount=0;
+    #endif
+    #if XMEM_BOUNDRY_CHECK_ENABLE && XMEM_CHECK_MODE == XMEM_CHECK_BOUNDED
+    xMemCheckCursor=NULL;
+    #endif
+    #if XMEM_PROFILE_ENABLE
+    xMemProfileClear();
+    #endif
+    #if XMEM_USED_COUNT
+    xMemBlockUsed=0;
+    for(blk=xMemBlkList;blk;blk=blk->next)
+    {
+        if(blk->free==XMEM_BLOCK_USED) xMemBlockUsed+=blk->blksize;
+    }
+    #endif
+    #if XMEM_SUPERBLOCK_ENABLE && XMEM_CACHE_ENABLE
+    //caches of an earlier process are not known to this one
+    xMemCacheList=NULL;
+    #endif
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemFileOpen
+ * DESCRIPTION
+ * use a file as the pool, a file that holds a heap is attached at the
+ * address it was created at, otherwise a new heap is created in it
+ * PARAMETERS
+ * path     [IN]    heap file
+ * addr     [IN]    address to map a new heap at, NULL for XMEM_POOL_FILE_ADDR
+ * RETURNS
+ * int 1-heap attached, 0-new heap created, -1-failure
+ * *************************************************************************/
+int xMemFileOpen(const char *path,void *addr)
+{
+    xMemFileHeader hdr;
+    void * map;
+    int fd,attach;
+
+    xMemAssert(sizeof(xMemFileHeader)<=XMEM_POOL_FILE_HEADER);
+    if(xMemPoolBase) return -1;
+
+    fd=open(path,O_RDWR|O_CREAT,0644);
+    if(fd<0) return -1;
+
+    attach=pread(fd,&hdr,sizeof(hdr),0)==sizeof(hdr)&&hdr.magic==XMEM_FILE_MAGIC;
+    if(attach)
+    {
+        //a heap of another build, or one that a process did not close, can not be trusted
+        if(hdr.version!=XMEM_FILE_VERSION||hdr.poolsize!=XMEM_POOL_SIZE||hdr.config!=XMEM_FILE_CONFIG||!hdr.clean)
+        {
+            close(fd);
+            return -1;
+        }
+        addr=(void *)hdr.base;
+    }
+    else
+    {
+        if(addr==NULL) addr=(void *)XMEM_POOL_FILE_ADDR;
+        if(ftruncate(fd,XMEM_FILE_SIZE)<0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    map=mmap(addr,XMEM_FILE_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED|XMEM_MAP_FIXED,fd,0);
+    close(fd);
+    if(map==MAP_FAILED) return -1;
+    if(map!=addr)
+    {
+        //pointers in the heap are only valid at the address it was created at
+        munmap(map,XMEM_FILE_SIZE);
+        return -1;
+    }
+
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemPoolBase=(uptr)map;
+    if(attach)
+    {
+        xMemFileRestore();
+        xmem_init_flag=1;
+    }
+    else
+    {
+        memset(XMEM_FILE_HDR,0,sizeof(xMemFileHeader));
+        XMEM_FILE_HDR->magic=XMEM_FILE_MAGIC;
+        XMEM_FILE_HDR->version=XMEM_FILE_VERSION;
+        XMEM_FILE_HDR->poolsize=XMEM_POOL_SIZE;
+        XMEM_FILE_HDR->config=XMEM_FILE_CONFIG;
+        XMEM_FILE_HDR->base=xMemPoolBase;
+        xMemInit();
+    }
+    XMEM_FILE_HDR->clean=0;
+    msync(map,XMEM_POOL_FILE_HEADER,MS_SYNC);
+    SYS_EXIT_CRITICAL_SECTION;
+
+    return attach;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemFileClose
+ * DESCRIPTION
+ * write the heap state to the file and unmap it, pointers into the pool
+ * are invalid until the file is opened again
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemFileClose(void)
+{
+    if(!xMemPoolBase) return;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    #if XMEM_DEFER_COALESCE_ENABLE
+    //the quick list is not saved, deferred blocks are merged first
+    xMemBlockCoalesce();
+    #endif
+    xMemFileSave();
+    XMEM_FILE_HDR->clean=1;
+    msync((void *)xMemPoolBase,XMEM_FILE_SIZE,MS_SYNC);
+    munmap((void *)xMemPoolBase,XMEM_FILE_SIZE);
+    xMemPoolBase=0;
+    xmem_init_flag=0;
+    SYS_EXIT_CRITICAL_SECTION;
+}
+#endif
+
+#if XMEM_POOL_SHARED_ENABLE
+#define XMEM_SHARED_MAGIC   0x44524853      //"SHRD"
+//options that change the layout of the pool, a process only attaches to the same build
+#define XMEM_SHARED_CONFIG  ((u32)XMEM_POOL_OPPOSITE|XMEM_SUPERBLOCK_ENABLE<<1|XMEM_CANARY_ENABLE<<3| \
+                             XMEM_CANARY_HEAD_ENABLE<<4|XMEM_SUPERBLOCK_LIST_COUNT<<5| \
+                             XMEM_ALIGN_SIZE<<8|XMEM_TAG_ENABLE<<15|(u32)sizeof(xMemBlock)<<16| \
+                             (u32)XMEM_HEADER_SLOTS_CONFIG<<24)
+#define XMEM_SHARED_SIZE    (XMEM_POOL_SHARED_HEADER+XMEM_POOL_SIZE)
+#define XMEM_SHARED_WAIT    1000            //ms an attaching process waits for the creator
+#define XMEM_POOL_ROOT      (XMEM_SHARED->root)
+
+#ifdef MAP_FIXED_NOREPLACE
+#define XMEM_SHARED_MAP_FIXED   MAP_FIXED_NOREPLACE
+#else
+#define XMEM_SHARED_MAP_FIXED   0
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSharedLock
+ * DESCRIPTION
+ * SYS_ENTER_CRITICAL_SECTION of the shared pool. the mutex is robust, when
+ * its owner died the lock is taken over and the heap used as it is
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemSharedLock(void)
+{
+    if(!xMemPoolBase) return;
+    if(pthread_mutex_lock(&XMEM_SHARED->lock)==EOWNERDEAD)
+    {
+        xMemPrintf("xMem: owner of the shared heap lock died\n");
+        pthread_mutex_consistent(&XMEM_SHARED->lock);
+    }
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSharedUnlock
+ * DESCRIPTION
+ * SYS_EXIT_CRITICAL_SECTION of the shared pool
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemSharedUnlock(void)
+{
+    if(!xMemPoolBase) return;
+    pthread_mutex_unlock(&XMEM_SHARED->lock);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSharedCreate
+ * DESCRIPTION
+ * size an empty shared memory object and create a heap in it
+ * PARAMETERS
+ * fd       [IN]    empty shared memory object
+ * addr     [IN]    address to map the heap at
+ * RETURNS
+ * int 0-heap created, -1-failure
+ * *************************************************************************/
+static int xMemSharedCreate(int fd,void *addr)
+{
+    pthread_mutexattr_t attr;
+    void * map;
+
+    if(ftruncate(fd,XMEM_SHARED_SIZE)<0) return -1;
+    map=mmap(addr,XMEM_SHARED_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED|XMEM_SHARED_MAP_FIXED,fd,0);
+    if(map==MAP_FAILED) return -1;
+    if(map!=addr)
+    {
+        munmap(map,XMEM_SHARED_SIZE);
+        return -1;
+    }
+
+    xMemPoolBase=(uptr)map;
+    XMEM_SHARED->config=XMEM_SHARED_CONFIG;
+    XMEM_SHARED->base=xMemPoolBase;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr,PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr,PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&XMEM_SHARED->lock,&attr);
+    pthread_mutexattr_destroy(&attr);
+    xMemFitPolicy=XMEM_FIT_POLICY;
+    xMemInit();
+
+    //attaching processes wait for the magic, it is written last
+    __atomic_store_n(&XMEM_SHARED->magic,XMEM_SHARED_MAGIC,__ATOMIC_RELEASE);
+    return 0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSharedAttach
+ * DESCRIPTION
+ * wait for the creator of a shared memory object to finish its heap, then
+ * map the heap at the address it was created at
+ * PARAMETERS
+ * fd       [IN]    shared memory object that holds or will hold a heap
+ * RETURNS
+ * int 1-heap attached, -1-failure
+ * *************************************************************************/
+static int xMemSharedAttach(int fd)
+{
+    xMemSharedState * state;
+    struct stat st;
+    uptr base=0;
+    u32 config=0;
+    void * map;
+    int i;
+
+    for(i=0;i<XMEM_SHARED_WAIT;i++)
+    {
+        if(fstat(fd,&st)<0) return -1;
+        if(st.st_size>=(off_t)XMEM_SHARED_SIZE)
+        {
+            map=mmap(NULL,sizeof(xMemSharedState),PROT_READ,MAP_SHARED,fd,0);
+            if(map==MAP_FAILED) return -1;
+            state=(xMemSharedState *)map;
+            if(__atomic_load_n(&state->magic,__ATOMIC_ACQUIRE)==XMEM_SHARED_MAGIC)
+            {
+                base=state->base;
+                config=state->config;
+            }
+            munmap(map,sizeof(xMemSharedState));
+            if(base) break;
+        }
+        usleep(1000);
+    }
+    //no heap yet, or a heap of another build
+    if(!base||config!=XMEM_SHARED_CONFIG||st.st_size!=(off_t)XMEM_SHARED_SIZE) return -1;
+
+    map=mmap((void *)base,XMEM_SHARED_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED|XMEM_SHARED_MAP_FIXED,fd,0);
+    if(map==MAP_FAILED) return -1;
+    if(map!=(void *)base)
+    {
+        //pointers in the heap are only valid at the address it was created at
+        munmap(map,XMEM_SHARED_SIZE);
+        return -1;
+    }
+
+    xMemPoolBase=base;
+    xmem_init_flag=1;
+    return 1;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSharedOpenFd
+ * DESCRIPTION
+ * use a shared memory object (memfd, shm_open) as the pool. an empty object
+ * gets a new heap, otherwise the heap in it is attached. the first process
+ * has to open the object before it is handed to the others
+ * PARAMETERS
+ * fd       [IN]    shared memory object, stays open
+ * addr     [IN]    address to map a new heap at, NULL for XMEM_POOL_SHARED_ADDR
+ * RETURNS
+ * int 1-heap attached, 0-new heap created, -1-failure
+ * *************************************************************************/
+int xMemSharedOpenFd(int fd,void *addr)
+{
+    struct stat st;
+
+    if(xMemPoolBase||fstat(fd,&st)<0) return -1;
+    if(st.st_size) return xMemSharedAttach(fd);
+    return xMemSharedCreate(fd,addr?addr:(void *)XMEM_POOL_SHARED_ADDR);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSharedOpen
+ * DESCRIPTION
+ * use the POSIX shared memory object name as the pool, the first process
+ * creates the object and the heap in it, the others attach
+ * PARAMETERS
+ * name     [IN]    shared memory object, "/name"
+ * addr     [IN]    address to map a new heap at, NULL for XMEM_POOL_SHARED_ADDR
+ * RETURNS
+ * int 1-heap attached, 0-new heap created, -1-failure
+ * *************************************************************************/
+int xMemSharedOpen(const char *name,void *addr)
+{
+    int fd,ret;
+
+    if(xMemPoolBase) return -1;
+
+    fd=shm_open(name,O_RDWR|O_CREAT|O_EXCL,0600);
+    if(fd>=0)
+    {
+        ret=xMemSharedCreate(fd,addr?addr:(void *)XMEM_POOL_SHARED_ADDR);
+        //nobody else could attach to it
+        if(ret<0) shm_unlink(name);
+    }
+    else
+    {
+        if(errno!=EEXIST) return -1;
+        fd=shm_open(name,O_RDWR,0);
+        if(fd<0) return -1;
+        ret=xMemSharedAttach(fd);
+    }
+    close(fd);
+    return ret;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemSharedClose
+ * DESCRIPTION
+ * unmap the shared heap from this process, the heap stays for the others
+ * until the object is removed (shm_unlink, last close of a memfd)
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemSharedClose(void)
+{
+    if(!xMemPoolBase) return;
+
+    munmap((void *)xMemPoolBase,XMEM_SHARED_SIZE);
+    xMemPoolBase=0;
+    xmem_init_flag=0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemPtrToOffset
+ * DESCRIPTION
+ * position of a memory block in the shared heap, to pass it to another
+ * process
+ * PARAMETERS
+ * ptr      [IN]    memory block in the pool, or NULL
+ * RETURNS
+ * size_t offset of ptr in the region, 0 for NULL or a pointer outside it
+ * *************************************************************************/
+size_t xMemPtrToOffset(const void *ptr)
+{
+    if(!xMemPoolBase||(uptr)ptr<XMEM_POOL_START||(uptr)ptr>=XMEM_POOL_END) return 0;
+    return (uptr)ptr-xMemPoolBase;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemOffsetToPtr
+ * DESCRIPTION
+ * memory block of an offset from xMemPtrToOffset
+ * PARAMETERS
+ * offset   [IN]    offset in the region
+ * RETURNS
+ * void * memory block, NULL for offset 0 or an offset outside the pool
+ * *************************************************************************/
+void * xMemOffsetToPtr(size_t offset)
+{
+    if(!xMemPoolBase||offset<XMEM_POOL_SHARED_HEADER||offset>=XMEM_SHARED_SIZE) return NULL;
+    return (void *)(xMemPoolBase+offset);
+}
+#endif
+
+#if XMEM_POOL_FILE_ENABLE || XMEM_POOL_SHARED_ENABLE
+/***************************************************************************
+ * FUNCTION
+ * xMemRootSet
+ * DESCRIPTION
+ * remember the object a re-attached or another process starts from
+ * PARAMETERS
+ * ptr      [IN]    memory block in the pool, NULL to clear
+ * RETURNS
+ * void
+ * *************************************************************************/
+void xMemRootSet(void *ptr)
+{
+    if(!xMemPoolBase) return;
+    XMEM_POOL_ROOT=ptr?(uptr)ptr-xMemPoolBase:0;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemRootGet
+ * DESCRIPTION
+ * the object set by xMemRootSet, also after the heap is re-attached or
+ * in another process of a shared heap
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void * root object, NULL if none
+ * *************************************************************************/
+void * xMemRootGet(void)
+{
+    if(!xMemPoolBase||!XMEM_POOL_ROOT) return NULL;
+    return (void *)(xMemPoolBase+XMEM_POOL_ROOT);
+}
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemReserve
+ * DESCRIPTION
+ * make room for count blocks of size ahead of time. a size served by super
+ * blocks gets super blocks with count free slots. blocks of the block list
+ * would merge again once freed, so for them count blocks are allocated,
+ * their pages faulted in and freed, which checks that they fit
+ * PARAMETERS
+ * size     [IN]    block size that will be required
+ * count    [IN]    number of blocks
+ * RETURNS
+ * int 0-success, -1-they do not fit
+ * *************************************************************************/
+int xMemReserve(size_t size,unsigned int count)
+{
+    void * ptr,*list=NULL;
+    int ret=0;
+    #if XMEM_SUPERBLOCK_ENABLE
+    int i;
+    #endif
+
+    if(size==0||size>XMEM_POOL_SIZE) return -1;
+
+    SYS_ENTER_CRITICAL_SECTION;
+
+    if(!xmem_init_flag){
+        xMemInit();
+    }
+    size+=XMEM_CANARY_SIZE;
+
+    #if XMEM_SUPERBLOCK_ENABLE
+    i=xMemMetaClassGet(size);
+    if(i>=0)
+    {
+        ret=xMemSuperBlockReserve(&xMemSuperBlockList[i],count);
+        SYS_EXIT_CRITICAL_SECTION;
+        return ret;
+    }
+    #endif
+
+    //the blocks are chained through their first word until they are freed
+    if(size<sizeof(void *)) size=sizeof(void *);
+    while(count--)
+    {
+        ptr=xMemBlockAlloc(size);
+        if(ptr==NULL)
+        {
+            ret=-1;
+            break;
+        }
+        xMemPoolTouch(ptr,size);
+        *(void **)ptr=list;
+        list=ptr;
+    }
+    while(list)
+    {
+        ptr=list;
+        list=*(void **)ptr;
+        xMemBlockFree(ptr);
+    }
+
+    SYS_EXIT_CRITICAL_SECTION;
+    return ret;
+}
+
+#if XMEM_MAINT_ENABLE
+static pthread_t xMemMaintThread;
+static pthread_mutex_t xMemMaintLock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t xMemMaintCond=PTHREAD_COND_INITIALIZER;
+static u32 xMemMaintInterval=0;     //ms between passes, 0 if the thread is not running
+
+/***************************************************************************
+ * FUNCTION
+ * xMemMaintNow
+ * DESCRIPTION
+ * monotonic time for the time slice of a pass
+ * PARAMETERS
+ * void
+ * RETURNS
+ * u64 microseconds
+ * *************************************************************************/
+static u64 xMemMaintNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (u64)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+#if XMEM_SUPERBLOCK_ENABLE
+/***************************************************************************
+ * FUNCTION
+ * xMemSuperBlockBalance
+ * DESCRIPTION
+ * free the empty super blocks of a list over XMEM_SUPERBLOCK_KEEP as long
+ * as XMEM_MAINT_SPARE free slots are left, or add super blocks up to them
+ * PARAMETERS
+ * superblocklist   [IN/OUT]    super block list
+ * RETURNS
+ * u32 number of super blocks freed or added
+ * *************************************************************************/
+static u32 xMemSuperBlockBalance(xMemSuperBlock * superblocklist)
+{
+    xMemSuperBlock * pmem,*pmemprev;
+    u32 nfree=0,nempty,n=0;
+
+    if(superblocklist->blksize==0) return 0;
+    for(pmem=superblocklist;pmem;pmem=pmem->next) nfree+=pmem->nfree;
+
+    if(nfree<XMEM_MAINT_SPARE)
+    {
+        for(pmem=superblocklist->next;pmem;pmem=pmem->next) n--;
+        xMemSuperBlockReserve(superblocklist,XMEM_MAINT_SPARE);
+        for(pmem=superblocklist->next;pmem;pmem=pmem->next) n++;
+        return n;
+    }
+
+    nempty=xMemSuperBlockEmptyCount(superblocklist);
+    pmemprev=superblocklist;
+    while(nempty>XMEM_SUPERBLOCK_KEEP&&(pmem=pmemprev->next)!=NULL)
+    {
+        if(pmem->nfree==pmem->nblk&&nfree-pmem->nfree>=XMEM_MAINT_SPARE)
+        {
+            nfree-=pmem->nfree;
+            nempty--;
+            xMemSuperBlockRelease(pmemprev,pmem);
+            n++;
+        }
+        else
+        {
+            pmemprev=pmem;
+        }
+    }
+    return n;
+}
+#endif
+
+/***************************************************************************
+ * FUNCTION
+ * xMemMaintTrim
+ * DESCRIPTION
+ * give the whole pages inside free blocks back to the OS, at most
+ * XMEM_MAINT_STEP blocks from where the last step stopped. the headers
+ * are kept, the pages come back zero filled when the blocks are used
+ * PARAMETERS
+ * more     [OUT]   1 if blocks are left for the next step, 0 at the end of the list
+ * RETURNS
+ * u32 number of blocks trimmed
+ * *************************************************************************/
+static u32 xMemMaintTrim(u8 *more)
+{
+    pxMemBlock blk;
+    uptr start,end;
+    u32 i,n=0;
+
+    SYS_ENTER_CRITICAL_SECTION;
+    blk=xMemMaintCursor;
+    if(blk==NULL)
+    {
+        blk=xMemBlkList;
+        #if XMEM_HEADER_PROTECT_ENABLE
+        //the gap between the header pages and the blocks is free as well
+        start=(xMemMgrHdrListEnd+XMEM_PAGE_SIZE-1)&~(uptr)(XMEM_PAGE_SIZE-1);
+        end=xMemBlkPoolStart&~(uptr)(XMEM_PAGE_SIZE-1);
+        if(end>start&&end-start>=XMEM_MAINT_TRIM_MIN)
+        {
+            xMemPageRelease((void *)start,end-start);
+            n++;
+        }
+        #endif
+    }
+    for(i=0;blk&&i<XMEM_MAINT_STEP;i++,blk=blk->next)
+    {
+        if(blk->free!=XMEM_BLOCK_FREE||blk->blksize<XMEM_MAINT_TRIM_MIN) continue;
+
+        start=(uptr)XMEM_BLOCK_ADDR(blk);
+        end=(start+blk->blksize)&~(uptr)(XMEM_PAGE_SIZE-1);
+        start=(start+XMEM_PAGE_SIZE-1)&~(uptr)(XMEM_PAGE_SIZE-1);
+        if(end>start)
+        {
+            xMemPageRelease((void *)start,end-start);
+            n++;
+        }
+    }
+    xMemMaintCursor=blk;
+    *more=blk!=NULL;
+    SYS_EXIT_CRITICAL_SECTION;
+    return n;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemMaintain
+ * DESCRIPTION
+ * one maintenance pass: merge the quick list, free what the epochs allow,
+ * balance the super block lists and trim the pages of free blocks. the lock is taken for each
+ * step, the pass stops once XMEM_MAINT_SLICE_US are used, the next pass
+ * goes on where it stopped
+ * PARAMETERS
+ * void
+ * RETURNS
+ * unsigned int number of things done, 0 if there was nothing to do
+ * *************************************************************************/
+unsigned int xMemMaintain(void)
+{
+    u64 deadline;
+    u32 n=0;
+    u8 more;
+    #if XMEM_SUPERBLOCK_ENABLE
+    u32 i;
+    #endif
+
+    if(!xmem_init_flag) return 0;
+    deadline=xMemMaintNow()+XMEM_MAINT_SLICE_US;
+
+    #if XMEM_DEFER_COALESCE_ENABLE
+    SYS_ENTER_CRITICAL_SECTION;
+    if(xMemQuickCount)
+    {
+        xMemBlockCoalesce();
+        n++;
+    }
+    SYS_EXIT_CRITICAL_SECTION;
+    #endif
+
+    #if XMEM_EPOCH_ENABLE
+    //retired blocks do not wait for the next xfree_deferred
+    SYS_ENTER_CRITICAL_SECTION;
+    n+=xMemEpochAdvance();
+    SYS_EXIT_CRITICAL_SECTION;
+    #endif
+
+    #if XMEM_SUPERBLOCK_ENABLE
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT&&xMemMaintNow()<deadline;i++)
+    {
+        SYS_ENTER_CRITICAL_SECTION;
+        n+=xMemSuperBlockBalance(&xMemSuperBlockList[i]);
+        SYS_EXIT_CRITICAL_SECTION;
+    }
+    #endif
+
+    //the cursor is only read inside the lock, xfree may move it
+    do{
+        n+=xMemMaintTrim(&more);
+    }while(more&&xMemMaintNow()<deadline);
+
+    return n;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemMaintWorker
+ * DESCRIPTION
+ * thread of xMemMaintStart, a pass every interval until xMemMaintStop
+ * PARAMETERS
+ * arg      [IN]    not used
+ * RETURNS
+ * void * NULL
+ * *************************************************************************/
+static void * xMemMaintWorker(void *arg)
+{
+    struct timespec ts;
+
+    (void)arg;
+
+    pthread_mutex_lock(&xMemMaintLock);
+    while(xMemMaintInterval)
+    {
+        pthread_mutex_unlock(&xMemMaintLock);
+        xMemMaintain();
+        pthread_mutex_lock(&xMemMaintLock);
+
+        clock_gettime(CLOCK_REALTIME,&ts);
+        ts.tv_sec+=xMemMaintInterval/1000;
+        ts.tv_nsec+=(long)(xMemMaintInterval%1000)*1000000;
+        if(ts.tv_nsec>=1000000000)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec-=1000000000;
+        }
+        if(xMemMaintInterval) pthread_cond_timedwait(&xMemMaintCond,&xMemMaintLock,&ts);
+    }
+    pthread_mutex_unlock(&xMemMaintLock);
+    return NULL;
 }
 
 /***************************************************************************
  * FUNCTION
- * xMemSuperBlockAppend
+ * xMemMaintStart
  * DESCRIPTION
- * Append a new super block
+ * run xMemMaintain from a thread of its own
  * PARAMETERS
- * psuperblock  [IN/OUT] super block list
+ * interval_ms  [IN]    time between passes
  * RETURNS
- * xMemSuperBlock *  new super block
+ * int 0-success, -1-already running or no thread
  * *************************************************************************/
-static xMemSuperBlock * xMemSuperBlockAppend(xMemSuperBlock * superblocklist)
+int xMemMaintStart(unsigned int interval_ms)
 {
-    xMemSuperBlock * pmemtail,*pmemnew=NULL;
-    void *blk;
+    int ret=-1;
 
-    pmemtail=superblocklist;
-    while(pmemtail->next) pmemtail=pmemtail->next;
-    #if XMEM_BOUNDRY_CHECK_ENABLE
-    pmemnew=(xMemSuperBlock *)xMemBlockAlloc(XMEM_LIST_TYPE_SUPERBLOCK);
-    #else
-    pmemnew=(xMemSuperBlock *)xMemMgrHdrGet(XMEM_LIST_TYPE_SUPERBLOCK);
-    #endif
-    if(pmemnew)
+    if(interval_ms==0) interval_ms=1;
+
+    pthread_mutex_lock(&xMemMaintLock);
+    if(xMemMaintInterval==0)
     {
-        blk=xMemBlockAlloc(superblocklist->blksize*(superblocklist->nblk/2));
-        if(blk)
-        {
-            xMemSuperBlockInit(pmemnew,blk,(superblocklist->nblk/2),superblocklist->blksize);
-            pmemtail->next=pmemnew;
-        }else
-        {
-            #if XMEM_BOUNDRY_CHECK_ENABLE
-            xMemBlockFree(pmemnew);
-            #else
-            xMemMgrHdrPut(pmemnew);
-            #endif
-            pmemnew=NULL;
-        }
+        xMemMaintInterval=interval_ms;
+        if(pthread_create(&xMemMaintThread,NULL,xMemMaintWorker,NULL)==0) ret=0;
+        else xMemMaintInterval=0;
     }
-    return pmemnew;
+    pthread_mutex_unlock(&xMemMaintLock);
+    return ret;
 }
 
 /***************************************************************************
  * FUNCTION
- * xMemSuperBlockListInit
+ * xMemMaintStop
  * DESCRIPTION
- * Init super block list
+ * stop the thread of xMemMaintStart, waits for the pass it is running
  * PARAMETERS
  * void
  * RETURNS
  * void
  * *************************************************************************/
-static void xMemSuperBlockListInit(void)
+void xMemMaintStop(void)
 {
-    void * blk;
-    #if XMEM_8META_ENABLE
-    blk=xMemBlockAlloc(XMEM_SUPERBLOCK_1META_MIN_SIZE+XMEM_SUPERBLOCK_2META_MIN_SIZE+XMEM_SUPERBLOCK_4META_MIN_SIZE+XMEM_SUPERBLOCK_8META_MIN_SIZE);
-    #else
-    blk=xMemBlockAlloc(XMEM_SUPERBLOCK_1META_MIN_SIZE+XMEM_SUPERBLOCK_2META_MIN_SIZE+XMEM_SUPERBLOCK_4META_MIN_SIZE);
-    #endif
-    if(blk)
-    {
-        xMemSuperBlockInit(&xMemSuperBlockList[0],
-                blk,
-                XMEM_SUPERBLOCK_1META_CNT,
-                XMEM_META_BLOCK_SIZE);
-        xMemSuperBlockInit(&xMemSuperBlockList[1],
-                blk+XMEM_SUPERBLOCK_1META_MIN_SIZE,
-                XMEM_SUPERBLOCK_2META_CNT,
-                XMEM_2META_BLOCK_SIZE);
-        xMemSuperBlockInit(&xMemSuperBlockList[2],
-                blk+XMEM_SUPERBLOCK_1META_MIN_SIZE+XMEM_SUPERBLOCK_2META_MIN_SIZE,
-                XMEM_SUPERBLOCK_4META_CNT,
-                XMEM_4META_BLOCK_SIZE);
-        #if XMEM_8META_ENABLE
-        xMemSuperBlockInit(&xMemSuperBlockList[3],
-                blk+XMEM_SUPERBLOCK_1META_MIN_SIZE+XMEM_SUPERBLOCK_2META_MIN_SIZE+XMEM_SUPERBLOCK_4META_MIN_SIZE,
-                XMEM_SUPERBLOCK_8META_CNT,
-                XMEM_8META_BLOCK_SIZE);
-        #endif
+    pthread_mutex_lock(&xMemMaintLock);
+    if(xMemMaintInterval==0)
+    {
+        pthread_mutex_unlock(&xMemMaintLock);
+        return;
     }
+    xMemMaintInterval=0;
+    pthread_cond_signal(&xMemMaintCond);
+    pthread_mutex_unlock(&xMemMaintLock);
+    pthread_join(xMemMaintThread,NULL);
 }
-
-static const char xMemDumpMsgSuperBblock[]="-----SuperBlock Info-----\n";
-static const char xMemDumpFmtSuperBlock[]="size:%d,free:%d,total:%d\n";
+#endif
 
 /***************************************************************************
  * FUNCTION
- * xMemSuperBlockInfoDump
+ * xMemPolicySet
  * DESCRIPTION
- * Dump super block lists information
+ * select how xmalloc places a block in the block list
  * PARAMETERS
- * void
+ * policy   [IN]    XMEM_FIT_FIRST, XMEM_FIT_NEXT or XMEM_FIT_BEST
  * RETURNS
  * void
  * *************************************************************************/
-static void xMemSuperBlockInfoDump(void)
+void xMemPolicySet(int policy)
 {
-    u8 i;
+    if(policy!=XMEM_FIT_FIRST&&policy!=XMEM_FIT_NEXT&&policy!=XMEM_FIT_BEST) return;
 
-    xMemSuperBlock * psuperblock;
-    xMemPrintf(xMemDumpMsgSuperBblock);
-    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
-    {
-        psuperblock=&xMemSuperBlockList[i];
-        while(psuperblock)
-        {
-            xMemPrintf(xMemDumpFmtSuperBlock,psuperblock->blksize,psuperblock->nfree,psuperblock->nblk);
-            psuperblock=psuperblock->next;
-        }
-    }
-    xMemPrintf(xMemDumpMsgSuperBblock);
+    SYS_ENTER_CRITICAL_SECTION;
+    xMemFitPolicy=policy;
+    xMemFitRover=NULL;
+    SYS_EXIT_CRITICAL_SECTION;
 }
 
 /***************************************************************************
  * FUNCTION
- * xMallocMetaBlockGet
+ * xMemFragInfoGet
  * DESCRIPTION
- * Get a meta block
+ * get free space of the block list, deferred blocks count as free and the
+ * gap between headers and blocks counts as one free block
  * PARAMETERS
- * superblocklist   [IN/OUT]    super block list
- * size             [IN]    Meta block size required
+ * info     [OUT]   fragmentation information
  * RETURNS
- * void * meta block
+ * void
  * *************************************************************************/
-static void * xMallocMetaBlockGet(xMemSuperBlock * superblocklist,size_t size)
+void xMemFragInfoGet(xMemFragInfo *info)
 {
-    u32 i;
-    void      *pblk;
-    xMemSuperBlock *pmemiter;
-    
-    if (superblocklist == NULL||size>superblocklist->blksize)    return NULL;
+    pxMemBlock blk;
 
-    pmemiter=superblocklist;
+    memset(info,0,sizeof(xMemFragInfo));
 
-    while(pmemiter)
+    SYS_ENTER_CRITICAL_SECTION;
+    for(blk=xMemBlkList;blk;blk=blk->next)
     {
-        if (pmemiter->nfree > 0)
+        if(blk->free==XMEM_BLOCK_USED)
         {
-            break;
+            info->usedblocks++;
+            continue;
         }
-        
-        pmemiter=pmemiter->next;
+        info->freeblocks++;
+        info->freebytes+=blk->blksize;
+        if(blk->blksize>info->largest) info->largest=blk->blksize;
     }
-    
-    if(pmemiter==NULL)pmemiter=xMemSuperBlockAppend(superblocklist);
-
-    if(pmemiter)
+    #if XMEM_HEADER_PROTECT_ENABLE
+    if(xMemBlkPoolStart>xMemMgrHdrListEnd)
     {
-        for(i=0;i<pmemiter->nblk;i++)
-        {
-           if((1<<i)&(pmemiter->freeList))
-           {
-              pmemiter->freeList&=(~(1<<i));
-              break;
-           }
-        }
-        xMemAssert(i<pmemiter->nblk);
-        pblk = (void *)(pmemiter->addr+i*(u32)(pmemiter->blksize));
-        //xMemPrintf("get %u\n",pblk);
-        pmemiter->nfree--;        
-        return (pblk);
+        info->freeblocks++;
+        info->freebytes+=xMemBlkPoolStart-xMemMgrHdrListEnd;
+        if(xMemBlkPoolStart-xMemMgrHdrListEnd>info->largest) info->largest=xMemBlkPoolStart-xMemMgrHdrListEnd;
     }
-                
-    return NULL;   
-
+    #endif
+    SYS_EXIT_CRITICAL_SECTION;
 }
 
 /***************************************************************************
  * FUNCTION
- * xMallocMetaBlockPut
+ * xMemSnapshotInit
  * DESCRIPTION
- * put a meta block
+ * give a snapshot its entry storage, which must not come from the pool
+ * being inspected
  * PARAMETERS
- * superblocklist   [IN/OUT]    super block list
- * pblk             [IN]    meta block be put
+ * snap         [OUT]   snapshot
+ * entries      [IN]    entry storage
+ * maxentries   [IN]    number of entries in the storage
  * RETURNS
  * void
  * *************************************************************************/
-static void  xMallocMetaBlockPut (xMemSuperBlock  *superblocklist, void *pblk)
+void xMemSnapshotInit(xMemSnapshot *snap,xMemSnapEntry *entries,unsigned int maxentries)
 {
-    u8 i;
-
-    if (superblocklist == NULL||pblk == NULL||superblocklist->nfree >= superblocklist->nblk)  return ;
-
-    i=(u32)(pblk-superblocklist->addr)/superblocklist->blksize;
-    superblocklist->freeList|=(1<<i);
-    superblocklist->nfree++;
-    return;
+    memset(snap,0,sizeof(xMemSnapshot));
+    snap->entries=entries;
+    snap->maxentries=maxentries;
 }
 
 /***************************************************************************
  * FUNCTION
- * xMallocMetaBlockAlloc
+ * xMemSnapshotAdd
  * DESCRIPTION
- * Allocate a meta block
+ * count live blocks in the entry of their tag and size class, entries
+ * stay sorted by tag then size class
  * PARAMETERS
- * size     [IN]    meta block size that required
+ * snap     [IN/OUT]    snapshot
+ * tag      [IN]        allocation tag
+ * size     [IN]        usable size of each block
+ * n        [IN]        number of blocks
  * RETURNS
- * void * meta block
+ * void
  * *************************************************************************/
-static void * xMallocMetaBlockAlloc(size_t size)
+static void xMemSnapshotAdd(xMemSnapshot *snap,u16 tag,u32 size,u32 n)
 {
-    void * ptr;
+    xMemSnapEntry * e;
+    u32 key,lo,hi,mid;
+    u16 sizeclass;
 
-    #if XMEM_8META_ENABLE
-    if(size>XMEM_4META_BLOCK_SIZE)
-    {
-        ptr=xMallocMetaBlockGet(&xMemSuperBlockList[3],size);
-    }
-    else
-    #endif
-    if(size>XMEM_2META_BLOCK_SIZE)
-    {
-        ptr=xMallocMetaBlockGet(&xMemSuperBlockList[2],size);
-    }
-    else if(size>XMEM_META_BLOCK_SIZE)
-    {
-        ptr=xMallocMetaBlockGet(&xMemSuperBlockList[1],size);
-    }
-    else if(size>0)
-    {
-        ptr=xMallocMetaBlockGet(&xMemSuperBlockList[0],size);
-    }
-    else
-    {
-        return NULL;
-    }
+    sizeclass=size>1?32-__builtin_clz(size-1):0;
+    key=((u32)tag<<16)|sizeclass;
 
-    if(ptr==NULL)
+    lo=0;
+    hi=snap->nentries;
+    while(lo<hi)
     {
-        xMemSuperBlockInfoDump();
+        mid=(lo+hi)/2;
+        e=&snap->entries[mid];
+        if((((u32)e->tag<<16)|e->sizeclass)<key) lo=mid+1;
+        else hi=mid;
     }
 
-    return ptr;
-}
-
-/***************************************************************************
- * FUNCTION
- * xMemMetaBlockFree
- * DESCRIPTION
- * free a meta block
- * PARAMETERS
- * pblk     [IN] meta block be free
- * RETURNS
- * u8 0-success, 1-failure
- * *************************************************************************/
-static u8 xMemMetaBlockFree(void * pblk)
-{
-    int i;
-    u32 start,end,p;
-    xMemSuperBlock  *pmem,*pmemprev=NULL;
-
-    if (pblk == NULL)   return 0;
-
-    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
+    e=&snap->entries[lo];
+    if(lo==snap->nentries||e->tag!=tag||e->sizeclass!=sizeclass)
     {
-        pmem=&xMemSuperBlockList[i];
-        while(pmem)
+        if(snap->nentries>=snap->maxentries)
         {
-            p=(u32)pblk;
-            start=(u32)pmem->addr;
-            end=start+pmem->blksize*pmem->nblk;
-            if(p>=start&&p<end)
-            {
-                xMallocMetaBlockPut(pmem,pblk);
-                if(pmem->nfree==pmem->nblk&&pmemprev)
-                {
-                    pmemprev->next=pmem->next;
-                    xMemBlockFree(pmem->addr);
-                    xMemBlockFree(pmem);
-                }
-                return 0;
-            }
-            pmemprev=pmem;
-            pmem=pmem->next;        
+            snap->dropped+=n;
+            return;
         }
+        memmove(e+1,e,(snap->nentries-lo)*sizeof(xMemSnapEntry));
+        snap->nentries++;
+        e->tag=tag;
+        e->sizeclass=sizeclass;
+        e->count=0;
+        e->bytes=0;
     }
-    return 1;
+    e->count+=n;
+    e->bytes+=size*n;
+    snap->usedblocks+=n;
+    snap->usedbytes+=size*n;
 }
-#endif
-static u8 xmem_init_flag=0;
 
 /***************************************************************************
  * FUNCTION
- * xMemInit
+ * xMemSnapshotTake
  * DESCRIPTION
- * Init X-Memory Pool
+ * count the live blocks of the pool by tag and size class, a super block
+ * counts its used slots instead of the block that holds them
  * PARAMETERS
- * void
+ * snap     [IN/OUT]    snapshot set up by xMemSnapshotInit
  * RETURNS
- * void
+ * int 0-success, -1-some blocks did not fit in the entries
  * *************************************************************************/
-void xMemInit(void)
+int xMemSnapshotTake(xMemSnapshot *snap)
 {
-    xMemPrintf("xMem Version: %s\n",XMEM_VER);
-    xMemAssert(XMEM_POOL_END-XMEM_POOL_START>=XMEM_POOL_SIZE);
-    #if defined(__MT7681)
-    __OS_Heap_Start += XMEM_POOL_SIZE;//reserve space for other using
+    pxMemBlock blk;
+    #if XMEM_SUPERBLOCK_ENABLE
+    xMemSuperBlock * psuperblock;
+    int i;
     #endif
 
-    #if XMEM_HEADER_PROTECT_ENABLE
-    xMemMgrHdrListInit();
-    #endif
+    SYS_ENTER_CRITICAL_SECTION;
+    snap->nentries=0;
+    snap->dropped=0;
+    snap->usedblocks=0;
+    snap->usedbytes=0;
 
-    xMemBlockListInit();
+    for(blk=xMemBlkList;blk;blk=blk->next)
+    {
+        if(blk->free!=XMEM_BLOCK_USED) continue;
+        #if XMEM_SIZE_MAP
+        //the first slot of a super block is marked in the size map
+        if(XMEM_SIZE_MAP_BIT(XMEM_SIZE_MAP_UNIT(XMEM_BLOCK_ADDR(blk)))) continue;
+        #elif XMEM_SUPERBLOCK_ENABLE
+        if(xMemSuperBlockFind(XMEM_BLOCK_ADDR(blk))) continue;
+        #endif
+        #if XMEM_TAG_ENABLE
+        xMemSnapshotAdd(snap,XMEM_BLOCK_TAG(blk),blk->blksize,1);
+        #else
+        xMemSnapshotAdd(snap,0,blk->blksize,1);
+        #endif
+    }
 
     #if XMEM_SUPERBLOCK_ENABLE
-    xMemSuperBlockListInit();
+    for(i=0;i<XMEM_SUPERBLOCK_LIST_COUNT;i++)
+    {
+        for(psuperblock=&xMemSuperBlockList[i];psuperblock;psuperblock=psuperblock->next)
+        {
+            if(psuperblock->nblk>psuperblock->nfree)
+                xMemSnapshotAdd(snap,0,psuperblock->blksize,psuperblock->nblk-psuperblock->nfree);
+        }
+    }
     #endif
+    SYS_EXIT_CRITICAL_SECTION;
 
-    xmem_init_flag=1;    
-    return;
+    return snap->dropped?-1:0;
 }
 
 /***************************************************************************
  * FUNCTION
- * xmalloc
+ * xMemSnapshotDiff
  * DESCRIPTION
- * allocate a memory block
+ * entries whose count or bytes changed from one snapshot to a later one
  * PARAMETERS
- * size     [IN]    block size that required
+ * from     [IN]    earlier snapshot
+ * to       [IN]    later snapshot
+ * out      [OUT]   changes, count and bytes are to minus from
+ * maxout   [IN]    number of entries in out
  * RETURNS
- * void * memory block address
+ * unsigned int number of entries written to out
  * *************************************************************************/
-void * xmalloc(size_t size)
+unsigned int xMemSnapshotDiff(const xMemSnapshot *from,const xMemSnapshot *to,xMemSnapEntry *out,unsigned int maxout)
 {
-    SYS_ENTER_CRITICAL_SECTION;
-
-    if(!xmem_init_flag){
-        xMemInit();
-    }
-
-    #if XMEM_BOUNDRY_CHECK_ENABLE
-    xMemBlockListCheck();
-    #endif
+    const xMemSnapEntry * a,* b;
+    u32 i=0,j=0,n=0,ka,kb;
 
-    #if XMEM_SUPERBLOCK_ENABLE
-    #if XMEM_8META_ENABLE
-    if(size<=XMEM_8META_BLOCK_SIZE)
-    #else
-    if(size<=XMEM_4META_BLOCK_SIZE)
-    #endif
+    while((i<from->nentries||j<to->nentries)&&n<maxout)
     {
-        return xMallocMetaBlockAlloc(size);
-    }else{
-    #endif
-        return xMemBlockAlloc(size);
-    #if XMEM_SUPERBLOCK_ENABLE
-    }
-    #endif
+        a=i<from->nentries?&from->entries[i]:NULL;
+        b=j<to->nentries?&to->entries[j]:NULL;
+        ka=a?((u32)a->tag<<16)|a->sizeclass:0xFFFFFFFF;
+        kb=b?((u32)b->tag<<16)|b->sizeclass:0xFFFFFFFF;
 
-    SYS_EXIT_CRITICAL_SECTION;
+        if(ka<kb)
+        {
+            out[n]=*a;
+            out[n].count=-a->count;
+            out[n].bytes=-a->bytes;
+            n++;
+            i++;
+        }
+        else if(kb<ka)
+        {
+            out[n++]=*b;
+            j++;
+        }
+        else
+        {
+            if(a->count!=b->count||a->bytes!=b->bytes)
+            {
+                out[n]=*b;
+                out[n].count=b->count-a->count;
+                out[n].bytes=b->bytes-a->bytes;
+                n++;
+            }
+            i++;
+            j++;
+        }
+    }
+    return n;
 }
 
+static const char xMemDumpFmtSnapshot[]="tag:%u,size:%u-%u,count:%d,bytes:%d\n";
+
 /***************************************************************************
  * FUNCTION
- * xfree
+ * xMemSnapshotDump
  * DESCRIPTION
- * free a memory block
+ * print the entries of a snapshot or of a diff
  * PARAMETERS
- * void *       [IN]    memory block pointer
+ * entries  [IN]    entries
+ * n        [IN]    number of entries
  * RETURNS
  * void
  * *************************************************************************/
-void xfree(void *ptr)
+void xMemSnapshotDump(const xMemSnapEntry *entries,unsigned int n)
 {
-    SYS_ENTER_CRITICAL_SECTION;
-
-    #if XMEM_BOUNDRY_CHECK_ENABLE
-    xMemBlockListCheck();
-    #endif
-
-    if(
-        #if XMEM_SUPERBLOCK_ENABLE
-        xMemMetaBlockFree(ptr)&&
-        #endif
-        xMemBlockFree(ptr))
-    {//Meta block first, then common block, avoid super block start addr equals common block start addr
+    u32 i,lo;
 
-        xMemPrintf("prt:%u\n",(u32)ptr);
-        xMemSuperBlockInfoDump();
+    for(i=0;i<n;i++)
+    {
+        lo=entries[i].sizeclass?((u32)1<<(entries[i].sizeclass-1))+1:0;
+        xMemPrintf(xMemDumpFmtSnapshot,entries[i].tag,lo,
+                   entries[i].sizeclass<32?(u32)1<<entries[i].sizeclass:0xFFFFFFFF,entries[i].count,entries[i].bytes);
     }
-
-    SYS_EXIT_CRITICAL_SECTION;
-    return;
 }
 
+static const char xMemDumpFmtFrag[]="free:%u,largest:%u,free blocks:%u,used blocks:%u,fragmentation:%u%%\n";
+#if XMEM_TAG_ENABLE
+static const char xMemDumpFmtTag[]="tag:%u,bytes:%u,count:%u,peak:%u,quota:%u,failed:%u\n";
+#endif
+
 /***************************************************************************
  * FUNCTION
  * xMemInfoDump
@@ -1071,16 +5950,35 @@ void xfree(void *ptr)
  * *************************************************************************/
 void xMemInfoDump(void)
 {
+    xMemFragInfo frag;
+    #if XMEM_TAG_ENABLE
+    xMemTagInfo * info;
+    u32 i;
+    #endif
+
     #if XMEM_HEADER_PROTECT_ENABLE
-    xMemPrintf("hdr end:%u,blk start:%u\n",xMemMgrHdrListEnd,xMemBlkPoolStart);
+    xMemPrintf("hdr end:%p,blk start:%p\n",(void *)xMemMgrHdrListEnd,(void *)xMemBlkPoolStart);
     xMemMgrHdrListInfoDump();
     #endif
 
     xMemBlockListInfoDump();
 
+    xMemFragInfoGet(&frag);
+    xMemPrintf(xMemDumpFmtFrag,frag.freebytes,frag.largest,frag.freeblocks,frag.usedblocks,
+               frag.freebytes?100-(u32)((u64)frag.largest*100/frag.freebytes):0);
+
     #if XMEM_SUPERBLOCK_ENABLE
     xMemSuperBlockInfoDump();
     #endif
 
+    #if XMEM_TAG_ENABLE
+    for(i=1;i<XMEM_TAG_MAX;i++)
+    {
+        info=&xMemTagTable[i];
+        if(info->count||info->peak||info->quota||info->failed)
+            xMemPrintf(xMemDumpFmtTag,i,info->bytes,info->count,info->peak,info->quota,info->failed);
+    }
+    #endif
+
     xMemPrintf("\n");
 }
@@ -0,0 +1,159 @@
+#ifndef __XMEM_H__
+#define __XMEM_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void xMemInit(void);
+void * xmalloc(size_t size);
+void xfree(void *ptr);
+void * xrealloc(void *ptr, size_t size);
+void xfree_sized(void *ptr, size_t size);
+void xfree_batch(void **ptrs, unsigned int n);
+void * xmalloc_aligned(size_t size, size_t align);
+void xfree_aligned_sized(void *ptr, size_t size, size_t align);
+size_t xmalloc_usable_size(void *ptr);
+size_t xmalloc_good_size(size_t size);
+int xMemOwns(const void *ptr);
+void xMemInfoDump(void);
+
+#define XMEM_FIT_FIRST  0
+#define XMEM_FIT_NEXT   1
+#define XMEM_FIT_BEST   2
+
+typedef struct{
+    unsigned int freebytes;
+    unsigned int largest;
+    unsigned int freeblocks;
+    unsigned int usedblocks;
+}xMemFragInfo;
+
+typedef struct{
+    unsigned int bytes;             //block bytes held by the tag
+    unsigned int count;             //blocks held by the tag
+    unsigned int peak;              //largest bytes since xMemReset
+    unsigned int quota;             //bytes the tag may hold, 0 for no limit
+    unsigned int failed;            //requests refused by the quota
+}xMemTagInfo;
+
+void * xmalloc_tag(size_t size, unsigned int tag);
+void xMemTagQuotaSet(unsigned int tag, size_t quota);
+int xMemTagInfoGet(unsigned int tag, xMemTagInfo *info);
+
+#define XMEM_PRESSURE_NONE  0
+#define XMEM_PRESSURE_LOW   1       //free space is below the watermark
+#define XMEM_PRESSURE_OOM   2       //a request is about to fail
+
+/* returns the bytes it released, 0 if it had nothing to give back */
+typedef size_t (*xMemPressureFunc)(int level, size_t size, void *arg);
+
+int xMemPressureRegister(xMemPressureFunc func, void *arg);
+void xMemPressureUnregister(xMemPressureFunc func, void *arg);
+void xMemPressureWatermarkSet(size_t freebytes);
+int xMemPressureLevel(void);
+
+void xMemEpochEnter(void);
+void xMemEpochExit(void);
+int xfree_deferred(void *ptr);
+unsigned int xMemEpochReclaim(void);
+
+int xMemReserve(size_t size, unsigned int count);
+unsigned int xMemMaintain(void);
+int xMemMaintStart(unsigned int interval_ms);
+void xMemMaintStop(void);
+void xMemPolicySet(int policy);
+void xMemFragInfoGet(xMemFragInfo *info);
+
+typedef struct{
+    unsigned short tag;             //allocation tag, 0 for untagged blocks
+    unsigned short sizeclass;       //blocks of 2^(sizeclass-1)+1 to 2^sizeclass bytes
+    int count;
+    int bytes;
+}xMemSnapEntry;
+
+typedef struct{
+    xMemSnapEntry * entries;        //sorted by tag then size class, not from the pool
+    unsigned int maxentries;
+    unsigned int nentries;
+    unsigned int dropped;           //blocks that found no free entry
+    unsigned int usedblocks;
+    unsigned int usedbytes;
+}xMemSnapshot;
+
+void xMemSnapshotInit(xMemSnapshot *snap, xMemSnapEntry *entries, unsigned int maxentries);
+int xMemSnapshotTake(xMemSnapshot *snap);
+unsigned int xMemSnapshotDiff(const xMemSnapshot *from, const xMemSnapshot *to, xMemSnapEntry *out, unsigned int maxout);
+void xMemSnapshotDump(const xMemSnapEntry *entries, unsigned int n);
+
+typedef unsigned int xhandle;
+
+xhandle xhalloc(size_t size);
+void * xhlock(xhandle h);
+void xhunlock(xhandle h);
+void xhfree(xhandle h);
+unsigned int xMemCompact(void);
+
+typedef struct{
+    void * chunk;
+    unsigned int used;
+    unsigned int chunksize;
+}xRegion;
+
+typedef struct{
+    void * chunk;
+    unsigned int used;
+}xRegionPos;
+
+void xRegionInit(xRegion *rgn, size_t chunksize);
+void * xRegionAlloc(xRegion *rgn, size_t size);
+void xRegionMark(xRegion *rgn, xRegionPos *pos);
+void xRegionRelease(xRegion *rgn, const xRegionPos *pos);
+void xRegionReset(xRegion *rgn);
+void xMemReset(void);
+
+typedef struct t_xMemCache xMemCache;
+
+xMemCache * xMemCacheCreate(size_t size, size_t align, void (*ctor)(void *obj), void (*dtor)(void *obj));
+void * xMemCacheAlloc(xMemCache *cache);
+void xMemCacheFree(xMemCache *cache, void *obj);
+void xMemCacheShrink(xMemCache *cache);
+void xMemCacheDestroy(xMemCache *cache);
+
+typedef struct t_xbuf{
+    struct t_xbuf * next;           //next buffer of a scatter-gather chain, NULL at the end
+    void * data;                    //first byte of the view
+    size_t len;                     //bytes of the view
+    void * store;                   //allocation shared by the views
+}xbuf;
+
+xbuf * xballoc(size_t size);
+xbuf * xbslice(const xbuf *chain, size_t off, size_t len);
+xbuf * xbchain(xbuf *head, xbuf *tail);
+size_t xblength(const xbuf *chain);
+size_t xbgather(const xbuf *chain, size_t off, void *dst, size_t len);
+void xbfree(xbuf *chain);
+
+void xMemProfileStart(size_t interval);
+void xMemProfileStop(void);
+int xMemProfileDump(const char *path);
+
+int xMemTuneDump(const char *path);
+
+int xMemFileOpen(const char *path, void *addr);
+void xMemFileClose(void);
+int xMemSharedOpen(const char *name, void *addr);
+int xMemSharedOpenFd(int fd, void *addr);
+void xMemSharedClose(void);
+size_t xMemPtrToOffset(const void *ptr);
+void * xMemOffsetToPtr(size_t offset);
+void xMemRootSet(void *ptr);
+void * xMemRootGet(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __XMEM_H__
@@ -0,0 +1,153 @@
+#ifndef __XMEM_HPP__
+#define __XMEM_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <memory_resource>
+#include "xconfig.h"
+#include "xmem.h"
+
+/***************************************************************************
+ * C++ adapters of xmem
+ *
+ * xmem::heap_resource   std::pmr::memory_resource over xmalloc/xfree
+ * xmem::region_resource std::pmr::memory_resource over an xRegion, frees
+ *                       nothing until release()
+ * xmem::allocator<T>    std::allocator compatible, keeps the resource it
+ *                       allocates from
+ *
+ * Deallocation passes the size and alignment back to xmem, so xfree_sized
+ * only searches the super block list of that size. xmem is not locked by
+ * itself, share a resource between threads only if SYS_ENTER_CRITICAL_SECTION
+ * is implemented.
+ * *************************************************************************/
+
+namespace xmem {
+
+class heap_resource : public std::pmr::memory_resource {
+protected:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        void * ptr = xmalloc_aligned(bytes ? bytes : 1, alignment);
+
+        if (ptr == nullptr) throw std::bad_alloc();
+        return ptr;
+    }
+
+    void do_deallocate(void * ptr, std::size_t bytes, std::size_t alignment) override
+    {
+        xfree_aligned_sized(ptr, bytes ? bytes : 1, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+    {
+        //there is only one pool, any heap_resource can free what another allocated
+        return dynamic_cast<const heap_resource *>(&other) != nullptr;
+    }
+};
+
+// the resource xmem::allocator uses by default
+inline heap_resource * heap() noexcept
+{
+    static heap_resource resource;
+    return &resource;
+}
+
+#if XMEM_REGION_ENABLE
+class region_resource : public std::pmr::memory_resource {
+public:
+    explicit region_resource(std::size_t chunksize = 0) noexcept
+    {
+        xRegionInit(&rgn, chunksize);
+    }
+
+    region_resource(const region_resource &) = delete;
+    region_resource & operator=(const region_resource &) = delete;
+
+    ~region_resource()
+    {
+        release();
+    }
+
+    // give every chunk back to the pool
+    void release() noexcept
+    {
+        xRegionReset(&rgn);
+    }
+
+protected:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        //region blocks are pointer aligned, pad for stronger alignment
+        std::size_t pad = alignment > sizeof(void *) ? alignment : 0;
+        char * ptr = static_cast<char *>(xRegionAlloc(&rgn, bytes + pad));
+
+        if (ptr == nullptr) throw std::bad_alloc();
+        if (pad) ptr += (alignment - reinterpret_cast<std::uintptr_t>(ptr) % alignment) % alignment;
+        return ptr;
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override
+    {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    xRegion rgn;
+};
+#endif
+
+template <class T>
+class allocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    allocator() noexcept : res(heap()) {}
+    explicit allocator(std::pmr::memory_resource * r) noexcept : res(r) {}
+    template <class U>
+    allocator(const allocator<U> & other) noexcept : res(other.resource()) {}
+
+    T * allocate(std::size_t n)
+    {
+        if (n > std::size_t(-1) / sizeof(T)) throw std::bad_array_new_length();
+        return static_cast<T *>(res->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T * ptr, std::size_t n) noexcept
+    {
+        res->deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    std::pmr::memory_resource * resource() const noexcept
+    {
+        return res;
+    }
+
+private:
+    std::pmr::memory_resource * res;
+};
+
+template <class T, class U>
+bool operator==(const allocator<T> & a, const allocator<U> & b) noexcept
+{
+    return a.resource() == b.resource() || a.resource()->is_equal(*b.resource());
+}
+
+template <class T, class U>
+bool operator!=(const allocator<T> & a, const allocator<U> & b) noexcept
+{
+    return !(a == b);
+}
+
+} // namespace xmem
+
+#endif // __XMEM_HPP__
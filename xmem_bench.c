@@ -0,0 +1,588 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "xtypes.h"
+#include "xmem.h"
+
+/***************************************************************************
+ * xmem benchmark
+ *
+ * Runs the standard allocator workloads against xmalloc/xfree and against
+ * the system malloc/free, and reports ops/sec, ns/op percentiles and the
+ * peak footprint. xmem runs once for each placement policy, and reports
+ * the fragmentation of its free space when the live set is released. The
+ * pool mode is a compile time choice, build one binary per mode (see README)
+ * and compare their output.
+ *
+ * usage: xmem_bench [ops] [threads]
+ * *************************************************************************/
+
+#define BENCH_OPS_DEFAULT       200000
+#define BENCH_THREADS_DEFAULT   4
+#define BENCH_THREADS_MAX       16
+#define BENCH_SLOTS_MAX         1024
+#define BENCH_SLOTS_MIN         8
+#define BENCH_QUEUE_SIZE        64
+
+typedef struct{
+    const char * name;
+    void * (*alloc)(size_t size);
+    void (*free)(void *ptr);
+    int xmem;
+    int policy;
+}bench_allocator;
+
+typedef struct{
+    void * ptr;
+    size_t size;
+}bench_slot;
+
+typedef struct{
+    u32 * lat;
+    size_t nlat;
+    size_t cap;
+    size_t fails;
+}bench_record;
+
+typedef struct{
+    const char * workload;
+    double seconds;
+    size_t ops;
+    size_t fails;
+    u32 p50,p90,p99,p999,max;
+    size_t peak;
+}bench_result;
+
+static size_t bench_ops = BENCH_OPS_DEFAULT;
+static int bench_threads = BENCH_THREADS_DEFAULT;
+static size_t bench_slots;
+
+/* xmem is not thread safe unless SYS_ENTER_CRITICAL_SECTION is provided, serialize it here */
+static pthread_mutex_t bench_xmem_lock = PTHREAD_MUTEX_INITIALIZER;
+static int bench_mt = 0;
+
+/* footprint accounting */
+static pthread_mutex_t bench_peak_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t bench_live = 0;
+static size_t bench_live_peak = 0;
+static uintptr_t bench_xmem_lo = 0;
+static uintptr_t bench_xmem_hi = 0;
+static size_t bench_sys_base = 0;
+static size_t bench_sys_peak = 0;
+static int bench_frag = -1;
+
+static void * bench_xmalloc(size_t size)
+{
+    void * ptr;
+
+    if(bench_mt) pthread_mutex_lock(&bench_xmem_lock);
+    ptr = xmalloc(size);
+    if(bench_mt) pthread_mutex_unlock(&bench_xmem_lock);
+    return ptr;
+}
+
+static void bench_xfree(void *ptr)
+{
+    if(bench_mt) pthread_mutex_lock(&bench_xmem_lock);
+    xfree(ptr);
+    if(bench_mt) pthread_mutex_unlock(&bench_xmem_lock);
+}
+
+static const bench_allocator bench_allocators[] = {
+    {"xm-best", bench_xmalloc, bench_xfree, 1, XMEM_FIT_BEST},
+    {"xm-first", bench_xmalloc, bench_xfree, 1, XMEM_FIT_FIRST},
+    {"xm-next", bench_xmalloc, bench_xfree, 1, XMEM_FIT_NEXT},
+    {"malloc", malloc, free, 0, 0},
+};
+
+static size_t bench_sys_inuse(void)
+{
+    #if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+    #else
+    return 0;
+    #endif
+}
+
+static void bench_peak_reset(const bench_allocator *a)
+{
+    bench_live = bench_live_peak = 0;
+    bench_xmem_lo = bench_xmem_hi = 0;
+    bench_sys_peak = 0;
+    bench_frag = -1;
+    if(!a->xmem) bench_sys_base = bench_sys_inuse();
+}
+
+static size_t bench_peak_get(const bench_allocator *a)
+{
+    if(a->xmem) return bench_xmem_hi - bench_xmem_lo;
+    return bench_sys_peak > bench_sys_base ? bench_sys_peak - bench_sys_base : 0;
+}
+
+static void bench_peak_on_alloc(const bench_allocator *a, void *ptr, size_t size)
+{
+    pthread_mutex_lock(&bench_peak_lock);
+    bench_live += size;
+    if(a->xmem)
+    {
+        //xmem footprint is the extent of the pool ever handed out
+        if(bench_xmem_lo == 0 || (uintptr_t)ptr < bench_xmem_lo) bench_xmem_lo = (uintptr_t)ptr;
+        if((uintptr_t)ptr + size > bench_xmem_hi) bench_xmem_hi = (uintptr_t)ptr + size;
+    }
+    else if(bench_live > bench_live_peak)
+    {
+        //sample the system heap only when the live set reaches a new high
+        size_t inuse = bench_sys_inuse();
+        if(inuse > bench_sys_peak) bench_sys_peak = inuse;
+    }
+    if(bench_live > bench_live_peak) bench_live_peak = bench_live;
+    pthread_mutex_unlock(&bench_peak_lock);
+}
+
+static void bench_peak_on_free(size_t size)
+{
+    pthread_mutex_lock(&bench_peak_lock);
+    bench_live -= size;
+    pthread_mutex_unlock(&bench_peak_lock);
+}
+
+static inline u32 bench_rand(u32 *state)
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static void bench_record_init(bench_record *r, size_t cap)
+{
+    r->lat = (u32 *)malloc(cap*sizeof(u32));
+    r->nlat = 0;
+    r->cap = cap;
+    r->fails = 0;
+}
+
+static inline void bench_record_add(bench_record *r, uint64_t ns)
+{
+    if(r->nlat < r->cap) r->lat[r->nlat++] = ns > 0xFFFFFFFFu ? 0xFFFFFFFFu : (u32)ns;
+}
+
+static inline int bench_alloc(const bench_allocator *a, bench_record *r, bench_slot *s, size_t size)
+{
+    uint64_t t0 = bench_now();
+    s->ptr = a->alloc(size);
+    bench_record_add(r, bench_now() - t0);
+    if(s->ptr == NULL)
+    {
+        r->fails++;
+        return 0;
+    }
+    s->size = size;
+    memset(s->ptr, 0xA5, size < 16 ? size : 16);
+    bench_peak_on_alloc(a, s->ptr, size);
+    return 1;
+}
+
+static inline void bench_free(const bench_allocator *a, bench_record *r, bench_slot *s)
+{
+    uint64_t t0;
+
+    if(s->ptr == NULL) return;
+    t0 = bench_now();
+    a->free(s->ptr);
+    bench_record_add(r, bench_now() - t0);
+    bench_peak_on_free(s->size);
+    s->ptr = NULL;
+}
+
+static void bench_free_all(const bench_allocator *a, bench_record *r, bench_slot *slots, size_t n)
+{
+    size_t i;
+    xMemFragInfo frag;
+
+    //fragmentation of the free space while the live set is still there, 1 - largest/free
+    if(a->xmem && bench_frag < 0)
+    {
+        xMemFragInfoGet(&frag);
+        bench_frag = frag.freebytes ? 100 - (int)((uint64_t)frag.largest*100/frag.freebytes) : 0;
+    }
+    for(i=0;i<n;i++) bench_free(a, r, &slots[i]);
+}
+
+static int bench_cmp_u32(const void *a, const void *b)
+{
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_result_make(bench_result *res, const char *workload, bench_record *recs, int nrec, uint64_t ns)
+{
+    size_t i, n = 0;
+    u32 * all;
+    int k;
+
+    memset(res, 0, sizeof(*res));
+    res->workload = workload;
+    res->seconds = ns/1e9;
+    for(k=0;k<nrec;k++)
+    {
+        n += recs[k].nlat;
+        res->fails += recs[k].fails;
+    }
+    res->ops = n;
+    if(n == 0) return;
+
+    all = (u32 *)malloc(n*sizeof(u32));
+    for(n=0,k=0;k<nrec;k++)
+    {
+        memcpy(all+n, recs[k].lat, recs[k].nlat*sizeof(u32));
+        n += recs[k].nlat;
+        free(recs[k].lat);
+    }
+    qsort(all, n, sizeof(u32), bench_cmp_u32);
+    i = n-1;
+    res->p50 = all[i*50/100];
+    res->p90 = all[i*90/100];
+    res->p99 = all[i*99/100];
+    res->p999 = all[i*999/1000];
+    res->max = all[i];
+    free(all);
+}
+
+/*--------------------------------------------------------------------------
+ * single thread workloads
+ *------------------------------------------------------------------------*/
+static void bench_random_churn(const bench_allocator *a, bench_result *res)
+{
+    bench_slot * slots = (bench_slot *)calloc(bench_slots, sizeof(bench_slot));
+    bench_record r;
+    u32 seed = 2463534242u;
+    size_t i, j;
+    uint64_t t0;
+
+    bench_record_init(&r, bench_ops);
+    t0 = bench_now();
+    for(i=0;i<bench_ops;i++)
+    {
+        j = bench_rand(&seed) % bench_slots;
+        if(slots[j].ptr) bench_free(a, &r, &slots[j]);
+        else bench_alloc(a, &r, &slots[j], 1 + bench_rand(&seed) % 256);
+    }
+    bench_free_all(a, &r, slots, bench_slots);
+    bench_result_make(res, "random-churn", &r, 1, bench_now() - t0);
+    free(slots);
+}
+
+static void bench_same_size_churn(const bench_allocator *a, bench_result *res)
+{
+    bench_slot * slots = (bench_slot *)calloc(bench_slots, sizeof(bench_slot));
+    bench_record r;
+    u32 seed = 88675123u;
+    size_t i, j;
+    uint64_t t0;
+
+    bench_record_init(&r, bench_ops);
+    t0 = bench_now();
+    for(i=0;i<bench_ops;i++)
+    {
+        j = bench_rand(&seed) % bench_slots;
+        if(slots[j].ptr) bench_free(a, &r, &slots[j]);
+        else bench_alloc(a, &r, &slots[j], 64);
+    }
+    bench_free_all(a, &r, slots, bench_slots);
+    bench_result_make(res, "same-size-churn", &r, 1, bench_now() - t0);
+    free(slots);
+}
+
+static void bench_lifo_fifo(const bench_allocator *a, bench_result *res, int lifo)
+{
+    bench_slot * slots = (bench_slot *)calloc(bench_slots, sizeof(bench_slot));
+    bench_record r;
+    u32 seed = 521288629u;
+    size_t i, n;
+    uint64_t t0;
+
+    bench_record_init(&r, bench_ops);
+    t0 = bench_now();
+    for(n=0;n<bench_ops;)
+    {
+        for(i=0;i<bench_slots;i++,n++) bench_alloc(a, &r, &slots[i], 8 + bench_rand(&seed) % 120);
+        if(lifo)
+        {
+            for(i=bench_slots;i>0;i--,n++) bench_free(a, &r, &slots[i-1]);
+        }
+        else
+        {
+            for(i=0;i<bench_slots;i++,n++) bench_free(a, &r, &slots[i]);
+        }
+    }
+    bench_result_make(res, lifo ? "lifo" : "fifo", &r, 1, bench_now() - t0);
+    free(slots);
+}
+
+static void bench_fragmentation(const bench_allocator *a, bench_result *res)
+{
+    bench_slot * slots = (bench_slot *)calloc(bench_slots, sizeof(bench_slot));
+    bench_record r;
+    u32 seed = 362436069u;
+    size_t i, j, n;
+    uint64_t t0;
+
+    bench_record_init(&r, bench_ops + bench_slots);
+    t0 = bench_now();
+    //interleave small and large blocks, then punch holes by freeing the small ones
+    for(i=0;i<bench_slots;i++)
+        bench_alloc(a, &r, &slots[i], (i&1) ? 128 + bench_rand(&seed) % 384 : 16 + bench_rand(&seed) % 16);
+    for(i=0;i<bench_slots;i+=2) bench_free(a, &r, &slots[i]);
+    //medium requests now have to live with the holes
+    for(n=0;n<bench_ops;n++)
+    {
+        j = (bench_rand(&seed) % (bench_slots/2))*2;
+        if(slots[j].ptr) bench_free(a, &r, &slots[j]);
+        else bench_alloc(a, &r, &slots[j], 48 + bench_rand(&seed) % 208);
+    }
+    bench_free_all(a, &r, slots, bench_slots);
+    bench_result_make(res, "fragmentation", &r, 1, bench_now() - t0);
+    free(slots);
+}
+
+/*--------------------------------------------------------------------------
+ * multi thread workloads
+ *------------------------------------------------------------------------*/
+typedef struct{
+    const bench_allocator * a;
+    bench_slot * slots;
+    size_t nslots;
+    size_t ops;
+    u32 seed;
+    bench_record * rec;
+}bench_larson_arg;
+
+static void * bench_larson_thread(void *p)
+{
+    bench_larson_arg * arg = (bench_larson_arg *)p;
+    size_t i, j;
+
+    for(i=0;i<arg->ops;i++)
+    {
+        j = bench_rand(&arg->seed) % arg->nslots;
+        bench_free(arg->a, arg->rec, &arg->slots[j]);
+        bench_alloc(arg->a, arg->rec, &arg->slots[j], 8 + bench_rand(&arg->seed) % 248);
+    }
+    return NULL;
+}
+
+static void bench_larson(const bench_allocator *a, bench_result *res)
+{
+    const int rounds = 8;
+    pthread_t tid[BENCH_THREADS_MAX];
+    bench_larson_arg arg[BENCH_THREADS_MAX];
+    bench_record rec[BENCH_THREADS_MAX];
+    bench_slot * slots[BENCH_THREADS_MAX];
+    size_t nslots = bench_slots/bench_threads;
+    int t, round;
+    uint64_t t0;
+
+    if(nslots == 0) nslots = 1;
+    for(t=0;t<bench_threads;t++)
+    {
+        slots[t] = (bench_slot *)calloc(nslots, sizeof(bench_slot));
+        bench_record_init(&rec[t], bench_ops*2/bench_threads + 2*nslots);
+    }
+    bench_mt = 1;
+    t0 = bench_now();
+    //server threads exit and new ones inherit their objects, so frees cross threads
+    for(round=0;round<rounds;round++)
+    {
+        for(t=0;t<bench_threads;t++)
+        {
+            arg[t].a = a;
+            arg[t].slots = slots[(t+round)%bench_threads];
+            arg[t].nslots = nslots;
+            arg[t].ops = bench_ops/bench_threads/rounds;
+            arg[t].seed = 0x9E3779B9u*(t+1) + round;
+            arg[t].rec = &rec[t];
+            pthread_create(&tid[t], NULL, bench_larson_thread, &arg[t]);
+        }
+        for(t=0;t<bench_threads;t++) pthread_join(tid[t], NULL);
+    }
+    for(t=0;t<bench_threads;t++)
+    {
+        bench_free_all(a, &rec[t], slots[t], nslots);
+        free(slots[t]);
+    }
+    bench_mt = 0;
+    bench_result_make(res, "larson", rec, bench_threads, bench_now() - t0);
+}
+
+typedef struct{
+    const bench_allocator * a;
+    bench_slot queue[BENCH_QUEUE_SIZE];
+    size_t head, tail;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t ops;
+    bench_record prod, cons;
+}bench_pc_arg;
+
+static void * bench_producer_thread(void *p)
+{
+    bench_pc_arg * arg = (bench_pc_arg *)p;
+    bench_slot s;
+    u32 seed = 1234567u ^ (u32)(uintptr_t)p;
+    size_t i;
+
+    for(i=0;i<arg->ops;i++)
+    {
+        s.ptr = NULL;
+        bench_alloc(arg->a, &arg->prod, &s, 8 + bench_rand(&seed) % 504);
+        pthread_mutex_lock(&arg->lock);
+        while(arg->tail - arg->head == BENCH_QUEUE_SIZE) pthread_cond_wait(&arg->cond, &arg->lock);
+        arg->queue[arg->tail++ % BENCH_QUEUE_SIZE] = s;
+        pthread_cond_broadcast(&arg->cond);
+        pthread_mutex_unlock(&arg->lock);
+    }
+    return NULL;
+}
+
+static void * bench_consumer_thread(void *p)
+{
+    bench_pc_arg * arg = (bench_pc_arg *)p;
+    bench_slot s;
+    size_t i;
+
+    for(i=0;i<arg->ops;i++)
+    {
+        pthread_mutex_lock(&arg->lock);
+        while(arg->tail == arg->head) pthread_cond_wait(&arg->cond, &arg->lock);
+        s = arg->queue[arg->head++ % BENCH_QUEUE_SIZE];
+        pthread_cond_broadcast(&arg->cond);
+        pthread_mutex_unlock(&arg->lock);
+        bench_free(arg->a, &arg->cons, &s);
+    }
+    return NULL;
+}
+
+static void bench_producer_consumer(const bench_allocator *a, bench_result *res)
+{
+    int pairs = bench_threads/2 > 0 ? bench_threads/2 : 1;
+    pthread_t ptid[BENCH_THREADS_MAX], ctid[BENCH_THREADS_MAX];
+    bench_pc_arg * arg = (bench_pc_arg *)calloc(pairs, sizeof(bench_pc_arg));
+    bench_record rec[BENCH_THREADS_MAX];
+    int t;
+    uint64_t t0;
+
+    bench_mt = 1;
+    t0 = bench_now();
+    for(t=0;t<pairs;t++)
+    {
+        arg[t].a = a;
+        arg[t].ops = bench_ops/2/pairs;
+        pthread_mutex_init(&arg[t].lock, NULL);
+        pthread_cond_init(&arg[t].cond, NULL);
+        bench_record_init(&arg[t].prod, arg[t].ops);
+        bench_record_init(&arg[t].cons, arg[t].ops);
+        pthread_create(&ptid[t], NULL, bench_producer_thread, &arg[t]);
+        pthread_create(&ctid[t], NULL, bench_consumer_thread, &arg[t]);
+    }
+    for(t=0;t<pairs;t++)
+    {
+        pthread_join(ptid[t], NULL);
+        pthread_join(ctid[t], NULL);
+        rec[2*t] = arg[t].prod;
+        rec[2*t+1] = arg[t].cons;
+        pthread_mutex_destroy(&arg[t].lock);
+        pthread_cond_destroy(&arg[t].cond);
+    }
+    bench_mt = 0;
+    bench_result_make(res, "producer-consumer", rec, 2*pairs, bench_now() - t0);
+    free(arg);
+}
+
+/*--------------------------------------------------------------------------
+ * driver
+ *------------------------------------------------------------------------*/
+typedef void (*bench_workload)(const bench_allocator *a, bench_result *res);
+
+static void bench_lifo(const bench_allocator *a, bench_result *res) { bench_lifo_fifo(a, res, 1); }
+static void bench_fifo(const bench_allocator *a, bench_result *res) { bench_lifo_fifo(a, res, 0); }
+
+static const bench_workload bench_workloads[] = {
+    bench_random_churn,
+    bench_same_size_churn,
+    bench_lifo,
+    bench_fifo,
+    bench_fragmentation,
+    bench_larson,
+    bench_producer_consumer,
+};
+
+static void bench_result_print(const bench_allocator *a, const bench_result *res, size_t peak)
+{
+    char frag[8] = "-";
+
+    if(bench_frag >= 0) snprintf(frag, sizeof(frag), "%d", bench_frag);
+    printf("%-18s %-8s %12.0f %7u %7u %7u %7u %9u %10zu %7zu %6s\n",
+           res->workload, a->name,
+           res->seconds > 0 ? res->ops/res->seconds : 0.0,
+           res->p50, res->p90, res->p99, res->p999, res->max,
+           peak/1024, res->fails, frag);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t w, k;
+    bench_result res;
+
+    if(argc > 1) bench_ops = strtoul(argv[1], NULL, 0);
+    if(argc > 2) bench_threads = atoi(argv[2]);
+    if(bench_threads < 1) bench_threads = 1;
+    if(bench_threads > BENCH_THREADS_MAX) bench_threads = BENCH_THREADS_MAX;
+
+    //keep the live set well inside the pool, average request is ~128 bytes
+    bench_slots = XMEM_POOL_SIZE/512;
+    if(bench_slots > BENCH_SLOTS_MAX) bench_slots = BENCH_SLOTS_MAX;
+    if(bench_slots < BENCH_SLOTS_MIN) bench_slots = BENCH_SLOTS_MIN;
+
+    xMemInit();
+    printf("pool:%u opposite:%d superblock:%d ops:%zu threads:%d slots:%zu\n",
+           (u32)XMEM_POOL_SIZE, XMEM_POOL_OPPOSITE, XMEM_SUPERBLOCK_ENABLE,
+           bench_ops, bench_threads, bench_slots);
+    printf("%-18s %-8s %12s %7s %7s %7s %7s %9s %10s %7s %6s\n",
+           "workload", "alloc", "ops/s", "p50ns", "p90ns", "p99ns", "p999ns", "maxns", "peakKB", "fails", "frag%");
+
+    for(w=0;w<sizeof(bench_workloads)/sizeof(bench_workloads[0]);w++)
+    {
+        for(k=0;k<sizeof(bench_allocators)/sizeof(bench_allocators[0]);k++)
+        {
+            if(bench_allocators[k].xmem)
+            {
+                //every policy starts from an empty pool
+                xMemReset();
+                xMemPolicySet(bench_allocators[k].policy);
+            }
+            bench_peak_reset(&bench_allocators[k]);
+            bench_workloads[w](&bench_allocators[k], &res);
+            bench_result_print(&bench_allocators[k], &res, bench_peak_get(&bench_allocators[k]));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,218 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <memory_resource>
+#include "xmem.hpp"
+
+/***************************************************************************
+ * xmem C++ container benchmark
+ *
+ * Runs std::vector, std::unordered_map and std::list workloads with the
+ * default allocator, xmem::allocator and std::pmr containers on xmem, and
+ * reports ms and allocator calls per second for each. "xmem unsized" frees
+ * with plain xfree to show what sized deallocation saves.
+ *
+ * usage: xmem_bench_cpp [elements] [rounds]
+ * *************************************************************************/
+
+#define BENCH_ELEMS_DEFAULT     2000
+#define BENCH_ROUNDS_DEFAULT    200
+
+static std::size_t bench_elems = BENCH_ELEMS_DEFAULT;
+static std::size_t bench_rounds = BENCH_ROUNDS_DEFAULT;
+static std::size_t bench_calls = 0;
+
+/* heap_resource without the size hint, every free searches all super blocks */
+class bench_unsized_resource : public std::pmr::memory_resource {
+protected:
+    void * do_allocate(std::size_t bytes, std::size_t) override
+    {
+        void * ptr = xmalloc(bytes ? bytes : 1);
+
+        if (ptr == nullptr) throw std::bad_alloc();
+        bench_calls++;
+        return ptr;
+    }
+
+    void do_deallocate(void * ptr, std::size_t, std::size_t) override
+    {
+        xfree(ptr);
+        bench_calls++;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+/* counts the calls that reach the default allocator */
+template <class T>
+struct bench_std_allocator : std::allocator<T> {
+    typedef T value_type;
+    template <class U> struct rebind { typedef bench_std_allocator<U> other; };
+
+    bench_std_allocator() noexcept {}
+    template <class U>
+    bench_std_allocator(const bench_std_allocator<U> &) noexcept {}
+
+    T * allocate(std::size_t n)
+    {
+        bench_calls++;
+        return std::allocator<T>::allocate(n);
+    }
+
+    void deallocate(T * ptr, std::size_t n)
+    {
+        bench_calls++;
+        std::allocator<T>::deallocate(ptr, n);
+    }
+};
+
+/* counts the calls that reach xmem::allocator */
+class bench_counting_resource : public std::pmr::memory_resource {
+public:
+    explicit bench_counting_resource(std::pmr::memory_resource * r) : upstream(r) {}
+
+protected:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        bench_calls++;
+        return upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void * ptr, std::size_t bytes, std::size_t alignment) override
+    {
+        bench_calls++;
+        upstream->deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    std::pmr::memory_resource * upstream;
+};
+
+template <class Vector>
+static void bench_vector(Vector & v)
+{
+    for (std::size_t i = 0; i < bench_elems; i++) v.push_back(int(i));
+    v.clear();
+    v.shrink_to_fit();
+}
+
+template <class Map>
+static void bench_map(Map & m)
+{
+    std::size_t i;
+
+    for (i = 0; i < bench_elems; i++) m[int(i * 2654435761u)] = int(i);
+    for (i = 0; i < bench_elems; i += 2) m.erase(int(i * 2654435761u));
+    for (i = 0; i < bench_elems; i += 2) m[int(i * 2654435761u)] = int(i);
+    m.clear();
+}
+
+template <class List>
+static void bench_list(List & l)
+{
+    std::size_t i;
+
+    for (i = 0; i < bench_elems; i++) l.push_back(int(i));
+    for (i = 0; i < bench_elems / 2; i++) l.pop_front();
+    for (i = 0; i < bench_elems / 2; i++) l.push_front(int(i));
+    l.clear();
+}
+
+static void bench_run(const char * container, const char * allocator, const std::function<void()> & round)
+{
+    std::size_t r;
+    double ms;
+
+    bench_calls = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (r = 0; r < bench_rounds; r++) round();
+    auto t1 = std::chrono::steady_clock::now();
+
+    ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    std::printf("%-14s %-14s %10.2f ms %12.0f calls/s\n", container, allocator, ms,
+                ms > 0 ? bench_calls / (ms / 1000.0) : 0.0);
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc > 1) bench_elems = std::strtoul(argv[1], NULL, 0);
+    if (argc > 2) bench_rounds = std::strtoul(argv[2], NULL, 0);
+
+    xMemInit();
+
+    bench_counting_resource sized(xmem::heap());
+    bench_unsized_resource unsized;
+
+    std::printf("elements %zu, rounds %zu\n", bench_elems, bench_rounds);
+    std::printf("%-14s %-14s %13s %18s\n", "container", "allocator", "time", "throughput");
+
+    bench_run("vector", "std", [] {
+        std::vector<int, bench_std_allocator<int>> v;
+        bench_vector(v);
+    });
+    bench_run("vector", "xmem", [&] {
+        xmem::allocator<int> alloc(&sized);
+        std::vector<int, xmem::allocator<int>> v(alloc);
+        bench_vector(v);
+    });
+    bench_run("vector", "pmr xmem", [&] {
+        std::pmr::vector<int> v(&sized);
+        bench_vector(v);
+    });
+    bench_run("vector", "xmem unsized", [&] {
+        std::pmr::vector<int> v(&unsized);
+        bench_vector(v);
+    });
+
+    bench_run("unordered_map", "std", [] {
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                           bench_std_allocator<std::pair<const int, int>>> m;
+        bench_map(m);
+    });
+    bench_run("unordered_map", "xmem", [&] {
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                           xmem::allocator<std::pair<const int, int>>>
+            m(0, std::hash<int>(), std::equal_to<int>(), xmem::allocator<std::pair<const int, int>>(&sized));
+        bench_map(m);
+    });
+    bench_run("unordered_map", "pmr xmem", [&] {
+        std::pmr::unordered_map<int, int> m(&sized);
+        bench_map(m);
+    });
+    bench_run("unordered_map", "xmem unsized", [&] {
+        std::pmr::unordered_map<int, int> m(&unsized);
+        bench_map(m);
+    });
+
+    bench_run("list", "std", [] {
+        std::list<int, bench_std_allocator<int>> l;
+        bench_list(l);
+    });
+    bench_run("list", "xmem", [&] {
+        xmem::allocator<int> alloc(&sized);
+        std::list<int, xmem::allocator<int>> l(alloc);
+        bench_list(l);
+    });
+    bench_run("list", "pmr xmem", [&] {
+        std::pmr::list<int> l(&sized);
+        bench_list(l);
+    });
+    bench_run("list", "xmem unsized", [&] {
+        std::pmr::list<int> l(&unsized);
+        bench_list(l);
+    });
+
+    return 0;
+}
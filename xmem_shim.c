@@ -0,0 +1,351 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "xconfig.h"
+#include "platform.h"
+#include "xtypes.h"
+#include "xmem.h"
+
+/***************************************************************************
+ * xmem malloc replacement
+ *
+ * Exports the libc allocator entry points on top of xmalloc/xfree, so an
+ * unmodified program runs on xmem through LD_PRELOAD. Build it as a shared
+ * object with XMEM_SHIM_ENABLE=1 (see README).
+ *
+ * - xmem is serialized by one mutex, fork() holds it across the fork.
+ * - calls that come back into malloc while xmem runs (stdio, assert, ...),
+ *   allocations that do not fit in the pool and frees of pointers outside
+ *   the pool go to the glibc allocator.
+ * - set XMEM_SHIM_VERBOSE in the environment to see xmem messages on stderr.
+ * *************************************************************************/
+
+#if !XMEM_SHIM_ENABLE
+#error "build xmem_shim.c and xmem.c with -DXMEM_SHIM_ENABLE=1"
+#endif
+
+#define XMEM_SHIM_ALIGNED_MAX   64
+#define XMEM_SHIM_PRINT_SIZE    256
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t n, size_t size);
+extern void * __libc_realloc(void *ptr, size_t size);
+extern void * __libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+typedef struct{
+    void * ptr;     //address returned to user
+    void * raw;     //block from xmalloc
+}xMemShimAligned;
+
+static pthread_mutex_t xMemShimLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread int xMemShimDepth __attribute__((tls_model("initial-exec")));
+static int xMemShimVerbose = 0;
+
+static xMemShimAligned xMemShimAlignedTable[XMEM_SHIM_ALIGNED_MAX];
+static u32 xMemShimAlignedCount = 0;
+
+/***************************************************************************
+ * FUNCTION
+ * xMemShimPrintf
+ * DESCRIPTION
+ * xMemPrintf of the shim, formats on the stack and writes to stderr
+ * PARAMETERS
+ * fmt      [IN]    printf format
+ * RETURNS
+ * int number of characters written
+ * *************************************************************************/
+int xMemShimPrintf(const char *fmt, ...)
+{
+    char buf[XMEM_SHIM_PRINT_SIZE];
+    va_list ap;
+    int n;
+
+    if(!xMemShimVerbose) return 0;
+
+    va_start(ap,fmt);
+    n=vsnprintf(buf,sizeof(buf),fmt,ap);
+    va_end(ap);
+    if(n<0) return n;
+    if(n>=(int)sizeof(buf)) n=sizeof(buf)-1;
+    return write(STDERR_FILENO,buf,n);
+}
+
+static void xMemShimEnter(void)
+{
+    pthread_mutex_lock(&xMemShimLock);
+    xMemShimDepth++;
+}
+
+static void xMemShimExit(void)
+{
+    xMemShimDepth--;
+    pthread_mutex_unlock(&xMemShimLock);
+}
+
+static void xMemShimForkPrepare(void)
+{
+    pthread_mutex_lock(&xMemShimLock);
+}
+
+static void xMemShimForkDone(void)
+{
+    pthread_mutex_unlock(&xMemShimLock);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemShimInit
+ * DESCRIPTION
+ * runs when the shared object is loaded
+ * PARAMETERS
+ * void
+ * RETURNS
+ * void
+ * *************************************************************************/
+__attribute__((constructor))
+static void xMemShimInit(void)
+{
+    xMemShimVerbose=getenv("XMEM_SHIM_VERBOSE")!=NULL;
+    pthread_atfork(xMemShimForkPrepare,xMemShimForkDone,xMemShimForkDone);
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemShimAlignedTake
+ * DESCRIPTION
+ * look up an over-aligned pointer and remove it from the table, must be
+ * called inside xMemShimEnter
+ * PARAMETERS
+ * ptr      [IN]    address returned to user
+ * RETURNS
+ * void * block from xmalloc, ptr itself if it is not over-aligned
+ * *************************************************************************/
+static void * xMemShimAlignedTake(void *ptr)
+{
+    u32 i;
+    void * raw;
+
+    for(i=0;i<xMemShimAlignedCount;i++)
+    {
+        if(xMemShimAlignedTable[i].ptr==ptr)
+        {
+            raw=xMemShimAlignedTable[i].raw;
+            xMemShimAlignedTable[i]=xMemShimAlignedTable[--xMemShimAlignedCount];
+            return raw;
+        }
+    }
+    return ptr;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemShimAlignedFind
+ * DESCRIPTION
+ * look up an over-aligned pointer, must be called inside xMemShimEnter
+ * PARAMETERS
+ * ptr      [IN]    address returned to user
+ * RETURNS
+ * void * block from xmalloc, NULL if ptr is not over-aligned
+ * *************************************************************************/
+static void * xMemShimAlignedFind(void *ptr)
+{
+    u32 i;
+
+    for(i=0;i<xMemShimAlignedCount;i++)
+    {
+        if(xMemShimAlignedTable[i].ptr==ptr) return xMemShimAlignedTable[i].raw;
+    }
+    return NULL;
+}
+
+/***************************************************************************
+ * FUNCTION
+ * xMemShimAlloc
+ * DESCRIPTION
+ * allocate from the pool, from glibc if it does not fit or xmem is running
+ * PARAMETERS
+ * size     [IN]    block size that required
+ * RETURNS
+ * void * memory block address
+ * *************************************************************************/
+static void * xMemShimAlloc(size_t size)
+{
+    void * ptr;
+
+    if(xMemShimDepth) return __libc_malloc(size);
+
+    xMemShimEnter();
+    ptr=xmalloc(size);
+    xMemShimExit();
+
+    if(ptr==NULL) ptr=__libc_malloc(size);
+    return ptr;
+}
+
+void * malloc(size_t size)
+{
+    return xMemShimAlloc(size);
+}
+
+void free(void *ptr)
+{
+    if(ptr==NULL) return;
+    if(!xMemOwns(ptr))
+    {
+        __libc_free(ptr);
+        return;
+    }
+    //called back from inside xmem, cannot take the lock again, leave the block
+    if(xMemShimDepth) return;
+
+    xMemShimEnter();
+    if(xMemShimAlignedCount) ptr=xMemShimAlignedTake(ptr);
+    xfree(ptr);
+    xMemShimExit();
+}
+
+void * calloc(size_t n, size_t size)
+{
+    void * ptr;
+
+    if(size&&n>(size_t)-1/size)
+    {
+        errno=ENOMEM;
+        return NULL;
+    }
+    if(xMemShimDepth) return __libc_calloc(n,size);
+
+    //blocks are reused without clearing, so calloc always has to.
+    //not malloc()+memset(), the compiler would fold that back into calloc()
+    ptr=xMemShimAlloc(n*size);
+    if(ptr) memset(ptr,0,n*size);
+    return ptr;
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    static size_t (*libc_usable_size)(void *);
+    void * raw;
+    size_t size;
+
+    if(ptr==NULL) return 0;
+    if(!xMemOwns(ptr))
+    {
+        if(libc_usable_size==NULL) libc_usable_size=dlsym(RTLD_NEXT,"malloc_usable_size");
+        return libc_usable_size?libc_usable_size(ptr):0;
+    }
+
+    xMemShimEnter();
+    raw=xMemShimAlignedCount?xMemShimAlignedFind(ptr):NULL;
+    if(raw) size=xmalloc_usable_size(raw)-((u8*)ptr-(u8*)raw);
+    else size=xmalloc_usable_size(ptr);
+    xMemShimExit();
+    return size;
+}
+
+void * realloc(void *ptr, size_t size)
+{
+    void * pnew;
+    size_t oldsize;
+    int aligned;
+
+    if(ptr==NULL) return malloc(size);
+    if(!xMemOwns(ptr)) return __libc_realloc(ptr,size);
+    if(size==0)
+    {
+        free(ptr);
+        return NULL;
+    }
+
+    pnew=NULL;
+    xMemShimEnter();
+    aligned=xMemShimAlignedCount&&xMemShimAlignedFind(ptr);
+    if(!aligned) pnew=xrealloc(ptr,size);
+    xMemShimExit();
+    if(pnew) return pnew;
+
+    //over-aligned block or the pool is out of space, move it by hand
+    oldsize=malloc_usable_size(ptr);
+    pnew=malloc(size);
+    if(pnew)
+    {
+        memcpy(pnew,ptr,oldsize<size?oldsize:size);
+        free(ptr);
+    }
+    return pnew;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void * raw;
+    void * ptr;
+
+    if(align==0||(align&(align-1))||align%sizeof(void *)) return EINVAL;
+
+    if(align<=XMEM_ALIGN_SIZE)
+    {
+        ptr=malloc(size);
+    }
+    else if(xMemShimDepth||size>(size_t)-1-align)
+    {
+        ptr=__libc_memalign(align,size);
+    }
+    else
+    {
+        ptr=NULL;
+        xMemShimEnter();
+        if(xMemShimAlignedCount<XMEM_SHIM_ALIGNED_MAX)
+        {
+            raw=xmalloc(size+align);
+            if(raw)
+            {
+                ptr=(void *)(((uptr)raw+align-1)&~(uptr)(align-1));
+                xMemShimAlignedTable[xMemShimAlignedCount].ptr=ptr;
+                xMemShimAlignedTable[xMemShimAlignedCount].raw=raw;
+                xMemShimAlignedCount++;
+            }
+        }
+        xMemShimExit();
+        if(ptr==NULL) ptr=__libc_memalign(align,size);
+    }
+
+    if(ptr==NULL) return ENOMEM;
+    *memptr=ptr;
+    return 0;
+}
+
+void * memalign(size_t align, size_t size)
+{
+    void * ptr;
+
+    //memalign takes any power of 2, posix_memalign wants a multiple of the pointer size
+    if(align<sizeof(void *)) align=sizeof(void *);
+    if(posix_memalign(&ptr,align,size)) return NULL;
+    return ptr;
+}
+
+void * aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align,size);
+}
+
+void * valloc(size_t size)
+{
+    return memalign(sysconf(_SC_PAGESIZE),size);
+}
+
+void * pvalloc(size_t size)
+{
+    size_t page;
+
+    page=sysconf(_SC_PAGESIZE);
+    return memalign(page,(size+page-1)&~(page-1));
+}
@@ -1,11 +1,82 @@
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#if XMEM_SHIM_ENABLE
+#include <stdlib.h>
+#include <malloc.h>
+#endif
+#if XMEM_EPOCH_ENABLE
+#include <pthread.h>
+#endif
+#include "xconfig.h"
 #include "xmem.h"
 
-int main(int argc, char *argv[])
+/***************************************************************************
+ * xmem tests
+ *
+ * The layout and the features are chosen at compile time, so build one
+ * binary for each set of options, with XMEM_POOL_OPPOSITE at 0 and at 1:
+ *
+ *  gcc -DCPU_64_BIT=1 -DXMEM_POOL_OPPOSITE=1 xmem.c xmem_test.c -o xmem_test -lpthread -lrt
+ *
+ * With XMEM_SHIM_ENABLE link xmem_shim.c as well, malloc is then checked
+ * to land in the pool.
+ *
+ * A feature that is not built is not tested. The exit code is the number
+ * of failed checks.
+ * *************************************************************************/
+
+static int test_failed=0;
+
+#define TEST_CHECK(c)   do{ if(!(c)){ printf("FAIL %s:%d: %s\n",__FILE__,__LINE__,#c); test_failed++; } }while(0)
+
+#define TEST_SNAP_ENTRIES   64
+
+/* blocks handed out, a super block counts its used slots. an empty super block is kept
+   and its descriptor still counts, so a test uses a size once before it counts */
+static unsigned int test_used(void)
+{
+    static xMemSnapEntry entries[TEST_SNAP_ENTRIES];
+    xMemSnapshot snap;
+
+    xMemSnapshotInit(&snap,entries,TEST_SNAP_ENTRIES);
+    xMemSnapshotTake(&snap);
+    return snap.usedblocks;
+}
+
+static void test_fill(unsigned char *p, unsigned int n, unsigned char seed)
+{
+    unsigned int i;
+
+    for(i=0;i<n;i++) p[i]=(unsigned char)(seed+i);
+}
+
+static int test_same(const unsigned char *p, unsigned int n, unsigned char seed)
+{
+    unsigned int i;
+
+    for(i=0;i<n;i++) if(p[i]!=(unsigned char)(seed+i)) return 0;
+    return 1;
+}
+
+#if XMEM_SUPERBLOCK_ENABLE || !XMEM_DEFER_COALESCE_ENABLE
+/* free bytes of the block list, the gap counts */
+static unsigned int test_free(void)
+{
+    xMemFragInfo info;
+
+    xMemFragInfoGet(&info);
+    return info.freebytes;
+}
+#endif
+
+static void test_dump(void)
 {
     char * a,*b,*c,*d,*e,*f,*g,*h,*i;
 
-    //xMemInit();
     a=(char *)xmalloc(1);
     b=(char *)xmalloc(5);
     c=(char *)xmalloc(9);
@@ -28,6 +99,1268 @@ int main(int argc, char *argv[])
     xfree(g);
     xfree(e);
     xMemInfoDump();
+}
+
+#if XMEM_BOUNDRY_CHECK_ENABLE && !XMEM_POOL_FILE_ENABLE && !XMEM_POOL_SHARED_ENABLE && !defined(NDEBUG)
+#define TEST_CHECK_SIZE     200
+
+/* a header overwritten by the block in front of it is found within a
+   period of calls, in a child so the abort ends it */
+static void test_check(void)
+{
+    unsigned char * a,* b;
+    pid_t pid;
+    int status,i;
+
+    a=(unsigned char *)xmalloc(TEST_CHECK_SIZE);
+    b=(unsigned char *)xmalloc(TEST_CHECK_SIZE);
+    TEST_CHECK(a!=NULL&&b!=NULL);
+    if(a==NULL||b==NULL) return;
+
+    fflush(stdout);
+    pid=fork();
+    if(pid==0)
+    {
+        memset(a+TEST_CHECK_SIZE,0xFF,48);
+        for(i=0;i<XMEM_CHECK_PERIOD*2;i++) xfree(xmalloc(TEST_CHECK_SIZE));
+        xfree(a);
+        _exit(0);
+    }
+    TEST_CHECK(pid>0&&waitpid(pid,&status,0)==pid);
+    TEST_CHECK(WIFSIGNALED(status)&&WTERMSIG(status)==SIGABRT);
+
+    //the headers are intact in this process
+    xfree(b);
+    xfree(a);
+}
+#endif
+
+#if XMEM_CANARY_ENABLE && !XMEM_POOL_FILE_ENABLE && !XMEM_POOL_SHARED_ENABLE && !defined(NDEBUG)
+/* a write past the requested size is caught when the block is freed, even
+   one that stays in the rounding of the block. in a child so the abort ends it */
+static void test_canary(void)
+{
+    unsigned char * p;
+    pid_t pid;
+    int status;
+
+    p=(unsigned char *)xmalloc(17);
+    TEST_CHECK(p!=NULL);
+    if(p==NULL) return;
+
+    fflush(stdout);
+    pid=fork();
+    if(pid==0)
+    {
+        p[17]^=0xFF;
+        xfree(p);
+        _exit(0);
+    }
+    TEST_CHECK(pid>0&&waitpid(pid,&status,0)==pid);
+    TEST_CHECK(WIFSIGNALED(status)&&WTERMSIG(status)==SIGABRT);
+
+    //the block itself is intact in this process
+    xfree(p);
+    //a block written up to its size is fine
+    p=(unsigned char *)xmalloc(17);
+    TEST_CHECK(p!=NULL);
+    if(p==NULL) return;
+    memset(p,0xFF,17);
+    TEST_CHECK(xmalloc_usable_size(p)==17);
+    //the canary moves with the size, in place or not
+    p=(unsigned char *)xrealloc(p,21);
+    TEST_CHECK(p!=NULL);
+    if(p==NULL) return;
+    memset(p,0xFF,21);
+    TEST_CHECK(xmalloc_usable_size(p)==21);
+    xfree(p);
+}
+#endif
+
+/* a pointer the pool does not own is not reallocated */
+static void test_realloc(void)
+{
+    long local=0;
+    unsigned char * p;
+
+    TEST_CHECK(xrealloc(&local,16)==NULL);
+    p=(unsigned char *)xrealloc(NULL,100);
+    TEST_CHECK(p!=NULL);
+    if(p==NULL) return;
+    memset(p,0x3C,100);
+    p=(unsigned char *)xrealloc(p,300);
+    TEST_CHECK(p!=NULL);
+    if(p==NULL) return;
+    TEST_CHECK(p[0]==0x3C&&p[99]==0x3C);
+    xfree(p);
+}
+
+#if XMEM_DEFER_COALESCE_ENABLE
+#define TEST_DEFER_SIZE     232
+#define TEST_DEFER_BLOCKS   (XMEM_POOL_SIZE/TEST_DEFER_SIZE)
+
+/* a freed block serves the next request of its size, a request no free
+   block fits merges the deferred blocks and is made again */
+static void test_coalesce(void)
+{
+    void * p[TEST_DEFER_BLOCKS];
+    void * a,* sep;
+    unsigned int i,n;
+
+    a=xmalloc(TEST_DEFER_SIZE);
+    sep=xmalloc(72);
+    TEST_CHECK(a!=NULL&&sep!=NULL);
+    xfree(a);
+    TEST_CHECK(xmalloc(TEST_DEFER_SIZE)==a);
+    xfree(a);
+    xfree(sep);
+
+    for(n=0;n<TEST_DEFER_BLOCKS;n++)
+    {
+        p[n]=xmalloc(TEST_DEFER_SIZE);
+        if(p[n]==NULL) break;
+    }
+    TEST_CHECK(n>XMEM_QUICKLIST_SIZE);
+    for(i=0;i<n;i++) xfree(p[i]);
+    a=xmalloc(XMEM_POOL_SIZE/2);
+    TEST_CHECK(a!=NULL);
+    xfree(a);
+}
+#endif
+
+#if XMEM_HANDLE_ENABLE
+#define TEST_HANDLES        5
+#define TEST_HANDLE_SIZE    256
+
+/* compaction moves unlocked handle blocks with their data, a locked one stays */
+static void test_compact(void)
+{
+    xhandle h[TEST_HANDLES];
+    unsigned char * p;
+    void * locked,* moved;
+    xMemFragInfo before;
+    unsigned int i,largest,used;
+
+    used=test_used();
+    for(i=0;i<TEST_HANDLES;i++)
+    {
+        h[i]=xhalloc(TEST_HANDLE_SIZE);
+        TEST_CHECK(h[i]!=0);
+        if(h[i]==0) return;
+        p=(unsigned char *)xhlock(h[i]);
+        test_fill(p,TEST_HANDLE_SIZE,(unsigned char)i);
+        xhunlock(h[i]);
+    }
+    TEST_CHECK(xhalloc(XMEM_POOL_SIZE+1)==0);
+
+    xhfree(h[1]);
+    xhfree(h[3]);
+    locked=xhlock(h[2]);
+    moved=xhlock(h[4]);
+    xhunlock(h[4]);
+
+    xMemFragInfoGet(&before);
+    largest=xMemCompact();
+    TEST_CHECK(largest>=before.largest);
+
+    TEST_CHECK(xhlock(h[2])==locked);
+    xhunlock(h[2]);
+    xhunlock(h[2]);
+    TEST_CHECK(xhlock(h[4])!=moved);
+    xhunlock(h[4]);
+    for(i=0;i<TEST_HANDLES;i+=2)
+    {
+        p=(unsigned char *)xhlock(h[i]);
+        TEST_CHECK(test_same(p,TEST_HANDLE_SIZE,(unsigned char)i));
+        xhunlock(h[i]);
+        xhfree(h[i]);
+    }
+    TEST_CHECK(test_used()==used);
+}
+#endif
+
+#if XMEM_REGION_ENABLE
+/* a release gives back what came after the mark, the blocks before it stay */
+static void test_region(void)
+{
+    xRegion rgn;
+    xRegionPos pos;
+    unsigned char * a,* b,* c;
+    unsigned int used,i;
+
+    used=test_used();
+    xRegionInit(&rgn,256);
+    a=(unsigned char *)xRegionAlloc(&rgn,40);
+    TEST_CHECK(a!=NULL);
+    if(a==NULL) return;
+    test_fill(a,40,1);
+
+    xRegionMark(&rgn,&pos);
+    b=(unsigned char *)xRegionAlloc(&rgn,16);
+    TEST_CHECK(b!=NULL);
+    //larger than a chunk, gets one of its own
+    for(i=0;i<3;i++) TEST_CHECK(xRegionAlloc(&rgn,300)!=NULL);
+    TEST_CHECK(test_used()>used+1);
+    xRegionRelease(&rgn,&pos);
+
+    TEST_CHECK(test_used()==used+1);
+    TEST_CHECK(test_same(a,40,1));
+    c=(unsigned char *)xRegionAlloc(&rgn,16);
+    TEST_CHECK(c==b);
+    TEST_CHECK(xRegionAlloc(&rgn,(size_t)-8)==NULL);
+
+    xRegionReset(&rgn);
+    TEST_CHECK(test_used()==used);
+}
+#endif
+
+#if XMEM_SUPERBLOCK_ENABLE && XMEM_CACHE_ENABLE
+#define TEST_CACHE_OBJS     12
+
+static int test_ctors=0,test_dtors=0;
+
+static void test_ctor(void *obj)
+{
+    test_ctors++;
+    memset(obj,0x5A,24);
+}
+
+static void test_dtor(void *obj)
+{
+    (void)obj;
+    test_dtors++;
+}
+
+/* objects stay constructed while the cache holds them, slabs go back on shrink */
+static void test_cache(void)
+{
+    xMemCache * cache;
+    unsigned char * obj[TEST_CACHE_OBJS];
+    unsigned int i,j,used;
+    int ctors;
+
+    used=test_used();
+    cache=xMemCacheCreate(24,16,test_ctor,test_dtor);
+    TEST_CHECK(cache!=NULL);
+    if(cache==NULL) return;
+
+    for(i=0;i<TEST_CACHE_OBJS;i++)
+    {
+        obj[i]=(unsigned char *)xMemCacheAlloc(cache);
+        TEST_CHECK(obj[i]!=NULL);
+        if(obj[i]==NULL) return;
+        TEST_CHECK(((size_t)obj[i]&15)==0);
+        TEST_CHECK(obj[i][0]==0x5A&&obj[i][23]==0x5A);
+        for(j=0;j<i;j++) TEST_CHECK(obj[j]!=obj[i]);
+    }
+    TEST_CHECK(test_ctors>=TEST_CACHE_OBJS);
+
+    ctors=test_ctors;
+    for(i=0;i<TEST_CACHE_OBJS;i++) xMemCacheFree(cache,obj[i]);
+    for(i=0;i<TEST_CACHE_OBJS;i++) obj[i]=(unsigned char *)xMemCacheAlloc(cache);
+    TEST_CHECK(test_ctors==ctors);
+    for(i=0;i<TEST_CACHE_OBJS;i++) xMemCacheFree(cache,obj[i]);
+
+    xMemCacheShrink(cache);
+    TEST_CHECK(test_dtors==test_ctors);
+    xMemCacheDestroy(cache);
+    TEST_CHECK(test_used()==used);
+}
+#endif
+
+/* the pool knows its blocks, gives them aligned and refuses what it can not hold */
+static void test_owns(void)
+{
+    unsigned char * p;
+    int local=0;
+
+    p=(unsigned char *)xmalloc(40);
+    TEST_CHECK(p!=NULL);
+    if(p==NULL) return;
+    TEST_CHECK(xMemOwns(p));
+    TEST_CHECK(!xMemOwns(&local));
+    TEST_CHECK(((size_t)p&(XMEM_ALIGN_SIZE-1))==0);
+    TEST_CHECK(xmalloc_usable_size(p)>=40);
+    memset(p,0xA5,xmalloc_usable_size(p));
+    xfree(p);
+
+    TEST_CHECK(xmalloc(XMEM_POOL_SIZE*2)==NULL);
+    TEST_CHECK(xmalloc((size_t)-1)==NULL);
+}
+
+#if XMEM_SHIM_ENABLE
+/* malloc and its family come from the pool, what the pool can not hold from the C library */
+static void test_shim(void)
+{
+    unsigned char * p,* q;
+    void * a=NULL;
+
+    p=(unsigned char *)malloc(100);
+    TEST_CHECK(p!=NULL&&xMemOwns(p));
+    if(p==NULL) return;
+    memset(p,0x11,100);
+    TEST_CHECK(malloc_usable_size(p)>=100);
+    p=(unsigned char *)realloc(p,300);
+    TEST_CHECK(p!=NULL&&xMemOwns(p));
+    if(p==NULL) return;
+    TEST_CHECK(p[0]==0x11&&p[99]==0x11);
+    free(p);
+
+    q=(unsigned char *)calloc(10,20);
+    TEST_CHECK(q!=NULL&&xMemOwns(q));
+    if(q) TEST_CHECK(q[0]==0&&q[199]==0);
+    free(q);
+
+    TEST_CHECK(posix_memalign(&a,64,100)==0);
+    TEST_CHECK(a!=NULL&&((size_t)a&63)==0&&xMemOwns(a));
+    free(a);
+
+    p=(unsigned char *)malloc(XMEM_POOL_SIZE*2);
+    TEST_CHECK(p!=NULL&&!xMemOwns(p));
+    free(p);
+}
+#endif
+
+/* aligned blocks keep their alignment and data, sized frees find their block */
+static void test_aligned(void)
+{
+    unsigned char * p;
+    size_t align;
+
+    for(align=XMEM_ALIGN_SIZE;align<=256;align<<=1)
+    {
+        p=(unsigned char *)xmalloc_aligned(100,align);
+        TEST_CHECK(p!=NULL);
+        if(p==NULL) continue;
+        TEST_CHECK(((size_t)p&(align-1))==0);
+        memset(p,0x77,100);
+        TEST_CHECK(xMemOwns(p));
+        xfree_aligned_sized(p,100,align);
+    }
+    TEST_CHECK(xmalloc_aligned((size_t)-16,64)==NULL);
+
+    p=(unsigned char *)xmalloc(24);
+    TEST_CHECK(p!=NULL);
+    xfree_sized(p,24);
+    p=(unsigned char *)xmalloc(300);
+    TEST_CHECK(p!=NULL);
+    xfree_sized(p,300);
+}
+
+/* the usable size covers the good size, and a request of the good size fits the same block */
+static void test_usable(void)
+{
+    unsigned char * p,* q;
+    size_t size,good,usable;
+
+    TEST_CHECK(xmalloc_usable_size(NULL)==0);
+    for(size=1;size<=300;size+=13)
+    {
+        good=xmalloc_good_size(size);
+        TEST_CHECK(good>=size);
+        p=(unsigned char *)xmalloc(size);
+        TEST_CHECK(p!=NULL);
+        if(p==NULL) continue;
+        usable=xmalloc_usable_size(p);
+        TEST_CHECK(usable>=good);
+        memset(p,0xC3,usable);
+        q=(unsigned char *)xmalloc(good);
+        TEST_CHECK(q!=NULL&&xmalloc_usable_size(q)>=good);
+        xfree(q);
+        xfree(p);
+    }
+    TEST_CHECK(xmalloc_good_size(XMEM_POOL_SIZE+1)==XMEM_POOL_SIZE+1);
+}
+
+#if !XMEM_DEFER_COALESCE_ENABLE
+#define TEST_FIT_SIZE   272
+#define TEST_FIT_HOLES  3
+
+/* best fit takes the hole that leaves least, first fit the first one,
+   next fit goes on after the block it gave last */
+static void test_policy(void)
+{
+    static const unsigned int size[TEST_FIT_HOLES]={TEST_FIT_SIZE+32,TEST_FIT_SIZE+128,TEST_FIT_SIZE+16};
+    unsigned char * hole[TEST_FIT_HOLES],* sep[TEST_FIT_HOLES];
+    unsigned char * p,* q;
+    xMemFragInfo before,after;
+    unsigned int i;
+
+    for(i=0;i<TEST_FIT_HOLES;i++)
+    {
+        hole[i]=(unsigned char *)xmalloc(size[i]);
+        sep[i]=(unsigned char *)xmalloc(72);
+        TEST_CHECK(hole[i]!=NULL&&sep[i]!=NULL);
+        if(hole[i]==NULL||sep[i]==NULL) return;
+    }
+    xMemFragInfoGet(&before);
+    for(i=0;i<TEST_FIT_HOLES;i++) xfree(hole[i]);
+    xMemFragInfoGet(&after);
+    TEST_CHECK(after.freeblocks==before.freeblocks+TEST_FIT_HOLES);
+    TEST_CHECK(after.largest>=size[1]);
+
+    xMemPolicySet(XMEM_FIT_BEST);
+    p=(unsigned char *)xmalloc(TEST_FIT_SIZE);
+    TEST_CHECK(p==hole[2]);
+    xfree(p);
+
+    xMemPolicySet(XMEM_FIT_FIRST);
+    p=(unsigned char *)xmalloc(TEST_FIT_SIZE);
+    TEST_CHECK(p>=hole[0]&&p<hole[0]+size[0]);
+    xfree(p);
+
+    xMemPolicySet(XMEM_FIT_NEXT);
+    p=(unsigned char *)xmalloc(TEST_FIT_SIZE);
+    q=(unsigned char *)xmalloc(TEST_FIT_SIZE);
+    TEST_CHECK(p>=hole[0]&&p<hole[0]+size[0]);
+    TEST_CHECK(q>=hole[1]&&q<hole[1]+size[1]);
+    xfree(q);
+    xfree(p);
+
+    xMemPolicySet(XMEM_FIT_POLICY);
+    for(i=0;i<TEST_FIT_HOLES;i++) xfree(sep[i]);
+}
+#endif
+
+#if XMEM_HEADER_PROTECT_ENABLE
+#define TEST_GAP_BLOCKS     400
+
+/* with every header page in use, a gap that holds the request but not a
+   new header page must not turn down the free blocks */
+static void test_gap(void)
+{
+    static void * p[TEST_GAP_BLOCKS];
+    void * big,* q;
+    unsigned int i,n,size;
+
+    for(size=72;size<=72+64*8;size+=64)
+    {
+        big=xmalloc(2000);
+        TEST_CHECK(big!=NULL);
+        if(big==NULL) return;
+        for(n=0;n<TEST_GAP_BLOCKS;n++)
+        {
+            p[n]=xmalloc(size);
+            if(p[n]==NULL) break;
+        }
+        xfree(big);
+        q=xmalloc(size);
+        TEST_CHECK(q!=NULL);
+        xfree(q);
+        for(i=0;i<n;i++) xfree(p[i]);
+    }
+}
+#endif
+
+#if XMEM_FREE_INDEX_ENABLE && !XMEM_DEFER_COALESCE_ENABLE
+#define TEST_INDEX_HOLES    12
+
+/* the index finds the hole of the size asked for among holes of every size */
+static void test_free_index(void)
+{
+    unsigned char * hole[TEST_INDEX_HOLES],* sep[TEST_INDEX_HOLES];
+    unsigned char * p;
+    unsigned int i,k;
+
+    for(i=0;i<TEST_INDEX_HOLES;i++)
+    {
+        hole[i]=(unsigned char *)xmalloc(96+16*((i*5)%TEST_INDEX_HOLES));
+        sep[i]=(unsigned char *)xmalloc(72);
+        TEST_CHECK(hole[i]!=NULL&&sep[i]!=NULL);
+        if(hole[i]==NULL||sep[i]==NULL) return;
+    }
+    for(i=0;i<TEST_INDEX_HOLES;i++) xfree(hole[i]);
+
+    xMemPolicySet(XMEM_FIT_BEST);
+    for(k=0;k<TEST_INDEX_HOLES;k++)
+    {
+        for(i=0;(i*5)%TEST_INDEX_HOLES!=k;i++);
+        p=(unsigned char *)xmalloc(96+16*k-8);
+        TEST_CHECK(p==hole[i]);
+        xfree(p);
+    }
+    xMemPolicySet(XMEM_FIT_POLICY);
+    for(i=0;i<TEST_INDEX_HOLES;i++) xfree(sep[i]);
+}
+#endif
+
+#if XMEM_HEADER_PROTECT_ENABLE && !XMEM_DEFER_COALESCE_ENABLE
+#define TEST_HDR_BLOCKS     (XMEM_HEADER_PAGE_SLOTS+4)
+
+/* headers of more blocks than a page holds come from a new page, the space
+   goes back once they are freed */
+static void test_hdr_pages(void)
+{
+    void * p[TEST_HDR_BLOCKS];
+    xMemFragInfo before,after;
+    unsigned int i,n;
+
+    xMemFragInfoGet(&before);
+    for(n=0;n<TEST_HDR_BLOCKS;n++)
+    {
+        p[n]=xmalloc(72);
+        if(p[n]==NULL) break;
+        memset(p[n],0x42,72);
+    }
+    TEST_CHECK(n==TEST_HDR_BLOCKS);
+    for(i=0;i<n;i++) xfree(p[i]);
+    xMemFragInfoGet(&after);
+    TEST_CHECK(after.freebytes==before.freebytes);
+    TEST_CHECK(after.largest==before.largest);
+}
+#endif
+
+#if XMEM_PROFILE_ENABLE
+#define TEST_PROFILE_PATH   "xmem_test.prof"
+#define TEST_PROFILE_BLOCKS 10
+
+/* reads the totals line of a profile */
+static int test_profile_read(unsigned int *inuse, unsigned int *allocs)
+{
+    unsigned long long bytes;
+    FILE * fp;
+    int n;
+
+    fp=fopen(TEST_PROFILE_PATH,"r");
+    if(fp==NULL) return -1;
+    n=fscanf(fp,"heap profile: %u: %llu [%u:",inuse,&bytes,allocs);
+    fclose(fp);
+    return n==3?0:-1;
+}
+
+/* with a sample every byte the profile holds every live block */
+static void test_profile(void)
+{
+    void * p[TEST_PROFILE_BLOCKS];
+    unsigned int i,inuse,allocs;
+
+    xMemProfileStart(1);
+    for(i=0;i<TEST_PROFILE_BLOCKS;i++) p[i]=xmalloc(100);
+    TEST_CHECK(xMemProfileDump(TEST_PROFILE_PATH)==0);
+    TEST_CHECK(test_profile_read(&inuse,&allocs)==0);
+    TEST_CHECK(inuse==TEST_PROFILE_BLOCKS&&allocs==TEST_PROFILE_BLOCKS);
+
+    //the live set follows xfree after sampling stopped
+    xMemProfileStop();
+    for(i=0;i<TEST_PROFILE_BLOCKS;i++) xfree(p[i]);
+    TEST_CHECK(xMemProfileDump(TEST_PROFILE_PATH)==0);
+    TEST_CHECK(test_profile_read(&inuse,&allocs)==0);
+    TEST_CHECK(inuse==0&&allocs==TEST_PROFILE_BLOCKS);
+
+    TEST_CHECK(xMemProfileDump("/nonexistent/xmem_test.prof")<0);
+    unlink(TEST_PROFILE_PATH);
+}
+#endif
+
+#define TEST_DIFF_ENTRIES   8
+
+/* a diff of two snapshots holds the blocks allocated between them */
+static void test_snapshot(void)
+{
+    static xMemSnapEntry e1[TEST_SNAP_ENTRIES],e2[TEST_SNAP_ENTRIES];
+    xMemSnapEntry diff[TEST_DIFF_ENTRIES];
+    xMemSnapshot s1,s2;
+    void * p[3];
+    unsigned int i,n;
+    int count,bytes;
+
+    xMemSnapshotInit(&s1,e1,TEST_SNAP_ENTRIES);
+    xMemSnapshotInit(&s2,e2,TEST_SNAP_ENTRIES);
+    TEST_CHECK(xMemSnapshotTake(&s1)==0);
+    for(i=0;i<3;i++) p[i]=xmalloc(100);
+    TEST_CHECK(xMemSnapshotTake(&s2)==0);
+    TEST_CHECK(s2.usedblocks==s1.usedblocks+3);
+
+    n=xMemSnapshotDiff(&s1,&s2,diff,TEST_DIFF_ENTRIES);
+    for(i=0,count=0,bytes=0;i<n;i++)
+    {
+        TEST_CHECK(diff[i].tag==0);
+        count+=diff[i].count;
+        bytes+=diff[i].bytes;
+    }
+    TEST_CHECK(count==3&&bytes>=300);
+    #if !XMEM_DEFER_COALESCE_ENABLE
+    //a block from the quick list may be larger than asked for
+    TEST_CHECK(n==1&&diff[0].sizeclass==7);
+    #endif
+
+    for(i=0;i<3;i++) xfree(p[i]);
+    TEST_CHECK(xMemSnapshotTake(&s2)==0);
+    TEST_CHECK(xMemSnapshotDiff(&s1,&s2,diff,TEST_DIFF_ENTRIES)==0);
+}
+
+#if XMEM_TAG_ENABLE
+#define TEST_TAG_BLOCKS     16
+
+/* a tag stops at its quota, other tags go on, xrealloc keeps the tag */
+static void test_tags(void)
+{
+    xMemTagInfo info;
+    void * p[TEST_TAG_BLOCKS];
+    void * q;
+    unsigned int i,n;
+
+    xMemTagQuotaSet(1,600);
+    for(n=0;n<TEST_TAG_BLOCKS;n++)
+    {
+        p[n]=xmalloc_tag(100,1);
+        if(p[n]==NULL) break;
+    }
+    TEST_CHECK(n>0&&n<TEST_TAG_BLOCKS);
+    TEST_CHECK(xMemTagInfoGet(1,&info)==0);
+    TEST_CHECK(info.count==n&&info.bytes<=600&&info.failed>=1);
+
+    q=xmalloc_tag(100,2);
+    TEST_CHECK(q!=NULL);
+    q=xrealloc(q,400);
+    TEST_CHECK(q!=NULL);
+    TEST_CHECK(xMemTagInfoGet(2,&info)==0);
+    TEST_CHECK(info.count==1&&info.bytes>=400);
+    xfree(q);
+
+    for(i=0;i<n;i++) xfree(p[i]);
+    TEST_CHECK(xMemTagInfoGet(1,&info)==0);
+    TEST_CHECK(info.count==0&&info.bytes==0);
+    TEST_CHECK(xMemTagInfoGet(XMEM_TAG_MAX,&info)<0);
+    xMemTagQuotaSet(1,0);
+}
+#endif
+
+#if XMEM_PRESSURE_ENABLE
+#define TEST_PRESSURE_SIZE      96      //larger than a super block slot, the blocks come from the block list
+#define TEST_PRESSURE_BLOCKS    (XMEM_POOL_SIZE/TEST_PRESSURE_SIZE)
+
+static void * test_held[TEST_PRESSURE_BLOCKS];
+static unsigned int test_nheld=0;
+static int test_low=0,test_oom=0;
+
+/* frees a few held blocks when the pool runs out */
+static size_t test_shed(int level, size_t size, void *arg)
+{
+    size_t released=0;
+    unsigned int i;
+
+    (void)size;
+    (void)arg;
+    if(level==XMEM_PRESSURE_LOW)
+    {
+        test_low++;
+        return 0;
+    }
+    test_oom++;
+    for(i=0;i<4&&test_nheld;i++)
+    {
+        xfree(test_held[--test_nheld]);
+        released+=TEST_PRESSURE_SIZE;
+    }
+    return released;
+}
+
+static void * test_pressure_alloc(unsigned int tag)
+{
+    #if XMEM_TAG_ENABLE
+    if(tag) return xmalloc_tag(TEST_PRESSURE_SIZE,tag);
+    #endif
+    (void)tag;
+    return xmalloc(TEST_PRESSURE_SIZE);
+}
+
+/* a full pool calls the callbacks and retries the request, under its tag if it has one */
+static void test_pressure(unsigned int tag)
+{
+    void * p;
+
+    test_low=test_oom=0;
+    xMemPressureWatermarkSet(XMEM_POOL_SIZE/4);
+    TEST_CHECK(xMemPressureRegister(test_shed,NULL)==0);
+    while(test_nheld<TEST_PRESSURE_BLOCKS)
+    {
+        p=test_pressure_alloc(tag);
+        if(p==NULL) break;
+        test_held[test_nheld++]=p;
+        if(test_oom) break;
+    }
+    TEST_CHECK(test_low==1);
+    TEST_CHECK(test_oom==1);
+    TEST_CHECK(xMemPressureLevel()!=XMEM_PRESSURE_OOM);
+
+    //without the callback the pool runs out
+    xMemPressureUnregister(test_shed,NULL);
+    while(test_nheld<TEST_PRESSURE_BLOCKS&&(p=test_pressure_alloc(tag))!=NULL) test_held[test_nheld++]=p;
+    TEST_CHECK(test_pressure_alloc(tag)==NULL);
+    TEST_CHECK(xMemPressureLevel()==XMEM_PRESSURE_OOM);
+
+    TEST_CHECK(xMemPressureRegister(test_shed,NULL)==0);
+    p=test_pressure_alloc(tag);
+    TEST_CHECK(p!=NULL);
+    TEST_CHECK(test_oom==2);
+    #if XMEM_TAG_ENABLE
+    if(tag)
+    {
+        xMemTagInfo info;
+
+        TEST_CHECK(xMemTagInfoGet(tag,&info)==0&&info.count==test_nheld+1);
+    }
+    #endif
+    xfree(p);
+    xMemPressureUnregister(test_shed,NULL);
+
+    while(test_nheld) xfree(test_held[--test_nheld]);
+    xMemPressureWatermarkSet(0);
+}
+
+#if XMEM_TAG_ENABLE
+/* a tagged request the quota turns down after the pool gave the block
+   does not use up the LOW the next request raises */
+static void test_pressure_quota(void)
+{
+    size_t free;
+    void * p;
+
+    //the highest watermark the pool is not below yet
+    for(free=XMEM_POOL_SIZE;free;free--)
+    {
+        xMemPressureWatermarkSet(free);
+        if(xMemPressureLevel()==XMEM_PRESSURE_NONE) break;
+    }
+    test_low=0;
+    //the next block of the size takes the free space below the watermark
+    xMemPressureWatermarkSet(free-TEST_PRESSURE_SIZE/2);
+    TEST_CHECK(xMemPressureRegister(test_shed,NULL)==0);
+    xMemTagQuotaSet(1,TEST_PRESSURE_SIZE+1);
+    TEST_CHECK(xmalloc_tag(TEST_PRESSURE_SIZE+1,1)==NULL);
+    p=xmalloc(TEST_PRESSURE_SIZE);
+    TEST_CHECK(p!=NULL);
+    TEST_CHECK(test_low==1);
+    xfree(p);
+    xMemTagQuotaSet(1,0);
+    xMemPressureUnregister(test_shed,NULL);
+    xMemPressureWatermarkSet(0);
+}
+#endif
+#endif
+
+#if XMEM_SUPERBLOCK_ENABLE
+#define TEST_KEEP_BLOCKS    256
+
+/* a super block that runs empty is kept for the next request of its size */
+static void test_keep(void)
+{
+    static void * p[TEST_KEEP_BLOCKS];
+    unsigned int i,n,before;
+
+    before=test_free();
+    for(n=0;n<TEST_KEEP_BLOCKS;n++)
+    {
+        p[n]=xmalloc(8);
+        TEST_CHECK(p[n]!=NULL);
+        if(p[n]==NULL) break;
+        if(test_free()<before)
+        {
+            n++;
+            break;
+        }
+    }
+    TEST_CHECK(n>0&&test_free()<before);
+    if(n==0) return;
+
+    //the last block is alone in a new super block
+    before=test_free();
+    xfree(p[--n]);
+    TEST_CHECK(test_free()==before);
+    p[n]=xmalloc(8);
+    TEST_CHECK(test_free()==before);
+    n++;
+    for(i=0;i<n;i++) xfree(p[i]);
+}
+#endif
+
+/* reserved room is used by the requests it was made for, what does not fit is refused */
+static void test_reserve(void)
+{
+    unsigned int used;
+#if !XMEM_DEFER_COALESCE_ENABLE || XMEM_SUPERBLOCK_ENABLE
+    unsigned int before;
+#endif
+#if XMEM_SUPERBLOCK_ENABLE
+    void * p[32];
+    unsigned int i;
+#endif
+
+    used=test_used();
+    #if !XMEM_DEFER_COALESCE_ENABLE
+    before=test_free();
+    #endif
+    TEST_CHECK(xMemReserve(0,1)<0);
+    TEST_CHECK(xMemReserve(XMEM_POOL_SIZE+1,1)<0);
+    TEST_CHECK(xMemReserve(XMEM_POOL_SIZE/2,4)<0);
+    TEST_CHECK(xMemReserve(200,4)==0);
+    TEST_CHECK(test_used()==used);
+    #if !XMEM_DEFER_COALESCE_ENABLE
+    //the blocks merged back as they were freed, deferred ones keep their headers
+    TEST_CHECK(test_free()==before);
+    #endif
+
+#if XMEM_SUPERBLOCK_ENABLE
+    //small enough for a super block with both canaries
+    TEST_CHECK(xMemReserve(8,32)==0);
+    before=test_free();
+    for(i=0;i<32;i++)
+    {
+        p[i]=xmalloc(8);
+        TEST_CHECK(p[i]!=NULL);
+    }
+    TEST_CHECK(test_free()==before);
+    for(i=0;i<32;i++) xfree(p[i]);
+#endif
+}
+
+#if XMEM_TUNE_ENABLE
+#define TEST_TUNE_PATH      "xmem_test_tuned.h"
+#define TEST_TUNE_BLOCKS    20
+
+/* the tuned config counts the requests and sizes the pool and the super blocks */
+static void test_tune(void)
+{
+    void * p[TEST_TUNE_BLOCKS];
+    unsigned int i,requests=0,pool=0,cnt=0;
+    char line[128];
+    FILE * fp;
+
+    for(i=0;i<TEST_TUNE_BLOCKS;i++) p[i]=xmalloc(8+i*4);
+    for(i=0;i<TEST_TUNE_BLOCKS;i++) xfree(p[i]);
+
+    TEST_CHECK(xMemTuneDump(TEST_TUNE_PATH)==0);
+    fp=fopen(TEST_TUNE_PATH,"r");
+    TEST_CHECK(fp!=NULL);
+    if(fp==NULL) return;
+    while(fgets(line,sizeof(line),fp))
+    {
+        sscanf(line,"/* generated by xMemTuneDump from %u requests",&requests);
+        sscanf(line,"#define XMEM_POOL_SIZE    (1024*%u)",&pool);
+        sscanf(line,"#define XMEM_SUPERBLOCK_1META_CNT    ((u32)%u)",&cnt);
+    }
+    fclose(fp);
+    TEST_CHECK(requests>=TEST_TUNE_BLOCKS);
+    TEST_CHECK(pool>=1);
+    TEST_CHECK(cnt>=2&&cnt<=XMEM_SUPERBLOCK_BLKS_MAX);
+
+    TEST_CHECK(xMemTuneDump("/nonexistent/xmem_test_tuned.h")==-1);
+    unlink(TEST_TUNE_PATH);
+}
+#endif
+
+#if XMEM_MAINT_ENABLE
+#define TEST_MAINT_BLOCKS   (XMEM_SUPERBLOCK_BLKS_MAX*4)
+
+/* xfree leaves empty super blocks to the maintenance pass, which gives them back */
+static void test_maint(void)
+{
+    void * p[TEST_MAINT_BLOCKS];
+    unsigned int i,n;
+    #if XMEM_SUPERBLOCK_ENABLE
+    unsigned int before;
+    #endif
+
+    for(i=0;i<TEST_MAINT_BLOCKS;i++) p[i]=xmalloc(8);
+    for(i=0;i<TEST_MAINT_BLOCKS;i++) xfree(p[i]);
+    #if XMEM_SUPERBLOCK_ENABLE
+    before=test_free();
+    n=xMemMaintain();
+    TEST_CHECK(n>0);
+    TEST_CHECK(test_free()>before);
+    #else
+    n=xMemMaintain();
+    #endif
+    for(i=0;i<16&&n;i++) n=xMemMaintain();
+    TEST_CHECK(n==0);
+
+    TEST_CHECK(xMemMaintStart(1)==0);
+    TEST_CHECK(xMemMaintStart(1)<0);
+    for(i=0;i<TEST_MAINT_BLOCKS;i++) p[i]=xmalloc(8);
+    for(i=0;i<TEST_MAINT_BLOCKS;i++) xfree(p[i]);
+    usleep(20000);
+    xMemMaintStop();
+    TEST_CHECK(xMemMaintain()==0);
+}
+#endif
+
+#if XMEM_EPOCH_ENABLE
+#define TEST_EPOCH_BLOCKS   (XMEM_EPOCH_BATCH+XMEM_EPOCH_RETIRE_MAX+8)
+
+/* a retired block lives until the readers that could see it have left */
+static void test_epoch(void)
+{
+    void * p[TEST_EPOCH_BLOCKS];
+    void * full;
+    unsigned char * q;
+    unsigned int i,n,used;
+
+    //empty super blocks are kept, let them grow before the count is taken
+    for(n=0;n<TEST_EPOCH_BLOCKS;n++)
+    {
+        p[n]=xmalloc(8);
+        if(p[n]==NULL) break;
+    }
+    for(i=0;i<n;i++) xfree(p[i]);
+    xMemEpochReclaim();
+    used=test_used();
+
+    xMemEpochEnter();
+    q=(unsigned char *)xmalloc(32);
+    TEST_CHECK(q!=NULL);
+    if(q==NULL) return;
+    test_fill(q,32,7);
+    TEST_CHECK(xfree_deferred(q)==0);
+    xMemEpochReclaim();
+    xMemEpochReclaim();
+    TEST_CHECK(test_used()==used+1);
+    TEST_CHECK(test_same(q,32,7));
+
+    //nested sections hold the block as well
+    xMemEpochEnter();
+    xMemEpochExit();
+    xMemEpochReclaim();
+    TEST_CHECK(test_used()==used+1);
+    xMemEpochExit();
+    TEST_CHECK(xMemEpochReclaim()>=1);
+    TEST_CHECK(test_used()==used);
+
+    //more than a retire chunk holds. the pool may not hold them all without super
+    //blocks, then the next chunk can not be had while this reader holds the epoch
+    xMemEpochEnter();
+    for(n=0;n<TEST_EPOCH_BLOCKS;n++)
+    {
+        p[n]=xmalloc(8);
+        if(p[n]==NULL) break;
+    }
+    TEST_CHECK(n>XMEM_EPOCH_BATCH);
+    for(i=0;i<n&&xfree_deferred(p[i])==0;i++);
+    xMemEpochExit();
+    for(;i<n;i++) xfree(p[i]);
+    xMemEpochReclaim();
+    TEST_CHECK(test_used()==used);
+
+    //a full pool fails the retire of a reader that holds the epoch instead of waiting for it
+    xMemEpochEnter();
+    for(n=0;n<TEST_EPOCH_BLOCKS;n++)
+    {
+        p[n]=xmalloc(8);
+        if(p[n]==NULL) break;
+    }
+    full=NULL;
+    while((q=(unsigned char *)xmalloc(200))!=NULL)
+    {
+        *(void **)q=full;
+        full=q;
+    }
+    for(i=0;i<n&&xfree_deferred(p[i])==0;i++);
+    //the first chunks of two epochs may hold all the pool had room for
+    TEST_CHECK(i<n||n<=XMEM_EPOCH_BATCH+XMEM_EPOCH_RETIRE_MAX);
+    xMemEpochExit();
+    for(;i<n;i++) xfree(p[i]);
+    while(full)
+    {
+        q=(unsigned char *)full;
+        full=*(void **)q;
+        xfree(q);
+    }
+    xMemEpochReclaim();
+    TEST_CHECK(test_used()==used);
+}
+
+#define TEST_EPOCH_READERS  (XMEM_EPOCH_THREADS+8)
+
+static pthread_barrier_t test_barrier;
+
+static void * test_epoch_reader(void *arg)
+{
+    (void)arg;
+    xMemEpochEnter();
+    xMemEpochExit();
+    pthread_barrier_wait(&test_barrier);
+    return NULL;
+}
+
+/* live threads beyond the epoch slots enter one after another */
+static void test_epoch_threads(void)
+{
+    pthread_t tid[TEST_EPOCH_READERS];
+    unsigned int i,n;
+
+    pthread_barrier_init(&test_barrier,NULL,TEST_EPOCH_READERS+1);
+    for(n=0;n<TEST_EPOCH_READERS;n++)
+    {
+        if(pthread_create(&tid[n],NULL,test_epoch_reader,NULL)!=0) break;
+    }
+    TEST_CHECK(n==TEST_EPOCH_READERS);
+    if(n==TEST_EPOCH_READERS) pthread_barrier_wait(&test_barrier);
+    for(i=0;i<n;i++) pthread_join(tid[i],NULL);
+    pthread_barrier_destroy(&test_barrier);
+}
+#endif
+
+#if XMEM_XBUF_ENABLE
+/* slices share the data of their buffers, the last reference frees it */
+static void test_xbuf(void)
+{
+    xbuf * a,* b,* chain,* s,* s2;
+    char out[32];
+    unsigned int used;
+
+    used=test_used();
+    a=xballoc(10);
+    b=xballoc(7);
+    TEST_CHECK(a!=NULL&&b!=NULL);
+    if(a==NULL||b==NULL) return;
+    memcpy(a->data,"0123456789",10);
+    memcpy(b->data,"abcdefg",7);
+
+    chain=xbchain(a,b);
+    TEST_CHECK(chain==a);
+    TEST_CHECK(xblength(chain)==17);
+
+    //a slice over both buffers
+    s=xbslice(chain,8,5);
+    TEST_CHECK(s!=NULL&&s->next!=NULL&&s->next->next==NULL);
+    TEST_CHECK(xblength(s)==5);
+    TEST_CHECK(xbgather(s,0,out,sizeof(out))==5&&memcmp(out,"89abc",5)==0);
+    TEST_CHECK(xbslice(chain,15,5)==NULL);
+
+    s2=xbslice(s,1,3);
+    TEST_CHECK(s2!=NULL);
+    xbfree(chain);
+    //the buffers live on in the slices
+    TEST_CHECK(xbgather(s2,0,out,3)==3&&memcmp(out,"9ab",3)==0);
+    xbfree(s);
+    TEST_CHECK(xbgather(s2,0,out,3)==3&&memcmp(out,"9ab",3)==0);
+    xbfree(s2);
+
+    TEST_CHECK(xballoc(XMEM_POOL_SIZE+1)==NULL);
+    TEST_CHECK(test_used()==used);
+}
+#endif
+
+#if XMEM_POOL_FILE_ENABLE
+#define TEST_FILE_PATH  "xmem_test.heap"
+#define TEST_FILE_BLOCKS    8
+
+typedef struct{
+    unsigned char * blk[TEST_FILE_BLOCKS];
+    unsigned int size[TEST_FILE_BLOCKS];
+}test_file_root;
+
+/* a heap closed and opened again keeps its blocks, root and free space */
+static void test_file(void)
+{
+    test_file_root * root;
+    unsigned int i,used;
+    void * p;
+
+    root=(test_file_root *)xmalloc(sizeof(test_file_root));
+    TEST_CHECK(root!=NULL);
+    if(root==NULL) return;
+    for(i=0;i<TEST_FILE_BLOCKS;i++)
+    {
+        root->size[i]=8+i*i*40;
+        root->blk[i]=(unsigned char *)xmalloc(root->size[i]);
+        TEST_CHECK(root->blk[i]!=NULL);
+        if(root->blk[i]) test_fill(root->blk[i],root->size[i],(unsigned char)i);
+    }
+    xMemRootSet(root);
+    used=test_used();
+
+    xMemFileClose();
+    TEST_CHECK(xMemRootGet()==NULL);
+    TEST_CHECK(xMemFileOpen(TEST_FILE_PATH,NULL)==1);
+
+    TEST_CHECK(xMemRootGet()==root);
+    TEST_CHECK(test_used()==used);
+    for(i=0;i<TEST_FILE_BLOCKS;i++)
+    {
+        if(root->blk[i]) TEST_CHECK(test_same(root->blk[i],root->size[i],(unsigned char)i));
+    }
+
+    //the lists are in working order, freed space is given out again
+    for(i=0;i<TEST_FILE_BLOCKS;i+=2) xfree(root->blk[i]);
+    p=xmalloc(root->size[TEST_FILE_BLOCKS-2]);
+    TEST_CHECK(p!=NULL);
+    xfree(p);
+    for(i=1;i<TEST_FILE_BLOCKS;i+=2) xfree(root->blk[i]);
+    xMemRootSet(NULL);
+    xfree(root);
+}
+#endif
+
+#if XMEM_POOL_SHARED_ENABLE
+#define TEST_SHARED_NAME    "/xmem_test"
+
+typedef struct{
+    unsigned char * parent;
+    unsigned char * child;
+}test_shared_root;
+
+/* another process attaches, reads what this one wrote and allocates for it */
+static void test_shared(void)
+{
+    test_shared_root * root;
+    unsigned int used;
+    pid_t pid;
+    int status,ok;
+
+    used=test_used();
+    root=(test_shared_root *)xmalloc(sizeof(test_shared_root));
+    TEST_CHECK(root!=NULL);
+    if(root==NULL) return;
+    root->parent=(unsigned char *)xmalloc(100);
+    root->child=NULL;
+    TEST_CHECK(root->parent!=NULL);
+    if(root->parent==NULL) return;
+    test_fill(root->parent,100,3);
+    xMemRootSet(root);
+
+    fflush(stdout);
+    pid=fork();
+    if(pid==0)
+    {
+        //the child starts over as a process of its own
+        xMemSharedClose();
+        ok=xMemSharedOpen(TEST_SHARED_NAME,NULL)==1;
+        root=(test_shared_root *)xMemRootGet();
+        ok=ok&&root!=NULL&&test_same(root->parent,100,3);
+        if(ok)
+        {
+            xfree(root->parent);
+            root->parent=NULL;
+            root->child=(unsigned char *)xmalloc(200);
+            ok=root->child!=NULL;
+            if(ok) test_fill(root->child,200,9);
+        }
+        xMemSharedClose();
+        _exit(ok?0:1);
+    }
+    TEST_CHECK(pid>0&&waitpid(pid,&status,0)==pid);
+    TEST_CHECK(WIFEXITED(status)&&WEXITSTATUS(status)==0);
+
+    TEST_CHECK(root->parent==NULL);
+    TEST_CHECK(root->child!=NULL);
+    if(root->child)
+    {
+        TEST_CHECK(test_same(root->child,200,9));
+        TEST_CHECK(xMemOffsetToPtr(xMemPtrToOffset(root->child))==root->child);
+        xfree(root->child);
+    }
+    xMemRootSet(NULL);
+    xfree(root);
+    TEST_CHECK(test_used()==used);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    #if XMEM_POOL_FILE_ENABLE
+    unlink(TEST_FILE_PATH);
+    if(xMemFileOpen(TEST_FILE_PATH,NULL)!=0)
+    {
+        printf("FAIL: can not create %s\n",TEST_FILE_PATH);
+        return 1;
+    }
+    #elif XMEM_POOL_SHARED_ENABLE
+    shm_unlink(TEST_SHARED_NAME);
+    if(xMemSharedOpen(TEST_SHARED_NAME,NULL)!=0)
+    {
+        printf("FAIL: can not create %s\n",TEST_SHARED_NAME);
+        return 1;
+    }
+    #endif
+
+    //xMemInit();
+    test_dump();
+
+    #if XMEM_BOUNDRY_CHECK_ENABLE && !XMEM_POOL_FILE_ENABLE && !XMEM_POOL_SHARED_ENABLE && !defined(NDEBUG)
+    test_check();
+    #endif
+    #if XMEM_CANARY_ENABLE && !XMEM_POOL_FILE_ENABLE && !XMEM_POOL_SHARED_ENABLE && !defined(NDEBUG)
+    test_canary();
+    #endif
+    test_realloc();
+    #if XMEM_DEFER_COALESCE_ENABLE
+    test_coalesce();
+    #endif
+    #if XMEM_HANDLE_ENABLE
+    test_compact();
+    #endif
+    #if XMEM_REGION_ENABLE
+    test_region();
+    #endif
+    #if XMEM_SUPERBLOCK_ENABLE && XMEM_CACHE_ENABLE
+    test_cache();
+    #endif
+    test_owns();
+    #if XMEM_SHIM_ENABLE
+    test_shim();
+    #endif
+    test_aligned();
+    test_usable();
+    #if !XMEM_DEFER_COALESCE_ENABLE
+    test_policy();
+    #endif
+    #if XMEM_HEADER_PROTECT_ENABLE
+    test_gap();
+    #endif
+    #if XMEM_FREE_INDEX_ENABLE && !XMEM_DEFER_COALESCE_ENABLE
+    test_free_index();
+    #endif
+    #if XMEM_HEADER_PROTECT_ENABLE && !XMEM_DEFER_COALESCE_ENABLE
+    test_hdr_pages();
+    #endif
+    #if XMEM_PROFILE_ENABLE
+    test_profile();
+    #endif
+    test_snapshot();
+    #if XMEM_TAG_ENABLE
+    test_tags();
+    #endif
+    #if XMEM_PRESSURE_ENABLE
+    test_pressure(0);
+    #if XMEM_TAG_ENABLE
+    test_pressure(3);
+    #endif
+    #if XMEM_TAG_ENABLE
+    test_pressure_quota();
+    #endif
+    #endif
+    #if XMEM_SUPERBLOCK_ENABLE
+    test_keep();
+    #endif
+    test_reserve();
+    #if XMEM_TUNE_ENABLE
+    test_tune();
+    #endif
+    #if XMEM_MAINT_ENABLE
+    test_maint();
+    #endif
+    #if XMEM_EPOCH_ENABLE
+    test_epoch();
+    test_epoch_threads();
+    #endif
+    #if XMEM_XBUF_ENABLE
+    test_xbuf();
+    #endif
+
+    #if XMEM_POOL_FILE_ENABLE
+    test_file();
+    xMemFileClose();
+    unlink(TEST_FILE_PATH);
+    #elif XMEM_POOL_SHARED_ENABLE
+    test_shared();
+    xMemSharedClose();
+    shm_unlink(TEST_SHARED_NAME);
+    #endif
 
-    return 0;
+    if(test_failed) printf("%d checks failed\n",test_failed);
+    return test_failed;
 }
@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include <list>
+#include <memory_resource>
+#include "xmem.hpp"
+
+/***************************************************************************
+ * xmem C++ adapter tests
+ *
+ * Containers on xmem::allocator and on the memory resources keep their
+ * elements in the pool, with the alignment they ask for:
+ *
+ *  gcc -c -DCPU_64_BIT=1 xmem.c -o xmem.o
+ *  g++ -std=c++17 -DCPU_64_BIT=1 xmem_test_cpp.cpp xmem.o -o xmem_test_cpp
+ *
+ * The exit code is the number of failed checks.
+ * *************************************************************************/
+
+#define TEST_ELEMS  300
+
+static int test_failed = 0;
+
+#define TEST_CHECK(c)   do{ if(!(c)){ std::printf("FAIL %s:%d: %s\n",__FILE__,__LINE__,#c); test_failed++; } }while(0)
+
+struct alignas(64) test_line {
+    unsigned char data[64];
+};
+
+/* a vector grows in the pool and frees with the size it allocated */
+static void test_allocator(void)
+{
+    std::vector<int, xmem::allocator<int>> v;
+    std::list<int, xmem::allocator<int>> l;
+    int i;
+
+    for (i = 0; i < TEST_ELEMS; i++) v.push_back(i);
+    TEST_CHECK(xMemOwns(v.data()));
+    for (i = 0; i < TEST_ELEMS; i++) TEST_CHECK(v[i] == i);
+
+    for (i = 0; i < 16; i++) l.push_back(i);
+    TEST_CHECK(l.size() == 16 && l.front() == 0 && l.back() == 15);
+    TEST_CHECK(xMemOwns(&l.front()));
+
+    TEST_CHECK(xmem::allocator<int>() == xmem::allocator<long>());
+    TEST_CHECK(xmem::allocator<int>(std::pmr::new_delete_resource()) != xmem::allocator<int>());
+}
+
+/* the resource honours alignments above XMEM_ALIGN_SIZE and fails like operator new */
+static void test_heap_resource(void)
+{
+    std::pmr::vector<test_line> lines(xmem::heap());
+    std::pmr::vector<int> v(xmem::heap());
+    bool thrown = false;
+    int i;
+
+    for (i = 0; i < 4; i++) lines.emplace_back();
+    TEST_CHECK(xMemOwns(lines.data()));
+    TEST_CHECK((reinterpret_cast<std::uintptr_t>(lines.data()) & 63) == 0);
+
+    for (i = 0; i < TEST_ELEMS; i++) v.push_back(i);
+    TEST_CHECK(xMemOwns(v.data()) && v[TEST_ELEMS - 1] == TEST_ELEMS - 1);
+
+    try {
+        (void)xmem::heap()->allocate(XMEM_POOL_SIZE * 2);
+    } catch (const std::bad_alloc &) {
+        thrown = true;
+    }
+    TEST_CHECK(thrown);
+    TEST_CHECK(xmem::heap()->is_equal(*xmem::heap()));
+}
+
+#if XMEM_REGION_ENABLE
+/* a region frees nothing until release, its blocks are aligned as asked */
+static void test_region_resource(void)
+{
+    xmem::region_resource rgn(512);
+    void * a, * b;
+
+    a = rgn.allocate(40, 8);
+    b = rgn.allocate(40, 64);
+    TEST_CHECK(xMemOwns(a) && xMemOwns(b));
+    TEST_CHECK((reinterpret_cast<std::uintptr_t>(b) & 63) == 0);
+    rgn.deallocate(a, 40, 8);
+    TEST_CHECK(rgn.allocate(40, 8) != a);
+    TEST_CHECK(!rgn.is_equal(*xmem::heap()));
+    rgn.release();
+}
+#endif
+
+int main()
+{
+    test_allocator();
+    test_heap_resource();
+    #if XMEM_REGION_ENABLE
+    test_region_resource();
+    #endif
+
+    if (test_failed) std::printf("%d checks failed\n", test_failed);
+    return test_failed;
+}
@@ -1,18 +1,24 @@
 #ifndef __XTYPES_H__
 #define __XTYPES_H__
 
+#include <stdint.h>
 #include "xconfig.h"
 
 typedef int s32;
 typedef unsigned int u32;
+typedef unsigned long long u64;
 typedef short s16;
 typedef unsigned short u16;
 typedef char s8;
 typedef unsigned char u8;
+typedef uintptr_t uptr;
 
 
 #define XMEM_ATTR_PACKED __attribute((packed))
 #define XMEM_ATTR_ALIGNED_4 __attribute((aligned(4)))
+#define XMEM_ATTR_ALIGNED_POOL __attribute((aligned(XMEM_ALIGN_SIZE)))
+#define XMEM_ATTR_ALIGNED_VECTOR __attribute((aligned(32)))
+#define XMEM_ATTR_ALIGNED_CACHE __attribute((aligned(64)))
 
 
 enum{
@@ -21,25 +27,27 @@ enum{
     XMEM_LIST_TYPE_SUPERBLOCK,
 };
 
-typedef struct XMEM_ATTR_PACKED XMEM_ATTR_ALIGNED_4  t_xMemManagementHeader{
-    struct t_xMemManagementHeader * next;
-    u8 reserve;
-    u8 type;
-    u16 size;
-}xMemMgrHdr,*pxMemMgrHdr;
+enum{
+    XMEM_BLOCK_USED=0,
+    XMEM_BLOCK_FREE,
+    XMEM_BLOCK_DEFERRED,
+};
+
+/* first slot of a header page, bit n of freemap set means slot n is free */
+typedef struct t_xMemHeaderPage{
+    struct t_xMemHeaderPage * next;
+    struct t_xMemHeaderPage * prev;
+    u32 freemap;
+}xMemHdrPage,*pxMemHdrPage;
 
-typedef struct XMEM_ATTR_PACKED XMEM_ATTR_ALIGNED_4 t_xMemBlock{
+typedef struct t_xMemBlock{
     struct t_xMemBlock * next;
-    #if XMEM_HEADER_PROTECT_ENABLE == 0
+    #if XMEM_HEADER_PROTECT_ENABLE
     void * addr;
     #endif
     u32 blksize;
     u8 free;
-    #if XMEM_HEADER_PROTECT_ENABLE == 0
     u8 reserve[3];
-    #else
-    u8 reserve;
-    #endif
 }xMemBlock,*pxMemBlock;
 
 typedef struct XMEM_ATTR_PACKED XMEM_ATTR_ALIGNED_4 t_xMemSuperBlock{
@@ -52,7 +60,31 @@ typedef struct XMEM_ATTR_PACKED XMEM_ATTR_ALIGNED_4 t_xMemSuperBlock{
 }xMemSuperBlock;
 
 
-#define XMEM_HEADER_SIZE sizeof(xMemMgrHdr)
+/* block flags are kept in the spare reserve byte of the block header */
+#define XMEM_BLOCK_FLAGS(blk)   ((blk)->reserve[0])
+
+#define XMEM_BLOCK_FLAG_HANDLE  0x01
+
+/* address of the memory a block header manages */
+#if XMEM_HEADER_PROTECT_ENABLE
+#define XMEM_BLOCK_ADDR(blk)    ((blk)->addr)
+#else
+#define XMEM_BLOCK_ADDR(blk)    ((void*)(blk)+XMEM_BLOCK_SIZE)
+#endif
+
+/* slot size of the super block a block holds, kept in the next reserve byte */
+#if XMEM_HEADER_PROTECT_ENABLE == 0
+#define XMEM_BLOCK_SLOT(blk)    ((blk)->reserve[1])
+#endif
+
+/* allocation tag of a block, 0 if untagged, kept in the last reserve byte */
+#define XMEM_BLOCK_TAG(blk)     ((blk)->reserve[2])
+
+#define XMEM_SIZE_MAX(a,b) ((a)>(b)?(a):(b))
+
+/* a header slot holds a block header, a super block header or the page itself */
+#define XMEM_HEADER_SIZE ((XMEM_SIZE_MAX(XMEM_SIZE_MAX(sizeof(xMemBlock),sizeof(xMemSuperBlock)),sizeof(xMemHdrPage))+sizeof(void*)-1)&~(sizeof(void*)-1))
+#define XMEM_HEADER_PAGE_SIZE (XMEM_HEADER_SIZE*XMEM_HEADER_PAGE_SLOTS)
 #define XMEM_BLOCK_SIZE sizeof(xMemBlock)
 #define XMEM_NODE_SIZE(t) sizeof(t)
 